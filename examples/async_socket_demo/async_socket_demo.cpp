@@ -0,0 +1,57 @@
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <iostream>
+#include "phawd/phawd.h"
+
+using namespace phawd;
+// socket_demo with the socket handled by a background I/O thread: the control loop runs at 1 kHz and only
+// touches lock-free queues, it neither waits for phawd nor spins on Read()
+int main() {
+    bool usingPhawd = true;
+    size_t waveParamNum = 2;
+    size_t controlParamNum = 2;
+    size_t sendSize = sizeof(SocketToPhawd) + waveParamNum * sizeof(Parameter);
+    size_t readSize = sizeof(SocketFromPhawd) + controlParamNum * sizeof(Parameter);
+    AsyncSocketConnect<SocketToPhawd, SocketFromPhawd> socket;
+
+    try {
+        socket.Init(sendSize, readSize);
+        socket.getSocket().connectToServer("127.0.0.1", 5230);
+        socket.getSocket().setSchemaHandshake(true);
+        // the I/O thread sends what was queued every 500 us, as 10 cycles per frame at most
+        socket.getSocket().setBatch(10, 5000);
+        socket.Start(500);
+    } catch(std::runtime_error &err) {
+        printf("%s\n", err.what());
+        printf("Connect server error, don't use phawd here \n");
+        usingPhawd = false;
+    }
+    if (!usingPhawd) {
+        return 0;
+    }
+
+    SocketToPhawd *send_data = socket.getSend();
+    send_data->numWaveParams = waveParamNum;
+    send_data->parameters[0].setName("pd");
+    send_data->parameters[1].setName("sin");
+    send_data->parameters[0].setValue(0.0);
+    send_data->parameters[1].setValue(0.0);
+
+    double pd = 0;
+    auto next = std::chrono::steady_clock::now();
+    for (size_t iter = 0; iter < 60000 && socket.isConnected(); iter++) {
+        if (socket.Read() > 0) {
+            pd = socket.getRead()->parameters[0].getDouble();
+        }
+        send_data->parameters[0].setValue(pd);
+        send_data->parameters[1].setValue(std::sin((double)iter * 0.001 * 2 * 3.1415926));
+        socket.Send();
+
+        next += std::chrono::milliseconds(1);
+        std::this_thread::sleep_until(next);
+    }
+    std::cout << "messages dropped: " << socket.dropped() << std::endl;
+    socket.Close();
+    return 0;
+}
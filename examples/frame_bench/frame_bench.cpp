@@ -0,0 +1,195 @@
+// Bytes sent with FRAME_TO_PHAWD_DELTA instead of whole SocketToPhawd messages, for a robot program with many
+// waveform parameters of which only a few change every control cycle, see SocketConnect::setKeyframeInterval().
+// Everything is encoded and applied in memory, the receiver's copy has to end up identical to the sender's.
+// Then the loss, reorder and duplicate accounting of SequenceTracker, for sequences with known drops, swaps and
+// repeats.
+#include <array>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include "phawd/phawd.h"
+
+using namespace phawd;
+
+// what a whole FRAME_TO_PHAWD does on both sides, SocketToPhawd::operator= would realloc the message
+static void copyMessage(const SocketToPhawd *from, SocketToPhawd *to) {
+    to->timestamp = from->timestamp;
+    for (size_t i = 0; i < from->numWaveParams; ++i) {
+        to->parameters[i] = from->parameters[i];
+    }
+}
+
+static bool sameValues(const SocketToPhawd *a, const SocketToPhawd *b) {
+    for (size_t i = 0; i < a->numWaveParams; ++i) {
+        ParameterValue va, vb;
+        ParameterKind kind = a->parameters[i].readValue(va);
+        if (b->parameters[i].readValue(vb) != kind) {
+            return false;
+        }
+        bool same = true;
+        switch (kind) {
+            case ParameterKind::FLOAT:
+                same = va.f == vb.f;
+                break;
+            case ParameterKind::DOUBLE:
+                same = va.d == vb.d;
+                break;
+            case ParameterKind::S64:
+                same = va.i == vb.i;
+                break;
+            case ParameterKind::VEC3_DOUBLE:
+                same = std::memcmp(va.vec3d, vb.vec3d, sizeof(va.vec3d)) == 0;
+                break;
+            default:
+                break;
+        }
+        if (!same) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void deltaBench(size_t channels, size_t changes, size_t messages) {
+    size_t messageSize = sizeof(SocketToPhawd) + channels * sizeof(Parameter);
+    SocketToPhawd *current = SocketToPhawd::create((int)channels);
+    SocketToPhawd *baseline = SocketToPhawd::create((int)channels);
+    SocketToPhawd *received = SocketToPhawd::create((int)channels);
+    for (size_t i = 0; i < channels; ++i) {
+        Parameter &parameter = current->parameters[i];
+        parameter.setName("ch" + std::to_string(i));
+        switch (i % 4) {
+            case 0:
+                parameter.setValue(0.5 * (double)i);
+                break;
+            case 1:
+                parameter.setValue(0.25f * (float)i);
+                break;
+            case 2:
+                parameter.setValue((long int)i);
+                break;
+            default:
+                parameter.setValue(std::array<double, 3>{(double)i, 0, 0});
+                break;
+        }
+    }
+    // the first message goes out whole
+    copyMessage(current, baseline);
+    copyMessage(current, received);
+
+    size_t deltaBytes = 0;
+    size_t wholeMessages = 0;
+    std::vector<char> frame;
+    for (size_t m = 0; m < messages; ++m) {
+        for (size_t c = 0; c < changes; ++c) {
+            Parameter &parameter = current->parameters[(m * 37 + c * 41) % channels];
+            ParameterValue value;
+            ParameterKind kind = parameter.readValue(value);
+            switch (kind) {
+                case ParameterKind::FLOAT:
+                    parameter.setValue(value.f + 1.0f);
+                    break;
+                case ParameterKind::DOUBLE:
+                    parameter.setValue(value.d + 0.001);
+                    break;
+                case ParameterKind::S64:
+                    // beyond 32 bits, S64 is 8 bytes on the wire whatever the size of long int
+                    parameter.setValue((long int)(value.i + 0x100000001LL));
+                    break;
+                default:
+                    value.vec3d[1] += 1.0;
+                    parameter.setValue(kind, value);
+                    break;
+            }
+        }
+        frame.clear();
+        if (encodeWaveDelta(current, baseline, messageSize, frame) &&
+            applyWaveDelta(received, frame.data(), frame.size())) {
+            deltaBytes += sizeof(SocketFrameHeader) + frame.size();
+        } else {
+            copyMessage(current, baseline);
+            copyMessage(current, received);
+            deltaBytes += sizeof(SocketFrameHeader) + messageSize;
+            ++wholeMessages;
+        }
+    }
+    size_t wholeBytes = messages * (sizeof(SocketFrameHeader) + messageSize);
+    printf("%8zu %8zu %14zu %14zu %8zu %10s\n", channels, changes, wholeBytes, deltaBytes, wholeMessages,
+           sameValues(current, received) ? "yes" : "NO");
+    SocketToPhawd::destroy(current);
+    SocketToPhawd::destroy(baseline);
+    SocketToPhawd::destroy(received);
+}
+
+// feed sequences first + order[i] to a tracker and compare its counts with the expected ones
+static void sequenceCase(const char *name, unsigned int first, const std::vector<unsigned int> &order,
+                         unsigned long long lost, unsigned long long reordered, unsigned long long duplicated) {
+    SequenceTracker tracker;
+    for (unsigned int offset : order) {
+        tracker.accept(first + offset);
+    }
+    bool ok = tracker.received() == order.size() && tracker.lost() == lost && tracker.reordered() == reordered &&
+              tracker.duplicated() == duplicated;
+    printf("%-24s %8llu %8llu %8llu %8llu %8llu %8llu %6s\n", name, tracker.lost(), lost, tracker.reordered(),
+           reordered, tracker.duplicated(), duplicated, ok ? "ok" : "WRONG");
+}
+
+static void sequenceBench(size_t frames) {
+    std::vector<unsigned int> inOrder, dropped, swapped, repeated, mixed;
+    unsigned long long drops = 0, repeats = 0;
+    for (unsigned int i = 0; i < frames; ++i) {
+        inOrder.push_back(i);
+        // every 10th frame arrives twice, the copy right after it or three frames later
+        repeated.push_back(i);
+        if (i % 10 == 3) {
+            repeated.push_back(i);
+            ++repeats;
+        } else if (i % 10 == 7) {
+            repeated.push_back(i - 3);
+            ++repeats;
+        }
+        // every 10th frame is lost, never the last one, a tracker can't know about losses at the end
+        if (i % 10 == 5) {
+            ++drops;
+        } else {
+            dropped.push_back(i);
+        }
+    }
+    // pairs after the first frame arrive swapped, each late frame was counted lost and is taken back
+    swapped.push_back(0);
+    for (unsigned int i = 1; i + 1 < frames; i += 2) {
+        swapped.push_back(i + 1);
+        swapped.push_back(i);
+    }
+    unsigned long long swaps = (swapped.size() - 1) / 2;
+    // a late frame taken back from the lost ones, then a copy of it, which must not be taken back a second time
+    mixed = {0, 2, 1, 1, 3, 2};
+    printf("%-24s %8s %8s %8s %8s %8s %8s\n", "sequence", "lost", "expected", "reorder", "expected", "dup",
+           "expected");
+    sequenceCase("in order", 0, inOrder, 0, 0, 0);
+    sequenceCase("every 10th lost", 0, dropped, drops, 0, 0);
+    sequenceCase("pairs swapped", 0, swapped, 0, swaps, 0);
+    sequenceCase("every 10th twice", 0, repeated, 0, 0, repeats);
+    sequenceCase("late then duplicated", 0, mixed, 0, 1, 2);
+    // the sequence of the sender wraps around after 2^32 frames
+    sequenceCase("lost across wrap around", 0xFFFFFFFFu - (unsigned int)frames / 2, dropped, drops, 0, 0);
+    sequenceCase("swapped across wrap", 0xFFFFFFFFu - (unsigned int)frames / 2, swapped, 0, swaps, 0);
+    sequenceCase("twice across wrap", 0xFFFFFFFFu - (unsigned int)frames / 2, repeated, 0, 0, repeats);
+}
+
+int main() {
+    const size_t messages = 1000;
+    printf("%zu messages each\n", messages);
+    printf("%8s %8s %14s %14s %8s %10s\n", "channels", "changes", "whole(bytes)", "delta(bytes)", "whole", "identical");
+    for (size_t channels : {20, 200, 1000}) {
+        for (size_t changes : {1, 5, 50}) {
+            if (changes < channels) {
+                deltaBench(channels, changes, messages);
+            }
+        }
+    }
+    printf("\n");
+    sequenceBench(messages);
+    return 0;
+}
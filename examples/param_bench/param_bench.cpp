@@ -0,0 +1,91 @@
+// Reading control parameters every cycle through ParameterCollection::lookup(), through ParameterHandle<T> and into
+// a struct with ParameterBinding, with 100 and 1000 parameters in the collection. Every cycle reads 5 of them, like
+// shm_demo does.
+#include <string>
+#include <vector>
+#include <cstdio>
+#include "phawd/phawd.h"
+
+using namespace phawd;
+
+const size_t reads = 5;
+
+// nanoseconds per cycle, the sum of the values read is returned in sum so that the reads can't be left out
+static double runLookup(ParameterCollection &collection, const std::vector<std::string> &names, size_t cycles,
+                        double &sum) {
+    long long start = getTimestamp();
+    for (size_t i = 0; i < cycles; ++i) {
+        for (size_t j = 0; j < reads; ++j) {
+            sum += collection.lookup(names[j]).getDouble();
+        }
+    }
+    return (double) (getTimestamp() - start) / (double) cycles;
+}
+
+static double runHandle(ParameterCollection &collection, const std::vector<std::string> &names, size_t cycles,
+                        double &sum) {
+    std::vector<ParameterHandle<double>> handles;
+    for (size_t j = 0; j < reads; ++j) {
+        handles.emplace_back(collection, names[j]);
+    }
+    long long start = getTimestamp();
+    for (size_t i = 0; i < cycles; ++i) {
+        for (size_t j = 0; j < reads; ++j) {
+            sum += handles[j].get();
+        }
+    }
+    return (double) (getTimestamp() - start) / (double) cycles;
+}
+
+struct Gains {
+    double values[reads];
+};
+
+static double runBinding(ParameterCollection &collection, const std::vector<std::string> &names, size_t cycles,
+                         double &sum) {
+    ParameterBinding<Gains> binding;
+    for (size_t j = 0; j < reads; ++j) {
+        binding.field<double>(names[j], j * sizeof(double));
+    }
+    binding.bind(collection);
+    Gains gains;
+    long long start = getTimestamp();
+    for (size_t i = 0; i < cycles; ++i) {
+        binding.pull(gains);
+        for (size_t j = 0; j < reads; ++j) {
+            sum += gains.values[j];
+        }
+    }
+    return (double) (getTimestamp() - start) / (double) cycles;
+}
+
+int main() {
+    const size_t cycles = 1000000;
+    const size_t counts[] = {100, 1000};
+    printf("%zu parameters read per cycle, %zu cycles\n", reads, cycles);
+    printf("%-12s %14s %14s %14s\n", "parameters", "lookup(ns)", "handle(ns)", "binding(ns)");
+    for (size_t count : counts) {
+        std::vector<Parameter> parameters(count);
+        ParameterCollection collection;
+        for (size_t i = 0; i < count; ++i) {
+            parameters[i].setName("param" + std::to_string(i));
+            parameters[i].setValue((double) i);
+            collection.addParameter(&parameters[i]);
+        }
+        collection.build();
+        // spread over the collection, not only the first names of the map
+        std::vector<std::string> names;
+        for (size_t j = 0; j < reads; ++j) {
+            names.push_back("param" + std::to_string(j * count / reads + count / (2 * reads)));
+        }
+        double sum = 0;
+        double lookup = runLookup(collection, names, cycles, sum);
+        double handle = runHandle(collection, names, cycles, sum);
+        double binding = runBinding(collection, names, cycles, sum);
+        printf("%-12zu %14.1f %14.1f %14.1f\n", count, lookup, handle, binding);
+        if (sum < 0) {
+            printf("%f\n", sum);
+        }
+    }
+    return 0;
+}
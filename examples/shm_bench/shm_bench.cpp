@@ -0,0 +1,86 @@
+// Cost of publishing a waveform parameter while phawd edits control parameters on another core,
+// with the packed layout and with separate cache lines for both regions, see SharedParameters::init()
+#include <atomic>
+#include <thread>
+#include <cstdio>
+#include "phawd/phawd.h"
+#if __linux__
+#include <pthread.h>
+#endif
+
+using namespace phawd;
+
+// @return false if the thread isn't pinned, e.g. the core doesn't exist
+static bool pinToCore(std::thread &thread, unsigned int core) {
+#if __linux__
+    if (core >= std::thread::hardware_concurrency()) {
+        printf("core %u doesn't exist, the thread isn't pinned\n", core);
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    return pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+// nanoseconds per write of the first waveform parameter, while the last control parameter is written
+// by another thread if contended
+static double run(bool separate_regions, bool contended, size_t writes) {
+    const size_t controlParamNum = 5;
+    const size_t waveParamNum = 5;
+    SharedMemory<SharedParameters> shm;
+    shm.createNew("phawd_bench", SharedParameters::getSize(controlParamNum, waveParamNum, 0, separate_regions));
+    shm().init(controlParamNum, waveParamNum, 0, separate_regions);
+    Parameter *control = &shm().parameters[controlParamNum - 1];
+    Parameter *wave = shm().getWaveParameters();
+    control->setValueKind(ParameterKind::DOUBLE);
+    wave->setValueKind(ParameterKind::DOUBLE);
+
+    std::atomic<bool> started{false}, stop{false};
+    std::thread displayer([&]() {
+        started = true;
+        for (double value = 0; !stop.load(std::memory_order_relaxed); value += 1) {
+            control->setValue(value);
+        }
+    });
+    pinToCore(displayer, 0);
+    if (!contended) {
+        stop = true;
+    }
+    while (!started) {
+        std::this_thread::yield();
+    }
+
+    long long elapsed = 0;
+    std::thread robot([&]() {
+        long long start = getTimestamp();
+        for (size_t i = 0; i < writes; ++i) {
+            wave->setValue((double) i);
+        }
+        elapsed = getTimestamp() - start;
+    });
+    pinToCore(robot, 1);
+    robot.join();
+    stop = true;
+    displayer.join();
+    shm.closeNew();
+    return (double) elapsed / (double) writes;
+}
+
+int main() {
+    const size_t writes = 20000000;
+    printf("%zu bytes per Parameter, %u cores\n", sizeof(Parameter), std::thread::hardware_concurrency());
+    if (std::thread::hardware_concurrency() < 2) {
+        printf("both threads share one core, the contended numbers say nothing about false sharing\n");
+    }
+    printf("%-10s %14s %14s\n", "layout", "alone(ns)", "contended(ns)");
+    for (bool separate : {false, true}) {
+        double alone = run(separate, false, writes);
+        double contended = run(separate, true, writes);
+        printf("%-10s %14.2f %14.2f\n", separate ? "separate" : "packed", alone, contended);
+    }
+    return 0;
+}
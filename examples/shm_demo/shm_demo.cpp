@@ -1,63 +1,102 @@
-#include <vector>
+#include <array>
 #include <memory>
 #include <iostream>
 #include "phawd/phawd.h"
 
 using namespace phawd;
+
+// control parameters of the demo, copied out of phawd in one go every cycle
+struct DemoParams {
+    float pf;
+    double pd;
+    long int ps64;
+    std::array<float, 3> pvec3f;
+    std::array<double, 3> pvec3d;
+};
+
 int main() {
     bool usingPhawd = true;
-    size_t waveParamNum = 5;
-    size_t controlParamNum = 5;
+    size_t waveParamNum = 6;
     auto shm = std::make_shared<SharedMemory<SharedParameters>>();
-    auto paramCollection = std::make_shared<ParameterCollection>();
+    // one collection per bank of control parameters, see SharedParameters::acquireControlBank()
+    std::shared_ptr<ParameterCollection> paramCollections[2] = {std::make_shared<ParameterCollection>(),
+                                                                std::make_shared<ParameterCollection>()};
+    // looked up once by name, reading them in the loop doesn't search the collections
+    ParameterBinding<DemoParams> bindings[2];
+    for (ParameterBinding<DemoParams> &binding : bindings) {
+        PHAWD_BIND_FIELD(binding, DemoParams, pf);
+        PHAWD_BIND_FIELD(binding, DemoParams, pd);
+        PHAWD_BIND_FIELD(binding, DemoParams, ps64);
+        PHAWD_BIND_FIELD(binding, DemoParams, pvec3f);
+        PHAWD_BIND_FIELD(binding, DemoParams, pvec3d);
+    }
+    int producer = -1;
     try {
-        shm->attach("demo", sizeof(SharedParameters) +
-        (waveParamNum + controlParamNum) * sizeof(Parameter));
+        // the size is taken from the shared memory itself, every page is mapped now and kept in RAM,
+        // so that the loop below never takes a page fault
+        shm->attach("demo", 0, SHM_PREFAULT | SHM_MLOCK);
+        // take our own range of waveform parameters, other programs may publish theirs in the same shared memory
+        producer = shm->get()->registerProducer("demo", waveParamNum);
     } catch(std::runtime_error &err) {
         printf("%s\n", err.what());
         printf("Attach shared memory error, don't use phawd here \n");
         usingPhawd = false;
     }
     if (usingPhawd){
-        std::string nameList[5] = {"pf", "pd", "ps64", "pvec3f", "pvec3d"};
-        controlParamNum = shm->get()->numControlParams;
-        shm->get()->connected += 1;
-        shm->get()->numWaveParams = waveParamNum;
+        std::string nameList[6] = {"pf", "pd", "ps64", "pvec3f", "pvec3d", "pjoints"};
         for (int i = 0; i < waveParamNum; ++i) {
-            shm->get()->parameters[controlParamNum +i].setName(nameList[i]);//Waveform parameters are appended after Control parameters
+            shm->get()->getProducerParameters(producer)[i].setName(nameList[i]);
         }
-        for (int i = 0; i < controlParamNum; ++i){
-            paramCollection->addParameter(&shm->get()->parameters[i]);
+        for (unsigned int bank = 0; bank < 2; ++bank) {
+            shm->get()->collectControlParameters(paramCollections[bank].get(), bank);
+            bindings[bank].bind(*paramCollections[bank]);
         }
     }
 
     size_t iter = 0;
-    float pf;
-    double pd;
-    long int ps64;
-    std::vector<float> pvec3f = {0, 0, 0};
-    std::vector<double> pvec3d = {0, 0, 0};
+    DemoParams params = {};
+    // all joints of the robot are published as one VECN_DOUBLE parameter, if phawd was given a DataArenaSize
+    bool publishJoints = usingPhawd && shm->get()->getDataArena() != nullptr;
+    std::array<double, 12> joints = {0};
 
+    // nothing in the loop allocates, it can run at the rate of the robot without touching the heap
     while (iter < 500000 && usingPhawd) {
-        pf = paramCollection->lookup("pf").getFloat();
-        pd = paramCollection->lookup("pd").getDouble();
-        ps64 = paramCollection->lookup("ps64").getS64();
-        pvec3f = paramCollection->lookup("pvec3f").getVec3f();
-        pvec3d = paramCollection->lookup("pvec3d").getVec3d();
-        shm->get()->parameters[controlParamNum + 0].setValue(pf);
-        shm->get()->parameters[controlParamNum + 1].setValue(pd);
-        shm->get()->parameters[controlParamNum + 2].setValue(ps64);
-        shm->get()->parameters[controlParamNum + 3].setValue(pvec3f);
-        shm->get()->parameters[controlParamNum + 4].setValue(pvec3d);
+        // all control parameters of this cycle come from the same update of phawd
+        unsigned int bank, generation;
+        do {
+            bank = shm->get()->acquireControlBank(generation);
+            bindings[bank].pull(params);
+        } while (!shm->get()->releaseControlBank(bank, generation));
+        Parameter *waveParams = shm->get()->getProducerParameters(producer);
+        waveParams[0].setValue(params.pf);
+        waveParams[1].setValue(params.pd);
+        waveParams[2].setValue(params.ps64);
+        waveParams[3].setValue(params.pvec3f);
+        waveParams[4].setValue(params.pvec3d);
+        if (publishJoints) {
+            for (size_t j = 0; j < joints.size(); ++j) {
+                joints[j] = params.pd * (double) j + 0.001 * (double) (iter % 1000);
+            }
+            shm->get()->setWaveArray(shm->get()->producers[producer].waveBegin + 5, joints.data(), joints.size());
+        }
+        shm->get()->pushProducerSamples(producer);
+        // waveform parameters may be added in phawd while we are running
+        if (shm->updateMapping()) {
+            std::cout << "numWaveParams:" << shm->get()->numWaveParams << std::endl;
+        }
         if (iter % 20 == 0){
-            std::cout << "pf:" << pf<< std::endl;
-            std::cout << "pd:" << pd<< std::endl;
-            std::cout << "ps64:" << ps64<< std::endl;
-            std::cout << "pvec3f:" << pvec3f[0] << " " << pvec3f[1] << " " << pvec3f[2] << std::endl;
-            std::cout << "pvec3d:" << pvec3d[0] << " " << pvec3d[1] << " " << pvec3d[2] << std::endl;
+            std::cout << "pf:" << params.pf << std::endl;
+            std::cout << "pd:" << params.pd << std::endl;
+            std::cout << "ps64:" << params.ps64 << std::endl;
+            std::cout << "pvec3f:" << params.pvec3f[0] << " " << params.pvec3f[1] << " " << params.pvec3f[2]
+                      << std::endl;
+            std::cout << "pvec3d:" << params.pvec3d[0] << " " << params.pvec3d[1] << " " << params.pvec3d[2]
+                      << std::endl;
         }
         iter++;
     }
-    shm->get()->connected -= 1;
+    if (usingPhawd) {
+        shm->get()->unregisterProducer(producer);
+    }
     return 0;
 }
@@ -1,42 +1,157 @@
 # robot controller
-from phawd import SharedMemory, SharedParameters, ParameterCollection, Parameter
+# attaches to the shared memory of phawd by name with mmap and struct only, the header tells where everything is.
+# The offsets below are those of SharedParameters version 8 built for 64-bit linux, the layout hash in the header
+# is checked against them before anything else is touched.
+# Python can't do the atomic compare-and-swap of SharedParameters::registerProducer() on the mapping, so this is a
+# legacy producer: it bumps connected and publishes the first waveform parameters, like programs did before the
+# producer registry. It refuses to run next to registered producers, whose ranges start at the same parameters
+import mmap
+import os
+import struct
+
+SHARED_MEMORY_MAGIC = 0x44574850    # "PHWD"
+SHARED_MEMORY_VERSION = 8
+
+# what SharedParameters::getLayoutHash() hashes, in its order
+LAYOUT = (8, 8, 8,                  # size_t, long, long long
+          48, 8, 24,                # Parameter, alignof(Parameter), ParameterValue
+          64, 8,                    # GamepadCommand, alignof(GamepadCommand)
+          1472, 64, 1472,           # SharedParameters, alignof(SharedParameters), offsetof(parameters)
+          32, 64, 192)              # WaveSample, alignof(SampleRing), SampleRing::getSize(0)
+PARAMETER_SIZE = 48
+
+# fields of SharedParameters
+HEADER = struct.Struct("<IIIIQQQQ")     # magic, version, layoutHash, parametersOffset, totalSize,
+                                        # numControlParams, numWaveParams, waveParamsBegin
+CONTROL_BANK_OFFSET = 72
+CONTROL_BANK = 128 + 4
+CONTROL_GENERATION = 128 + 8
+CONNECTED = 320
+ASSIGNED_WAVE_PARAMS = 328
+PRODUCERS = 384                 # SHARED_MEMORY_MAX_PRODUCERS ProducerSlots of 64 bytes, the state first
+PRODUCER_SLOT_SIZE = 64
+MAX_PRODUCERS = 16
+
+# fields of Parameter
+PARAM_SET = 0
+PARAM_NAME = 1
+PARAM_KIND = 18
+PARAM_SEQ = 20
+PARAM_VALUE = 24
+
+KINDS = {0: "<f", 1: "<d", 2: "<q", 3: "<3f", 4: "<3d"}
+FLOAT, DOUBLE, S64, VEC3_FLOAT, VEC3_DOUBLE = range(5)
+
+
+def layout_hash():
+    # FNV-1a over the bytes of every size_t of LAYOUT
+    h = 2166136261
+    for value in LAYOUT:
+        for byte in struct.pack("<Q", value):
+            h = ((h ^ byte) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def u32(buf, offset):
+    return struct.unpack_from("<I", buf, offset)[0]
+
+
+class SharedParameters:
+    def __init__(self, name):
+        # SharedMemory::createNew() puts it here, or into /dev/hugepages/ with RealTimeMemory
+        path = "/dev/shm/" + name
+        if not os.path.exists(path):
+            path = "/dev/hugepages/" + name
+        fd = os.open(path, os.O_RDWR)
+        try:
+            self.buf = mmap.mmap(fd, 0)
+        finally:
+            os.close(fd)
+        (magic, version, layout, self.parametersOffset, total_size,
+         self.numControlParams, self.numWaveParams, self.waveParamsBegin) = HEADER.unpack_from(self.buf, 0)
+        if magic != SHARED_MEMORY_MAGIC:
+            raise RuntimeError("%s is not a phawd shared memory, or it isn't initialized yet" % name)
+        if version != SHARED_MEMORY_VERSION or layout != layout_hash() or self.parametersOffset != LAYOUT[10]:
+            raise RuntimeError("the shared memory of phawd is laid out by another version, update this script")
+        if total_size > len(self.buf):
+            raise RuntimeError("the shared memory is smaller than its header says")
+        self.controlBankOffset = struct.unpack_from("<Q", self.buf, CONTROL_BANK_OFFSET)[0]
+        self.controlIndex = {self.getName(self.controlOffset(0, i)): i for i in range(self.numControlParams)}
+
+    def controlOffset(self, bank, index):
+        begin = self.controlBankOffset if bank == 1 and self.controlBankOffset != 0 else self.parametersOffset
+        return begin + index * PARAMETER_SIZE
+
+    def waveOffset(self, index):
+        return self.parametersOffset + (self.waveParamsBegin + index) * PARAMETER_SIZE
+
+    def getName(self, offset):
+        return bytes(self.buf[offset + PARAM_NAME:offset + PARAM_NAME + 16]).split(b"\0", 1)[0].decode()
+
+    def readValue(self, offset):
+        # retry until the sequence lock of the parameter is even and the same before and after the copy
+        while True:
+            seq = u32(self.buf, offset + PARAM_SEQ)
+            if seq & 1:
+                continue
+            kind = struct.unpack_from("<H", self.buf, offset + PARAM_KIND)[0]
+            value = bytes(self.buf[offset + PARAM_VALUE:offset + PARAMETER_SIZE])
+            if u32(self.buf, offset + PARAM_SEQ) == seq:
+                break
+        value = struct.unpack_from(KINDS[kind], value)
+        return value[0] if len(value) == 1 else list(value)
+
+    def writeValue(self, offset, name, kind, value):
+        # this process is the only writer of its waveform parameters, readers retry while the sequence is odd
+        seq = u32(self.buf, offset + PARAM_SEQ)
+        struct.pack_into("<I", self.buf, offset + PARAM_SEQ, seq + 1)
+        struct.pack_into("<?16sxH", self.buf, offset + PARAM_SET, True, name.encode(), kind)
+        value = value if isinstance(value, (list, tuple)) else [value]
+        struct.pack_into(KINDS[kind], self.buf, offset + PARAM_VALUE, *value)
+        struct.pack_into("<I", self.buf, offset + PARAM_SEQ, seq + 2)
+
+    def readControlParameters(self, names):
+        # all values come from the same update of phawd, see SharedParameters::acquireControlBank()
+        while True:
+            bank = u32(self.buf, CONTROL_BANK)
+            generation = u32(self.buf, CONTROL_GENERATION + 4 * bank)
+            if generation & 1:
+                continue
+            values = [self.readValue(self.controlOffset(bank, self.controlIndex[name])) for name in names]
+            if u32(self.buf, CONTROL_GENERATION + 4 * bank) == generation:
+                return values
+
+    def hasProducers(self):
+        assigned = struct.unpack_from("<Q", self.buf, ASSIGNED_WAVE_PARAMS)[0]
+        return assigned > 0 or any(u32(self.buf, PRODUCERS + i * PRODUCER_SLOT_SIZE) != 0 for i in range(MAX_PRODUCERS))
+
+    def addConnected(self, count):
+        # not atomic, Python can't do a read-modify-write on the mapping
+        connected = struct.unpack_from("<i", self.buf, CONNECTED)[0]
+        struct.pack_into("<i", self.buf, CONNECTED, connected + count)
+
 
 if __name__ == '__main__':
-    p0 = Parameter("pw_d", 12.13)
-    p1 = Parameter("pw_s64", 1213)
-    p2 = Parameter("pw_vec3d", [-1.4, 2, 3])
-
-    shm = SharedMemory()
-    pc = ParameterCollection()
-
-    p_size = Parameter.__sizeof__()
-    sp_size = SharedParameters.__sizeof__()
-    num_control_params = 3
-    num_wave_params = 3
-    shm_size = sp_size + (num_control_params + num_wave_params) * p_size
-
-    shm.attach("demo", shm_size)
-    sp = shm.get()
-    sp.setParameters([p0, p1, p2])
-    sp.connected += 1
-    ctr_params = sp.getParameters()
-    sp.collectParameters(pc)
+    sp = SharedParameters("demo")
+    wave_params = [("pw_d", DOUBLE), ("pw_s64", S64), ("pw_vec3d", VEC3_DOUBLE)]
+    if sp.hasProducers():
+        raise RuntimeError("programs registered as producers publish into this shared memory, run this demo alone")
+    if len(wave_params) > sp.numWaveParams:
+        raise RuntimeError("phawd has only %d waveform parameters" % sp.numWaveParams)
+    sp.addConnected(1)
 
     run_iter = 0
 
-    while run_iter < 500000:
-        run_iter += 1
-        p0.setValue(pc.lookup("pd").getDouble())
-        p1.setValue(pc.lookup("ps64").getS64())
-        p2.setValue(pc.lookup("pvec3d").getVec3d())
-        sp.setParameters([p0, p1, p2])
-
-        if run_iter % 20 == 0:
-            print(pc.lookup("ps64").getName(), ":")
-            print(pc.lookup("ps64").getS64())
-            print(pc.lookup("pd").getName(), ":")
-            print(pc.lookup("pd").getDouble())
-            print(pc.lookup("pvec3d").getName(), ":")
-            print(pc.lookup("pvec3d").getVec3d())
-
-    sp.connected -= 1
\ No newline at end of file
+    try:
+        while run_iter < 500000:
+            run_iter += 1
+            pd, ps64, pvec3d = sp.readControlParameters(["pd", "ps64", "pvec3d"])
+            for i, value in enumerate([pd, ps64, pvec3d]):
+                sp.writeValue(sp.waveOffset(i), wave_params[i][0], wave_params[i][1], value)
+
+            if run_iter % 20 == 0:
+                print("ps64 :", ps64)
+                print("pd :", pd)
+                print("pvec3d :", pvec3d)
+    finally:
+        sp.addConnected(-1)
@@ -0,0 +1,254 @@
+// Heap allocations and time per control cycle of SocketConnect::Send()/Read() over loopback, the robot program
+// of socket_demo against a server which answers every message like phawd does.
+// After the first cycles have sized the buffers, no mode should allocate anymore. Every operator new and every
+// malloc()/calloc()/realloc() is counted, of the library as well, so the counting needs glibc.
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "phawd/phawd.h"
+#if __linux__
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#endif
+
+using namespace phawd;
+
+#if __linux__ && defined(__GLIBC__)
+// only allocations of the control loop are counted, not the ones of the server thread
+static thread_local bool counting = false;
+static unsigned long long allocations = 0;
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void __libc_free(void *p);
+
+void *malloc(size_t size) {
+    if (counting) {
+        ++allocations;
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    if (counting) {
+        ++allocations;
+    }
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, size_t size) {
+    if (counting) {
+        ++allocations;
+    }
+    return __libc_realloc(p, size);
+}
+
+void free(void *p) {
+    __libc_free(p);
+}
+}
+
+void *operator new(size_t size) {
+    void *p = malloc(size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    __libc_free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    __libc_free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    __libc_free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    __libc_free(p);
+}
+
+const unsigned short port = 5231;
+const size_t waveParamNum = 50;
+const size_t controlParamNum = 10;
+
+// answer every message of the robot program with a SocketFromPhawd, until the client disconnects
+static void serve(int listen_fd) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    size_t replySize = sizeof(SocketFromPhawd) + controlParamNum * sizeof(Parameter);
+    std::vector<char> reply(sizeof(SocketFrameHeader) + replySize);
+    SocketFrameHeader header{};
+    header.init(FRAME_FROM_PHAWD, (unsigned int)replySize, 0);
+    memcpy(reply.data(), &header, sizeof(header));
+    SocketFromPhawd *control = (SocketFromPhawd *) (reply.data() + sizeof(header));
+    control->numControlParams = controlParamNum;
+    control->parameters[0].setName("kp");
+    control->parameters[0].setValue(1.5);
+
+    FrameAssembler assembler;
+    const char *payload = nullptr;
+    for (;;) {
+        ssize_t count = recv(fd, assembler.reserve(65536), 65536, 0);
+        if (count <= 0) {
+            break;
+        }
+        assembler.commit((size_t)count);
+        while (assembler.next(header, payload)) {
+            if (header.type != FRAME_WAVE_SCHEMA && send(fd, reply.data(), reply.size(), MSG_NOSIGNAL) < 0) {
+                break;
+            }
+        }
+    }
+    close(fd);
+}
+
+enum Mode { WHOLE, DELTA, SCHEMA, BATCH };
+
+// nanoseconds per cycle, heap allocations of all cycles are returned in allocated
+static double run(int listen_fd, Mode mode, size_t cycles, unsigned long long &allocated) {
+    std::thread server(serve, listen_fd);
+    size_t sendSize = sizeof(SocketToPhawd) + waveParamNum * sizeof(Parameter);
+    size_t readSize = sizeof(SocketFromPhawd) + controlParamNum * sizeof(Parameter);
+    SocketConnect<SocketToPhawd, SocketFromPhawd> socket;
+    socket.Init(sendSize, readSize);
+    socket.connectToServer("127.0.0.1", port);
+    if (mode == DELTA) {
+        socket.setKeyframeInterval(100);
+    } else if (mode == SCHEMA) {
+        socket.setSchemaHandshake(true);
+    } else if (mode == BATCH) {
+        socket.setBatch(10);
+    }
+    SocketToPhawd *send_data = socket.getSend();
+    send_data->numWaveParams = waveParamNum;
+    for (size_t i = 0; i < waveParamNum; ++i) {
+        send_data->parameters[i].setName("wave" + std::to_string(i));
+        send_data->parameters[i].setValue((double) i);
+    }
+
+    const size_t warmup = 1000;
+    long long start = 0;
+    for (size_t i = 0; i < warmup + cycles; ++i) {
+        if (i == warmup) {
+            allocations = 0;
+            counting = true;
+            start = getTimestamp();
+        }
+        send_data->parameters[i % waveParamNum].setValue((double) i);
+        if (mode == BATCH) {
+            socket.SendBatched();
+        } else {
+            socket.Send();
+        }
+        if (socket.Read() > 0) {
+            volatile double kp = socket.getRead()->parameters[0].getDouble();
+            (void) kp;
+        }
+    }
+    long long elapsed = getTimestamp() - start;
+    counting = false;
+    allocated = allocations;
+    socket.Close();
+    server.join();
+    return (double) elapsed / (double) cycles;
+}
+
+// the same control loop with AsyncSocketConnect, whose I/O thread makes the syscalls. Its loop is paced at 10 kHz,
+// only Send()/Read() are timed
+static double runAsync(int listen_fd, size_t cycles, unsigned long long &allocated) {
+    std::thread server(serve, listen_fd);
+    size_t sendSize = sizeof(SocketToPhawd) + waveParamNum * sizeof(Parameter);
+    size_t readSize = sizeof(SocketFromPhawd) + controlParamNum * sizeof(Parameter);
+    AsyncSocketConnect<SocketToPhawd, SocketFromPhawd> socket;
+    socket.Init(sendSize, readSize, 256);
+    socket.getSocket().connectToServer("127.0.0.1", port);
+    socket.getSocket().setBatch(10);
+    socket.Start(500);
+    SocketToPhawd *send_data = socket.getSend();
+    send_data->numWaveParams = waveParamNum;
+    for (size_t i = 0; i < waveParamNum; ++i) {
+        send_data->parameters[i].setName("wave" + std::to_string(i));
+        send_data->parameters[i].setValue((double) i);
+    }
+
+    const size_t warmup = 1000;
+    long long spent = 0;
+    long long next = getTimestamp();
+    for (size_t i = 0; i < warmup + cycles; ++i) {
+        if (i == warmup) {
+            allocations = 0;
+            counting = true;
+            spent = 0;
+        }
+        long long start = getTimestamp();
+        send_data->parameters[i % waveParamNum].setValue((double) i);
+        socket.Send();
+        if (socket.Read() > 0) {
+            volatile double kp = socket.getRead()->parameters[0].getDouble();
+            (void) kp;
+        }
+        spent += getTimestamp() - start;
+        next += 100000;
+        while (getTimestamp() < next) {
+        }
+    }
+    counting = false;
+    allocated = allocations;
+    socket.Close();
+    server.join();
+    return (double) spent / (double) cycles;
+}
+
+int main() {
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listen_fd, (sockaddr *) &address, sizeof(address)) != 0 || listen(listen_fd, 1) != 0) {
+        printf("listening on port %u failed\n", port);
+        return 1;
+    }
+
+    const size_t cycles = 100000;
+    const char *names[] = {"whole", "delta", "schema", "batch"};
+    printf("%zu waveform parameters, %zu control parameters, %zu cycles\n", waveParamNum, controlParamNum, cycles);
+    printf("%-8s %12s %12s\n", "mode", "cycle(ns)", "allocations");
+    for (int mode = WHOLE; mode <= BATCH; ++mode) {
+        unsigned long long allocated = 0;
+        double ns = run(listen_fd, (Mode) mode, cycles, allocated);
+        printf("%-8s %12.0f %12llu\n", names[mode], ns, allocated);
+    }
+    unsigned long long allocated = 0;
+    double ns = runAsync(listen_fd, cycles / 10, allocated);
+    printf("%-8s %12.0f %12llu\n", "async", ns, allocated);
+    close(listen_fd);
+    return 0;
+}
+#else
+int main() {
+    printf("socket_bench uses linux sockets for its server and glibc to count allocations\n");
+    return 0;
+}
+#endif
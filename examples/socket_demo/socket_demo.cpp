@@ -1,4 +1,4 @@
-#include <vector>
+#include <array>
 #include <memory>
 #include <iostream>
 #include "phawd/phawd.h"
@@ -16,6 +16,19 @@ int main() {
     try {
         socket->Init(sendSize, readSize);
         socket->connectToServer("127.0.0.1", 5230);
+        // phawd on the same host also listens on a unix domain socket, which skips the TCP stack
+        // socket->connectToLocalServer(getLocalSocketPath(5230));
+        // only changed values go over the wire, with the whole message every 100 sends
+        socket->setKeyframeInterval(100);
+        // names, kinds and units are sent once, the messages in between carry values only
+        socket->setSchemaHandshake(true);
+        socket->setWaveUnit(1, "rad");
+        // on lossy links send waveforms over UDP, a lost datagram is skipped instead of stalling the ones behind it
+        // socket->setUdpTelemetry(true);
+        // with a fast control loop send 10 cycles per frame by calling SendBatched() instead of Send()
+        // socket->setBatch(10, 5000);
+        // keep running when phawd is restarted, the connection comes back within 2 s and the schema is sent again
+        socket->setReconnect(true, 100, 2000);
     } catch(std::runtime_error &err) {
         printf("%s\n", err.what());
         printf("Connect server error, don't use phawd here \n");
@@ -32,8 +45,8 @@ int main() {
         float f_value = 1.456;
         double d_value = 3.1516926;
         long s64_value = 12;
-        std::vector<float> vec3f_value{1, 2 , 3};
-        std::vector<double> vec3d_value{3, 2, 1};
+        std::array<float, 3> vec3f_value{1, 2 , 3};
+        std::array<double, 3> vec3d_value{3, 2, 1};
 
         send_data->parameters[0].setValue(f_value);
         send_data->parameters[1].setValue(d_value);
@@ -41,6 +54,9 @@ int main() {
         send_data->parameters[3].setValue(vec3f_value);
         send_data->parameters[4].setValue(vec3d_value);
     }
+    // nothing in the loop allocates, it can run at the rate of the robot without touching the heap
+    std::array<float, 3> pvec3f{};
+    std::array<double, 3> pvec3d{};
     while (iter < 5000000 && usingPhawd){
         iter++;
         int read_count = socket->Read();
@@ -49,8 +65,8 @@ int main() {
             float pf = socket->getRead()->parameters[0].getFloat();
             double pd = socket->getRead()->parameters[1].getDouble();
             long ps64 = socket->getRead()->parameters[2].getS64();
-            std::vector<float> pvec3f = socket->getRead()->parameters[3].getVec3f();
-            std::vector<double> pvec3d = socket->getRead()->parameters[4].getVec3d();
+            socket->getRead()->parameters[3].getVec3f(pvec3f);
+            socket->getRead()->parameters[4].getVec3d(pvec3d);
 
             auto send_data = socket->getSend();
             send_data->parameters[0].setValue(pf);
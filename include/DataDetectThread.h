@@ -13,6 +13,7 @@
 #include <QMap>
 #include <QObject>
 #include <QThread>
+#include <QElapsedTimer>
 #include "phawd/SharedParameter.h"
 
 class DataDetect :public QObject {
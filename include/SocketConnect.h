@@ -13,9 +13,43 @@
 #pragma once
 #include <QTcpServer>
 #include <QTcpSocket>
+#include <QUdpSocket>
+#include <QSocketNotifier>
+#include <QList>
+#include <vector>
+#include <string>
 #include "phawd/SharedParameter.h"
+#include "phawd/SocketFrame.h"
+
+/*!
+ * One robot program connected to phawd, over TCP or the unix domain socket. Every client has its own buffers,
+ * its waveform parameters are shown as "robotN/name" so that the waveforms of several robots can be compared
+ */
+struct SocketClient {
+    int id = 0;                         // N of "robotN", the smallest one not taken by another client
+    QTcpSocket *socket = nullptr;
+    int localFd = -1;
+    QSocketNotifier *localNotifier = nullptr;
+    // messages are framed, see phawd/SocketFrame.h, a readyRead() may carry part of one or several of them
+    phawd::FrameAssembler assembler;
+    unsigned int sendSequence = 0;
+    bool haveKeyframe = false;          // deltas can only be applied after a whole message
+    bool haveSchema = false;            // samples can only be applied after the schema handshake
+    unsigned int schemaId = 0;
+    std::vector<std::string> units;
+    phawd::SequenceTracker telemetry;
+    phawd::SocketToPhawd *data = nullptr;
+    phawd::SocketToPhawd *received = nullptr;  // whole message as received, compared with the last one
+    // every message received, single or in the batches sent by SendBatched(), is kept here until it is drawn, one
+    // ring per waveform parameter, allocated with the first message
+    char *sampleRings = nullptr;
+    // timestamps of the client are moved onto the clock of phawd, robots don't share a clock
+    long long clockOffset = 0;
+    bool haveClock = false;
+};
+
 /*!
- * Note that the socket header file is similar to the socket function under the Windows system, 
+ * Note that the socket header file is similar to the socket function under the Windows system,
  * which is used to store sockets, which contain the destination address and the current address and the corresponding port
  */
 class SocketConnect : public QObject{
@@ -24,24 +58,76 @@ private:
     // Note that last time it was caused by not initializing the pointer, and when the program exited,
     // the field pointer was destroyed, resulting in an exit exception
     QTcpServer *m_Server = nullptr;
-    QTcpSocket *m_Socket = nullptr;
+    QList<SocketClient *> m_clients;
+    // waveform parameters of clients using UDP telemetry arrive here, on the same port number as the server
+    QUdpSocket *m_udpSocket = nullptr;
+    std::vector<char> m_datagram;
+    // clients on the same host may connect to the unix domain socket phawd::getLocalSocketPath(port) instead,
+    // every frame arrives as one record(SOCK_SEQPACKET), only available on linux
+    int m_localServerFd = -1;
+    QSocketNotifier *m_localServerNotifier = nullptr;
+    std::string m_localPath;
 
-    size_t m_numWaveParams;
-    phawd::SocketToPhawd *m_socketToPhawd = nullptr;
+    size_t m_numWaveParams;     // waveform parameters every client may send
+    size_t m_ringSize = 0;
 
 signals:
-    void connected(bool isConnected);
-    void readReady();
+    // client is the index of getClientCount(), it is still valid when a client disconnects
+    void connected(int client, bool isConnected);
+    void readReady(int client);
+    // names, kinds or number of the waveform parameters of any client changed or a client left,
+    // emitted before readReady()
+    void schemaReady();
 public:
     explicit SocketConnect(QObject *parent = nullptr);
     ~SocketConnect() override;
     void init(unsigned short port, size_t parametersNum);
-    phawd::SocketToPhawd *getRead();
+    int getClientCount() const;
+    phawd::SocketToPhawd *getRead(int client);
+    //!< "robotN", the namespace of the waveform parameters of client
+    QString getClientName(int client) const;
+    //!< units of the waveform parameters sent with the schema handshake, empty for clients without it
+    const std::vector<std::string> &getUnits(int client) const;
+    //!< datagrams received, lost and out of order since the client connected
+    const phawd::SequenceTracker &getTelemetryStats(int client) const;
+
+    /*!
+     * Waveform parameters of all clients are numbered as channels, which stay valid while other clients come and go
+     * @return channel of the index-th waveform parameter of client
+     */
+    int getChannel(int client, size_t index) const;
+    //!< nullptr if the client of channel has left
+    phawd::Parameter *getParameter(int channel);
+    //!< messages of channel received since they were drawn, nullptr before its client sent the first one
+    phawd::SampleRing *getSampleRing(int channel);
+    //!< the latest timestamp of all clients, on the clock of phawd
+    long long getLatestTimestamp() const;
+
+    //!< send to every client
     void sendData(void *data, size_t sendSize);
+    void sendData(int client, void *data, size_t sendSize);
+    void discardSamples();
     void close();
 
+private:
+    SocketClient *addClient();
+    void removeClient(SocketClient *client);
+    void freeClient(SocketClient *client);
+    SocketClient *findClient(int id) const;
+    void sendFrame(SocketClient *client, void *data, size_t sendSize);
+    void dispatchFrames(SocketClient *client);
+    void handleFrame(SocketClient *client, const phawd::SocketFrameHeader &header, const char *payload,
+                     bool &received, bool &schemaChanged);
+    void toLocalClock(SocketClient *client);
+    void pushSamples(SocketClient *client);
+    phawd::SampleRing *getSampleRing(SocketClient *client, size_t index);
+    void listenLocal(unsigned short port);
+
 private slots:
     void slotNewConnection();
     void readData();
+    void readDatagrams();
+    void acceptLocalConnection();
+    void readLocalData();
     void closeSocket();
 };
\ No newline at end of file
@@ -13,10 +13,13 @@
 #pragma once
 #include <QWidget>
 #include <QTimer>
+#include <QHash>
+#include <QSet>
 #include "BatchAddSelect.h"
 #include "BatchDeleteSelect.h"
 #include "../ui_include/ui_waveshow.h"
 #include "phawd/SharedParameter.h"
+#include "SocketConnect.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class WaveShow; }
@@ -31,13 +34,15 @@ public:
     void initForm();
 
     void setSharedMessage(phawd::SharedParameters *sharedParameters){ m_sharedMessage = sharedParameters; }
-    void setSocketMessage(phawd::SocketToPhawd *socketToPhawd){ m_socketToPhawd = socketToPhawd; }
+    void setSocketConnect(SocketConnect *socketConnect){ m_socketConnect = socketConnect; }
     void setUsingSocket(bool usingSocket) { m_usingSocket = usingSocket; }
     void clearPtr();
     void setSelections(QStringList paramsNames);
 
     QPair<int, int> getIndexOfSelectedParameters(int graphIndex);
     void undoRequest();
+    void discardSamples();
+    double toPlotTime(long long timestamp);
 
 protected:
 	void closeEvent(QCloseEvent *event) override;
@@ -62,6 +67,12 @@ private:
     bool m_usingSocket = false;
     bool m_isStarted = false;
     unsigned long long int iter = 0;
+    long long m_firstTimestamp = 0;     // timestamp of the robot program drawn at time 0
+    long long m_lastTimestamp = 0;      // timestamp of the latest published data drawn
+    QSet<int> m_staleParameters;        // parameters whose writer didn't finish a write, reported once
+    // samples taken out of the rings every frame, one buffer per parameter sized to its ring once
+    QHash<int, QVector<phawd::WaveSample>> m_drainBuffers;
+    QVector<QPair<int, int>> m_graphIndices;    // getIndexOfSelectedParameters() of every graph in this frame
     Ui::WaveShow *ui;
     BatchAddSelectWindow *m_dataSelectWindow = nullptr;
     BatchDeleteSelectWindow *m_deleteSelectWindow = nullptr;
@@ -74,7 +85,10 @@ private:
     QStringList m_selectedNamesToDelete;
     QStringList m_selectedToAddName;
     QList<int> m_selectedToAddIndex;
+    // "producer/param" label of every waveform parameter in shared memory to its index in parameters[], or
+    // "robotN/param" label of every waveform parameter of the socket clients to its channel in SocketConnect
+    QHash<QString, int> m_waveIndexOfLabel;
     QVector<double> time_lapsed;
     phawd::SharedParameters *m_sharedMessage = nullptr;
-    phawd::SocketToPhawd *m_socketToPhawd = nullptr;
+    SocketConnect *m_socketConnect = nullptr;
 };
@@ -69,6 +69,9 @@ private:
     void saveToFile();
     void readFromFile();
 
+    // "robotN/name" of every waveform curve of a socket client, throws if its parameters are not valid
+    QStringList socketWaveNames(int client);
+
 private slots:
     /************For Parameter Page**************/
     void clickDeleteButton();
@@ -82,15 +85,22 @@ private slots:
     void consoleMenuRequested(QPoint pos);
     void tableMenuRequested(QPoint pos);
     void choiceChanged(int index);
+    void waveParamNumChanged(int num);
 
     void receiveWaveParams(QStringList paramsNames);
     /*********************************************/
-    void socketReadyRead();
+    void socketSchemaReady();
+    void socketReadyRead(int client);
     void updateGamepadCommand();
 
 private:
     bool m_usingSocket = false;
     bool m_socketConnected = false;
+    size_t m_sampleRingSize = 0;        // samples per waveform ring in shared memory, 0 for no ring
+    size_t m_dataArenaSize = 0;         // doubles for the elements of VECN/MATRIX waveform parameters
+    bool m_realTimeMemory = false;      // prefault, lock and use huge pages for the shared memory
+    bool m_separateRegions = false;     // control and waveform parameters on cache lines of their own
+    bool m_holdControlUpdates = false;  // stage edits of control parameters until they are applied together
 
     WaveShow *m_waveShow;
     Ui::MainWindow *ui = nullptr;
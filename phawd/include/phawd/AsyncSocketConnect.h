@@ -0,0 +1,174 @@
+/*!
+ * PHAWD - Parameters Handler and Waveform Display
+ * Licensed under the GNU GPLv3 license. See LICENSE for more details.
+ * @author HuNing-He
+ * @date 2026-10-16
+ * @version 0.3
+ * @email 2689112371@qq.com
+ * @copyright (c) 2022 HuNing-He
+ * @file AsyncSocketConnect.h
+ * @brief socket client whose sends and reads are done by a background I/O thread
+ */
+
+#pragma once
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "phawd/phawd_config.h"
+#include "phawd/SocketConnect.h"
+
+namespace phawd {
+/*!
+ * Latest message from one producer thread to one consumer thread(triple buffer). The producer always has a slot to
+ * write, the consumer always has a slot to read, the third one is handed over between them, so neither side waits
+ * and a message is never torn. Messages published before the consumer took them are overwritten.
+ */
+class PHAWD_DLLAPI MessageMailbox {
+private:
+    std::vector<char> m_slots;
+    size_t m_slotSize = 0;
+    std::atomic<unsigned int> m_middle{0};  // slot handed over, with MAILBOX_FRESH while the consumer hasn't taken it
+    unsigned int m_back = 1;                // slot of the producer
+    unsigned int m_front = 2;               // slot of the consumer
+
+public:
+    //!< three slots of size bytes, all zero, not thread safe
+    void init(size_t size);
+
+    //!< producer side, the slot to write the next message into
+    char *writeBuffer();
+
+    //!< producer side, hand over what was written into writeBuffer()
+    void publish();
+
+    /*!
+     * Consumer side, take the latest published message.
+     * @return false if nothing was published since the last call, readBuffer() stays as it was
+     */
+    bool fetch();
+
+    //!< consumer side, the message taken by the last fetch(), zero before the first one
+    const char *readBuffer() const;
+};
+
+/*!
+ * Queue of messages of the same size from one producer thread to one consumer thread. The slots are allocated by
+ * init(), pushing and popping only copy and never wait: a full queue makes reserve() fail.
+ */
+class PHAWD_DLLAPI MessageQueue {
+private:
+    std::atomic<unsigned long long> m_head{0};  // written by producer only
+    char m_padding[64];                         // head and tail on separate cache lines
+    std::atomic<unsigned long long> m_tail{0};  // written by consumer only
+    std::vector<char> m_slots;
+    size_t m_slotSize = 0;
+    size_t m_capacity = 0;
+
+public:
+    //!< capacity slots of size bytes, not thread safe
+    void init(size_t size, size_t capacity);
+
+    //!< producer side, the slot to write the next message into, nullptr if the queue is full
+    char *reserve();
+
+    //!< producer side, queue the message written into reserve()
+    void commit();
+
+    //!< consumer side, the oldest queued message, nullptr if the queue is empty
+    const char *front();
+
+    //!< consumer side, remove front()
+    void pop();
+
+    //!< messages queued and not popped yet
+    size_t pending() const;
+};
+
+/*!
+ * Client of SocketConnect whose socket is only touched by a background I/O thread, so that a control loop never makes
+ * a syscall for phawd and doesn't burn the CPU on empty reads.
+ *
+ * Send() copies getSend() into a queue, Read() takes the latest control message the I/O thread received, both are
+ * lock-free and never wait. The I/O thread sleeps in epoll until the server sends something or its timer expires,
+ * then sends what was queued with SocketConnect::SendBatched() and reads with SocketConnect::Read(), so everything
+ * set on getSocket() (deltas, schema handshake, UDP telemetry, batches) works the same. Only supported on linux.
+ *
+ * Init() first, then configure and connect getSocket(), then Start(). Don't call Send()/Read() of getSocket() after
+ * Start(), it belongs to the I/O thread until Close().
+ */
+template<typename SendData, typename ReadData>
+class PHAWD_DLLAPI AsyncSocketConnect {
+private:
+    SocketConnect<SendData, ReadData> _socket;
+    size_t _sendSize = 0;
+    size_t _readSize = 0;
+    SendData *_sendData = nullptr;
+    MessageQueue _outgoing;             // messages of the control loop, sent by the I/O thread
+    MessageMailbox _incoming;           // latest message received by the I/O thread
+    std::thread _ioThread;
+    std::atomic<bool> _running{false};
+    std::atomic<bool> _connected{false};
+    std::atomic<unsigned long long> _dropped{0};
+    int _epoll_fd = -1;
+    int _timer_fd = -1;
+    int _wake_fd = -1;                  // written by Close() to stop the I/O thread
+
+    void ioLoop();
+    void sendQueued();
+    void closeDescriptors();
+
+public:
+    AsyncSocketConnect() = default;
+
+    ~AsyncSocketConnect();
+
+    AsyncSocketConnect(const AsyncSocketConnect &) = delete;
+    AsyncSocketConnect &operator=(const AsyncSocketConnect &) = delete;
+
+    /*!
+     * @param sendSize : bytes of a message sent, see SocketConnect::Init()
+     * @param readSize : bytes of a message read
+     * @param queueLength : messages Send() may queue before the I/O thread sends them, further ones are dropped
+     */
+    void Init(size_t sendSize, size_t readSize, size_t queueLength = 64);
+
+    //!< connect and configure this before Start(), e.g. getSocket().connectToServer(ip, port)
+    SocketConnect<SendData, ReadData> &getSocket();
+
+    /*!
+     * Start the I/O thread on the connected socket.
+     * @param period_us : the I/O thread wakes up this often to send what was queued. Messages from the server wake it
+     *                    up at once. Shorter periods send with less delay and wake up more often.
+     */
+    void Start(long long period_us = 500);
+
+    /*!
+     * Queue getSend() to be sent by the I/O thread, SocketToPhawd::timestamp is stamped here, not when it is sent.
+     * @return : -1 if the queue is full and the message was dropped, else bytes of the message
+     */
+    int Send();
+
+    /*!
+     * Take the latest message received by the I/O thread into getRead(), older ones not taken are skipped.
+     * @return : -1 if nothing was received since the last call, else bytes of the message
+     */
+    int Read();
+
+    /*!
+     * False once the I/O thread lost the connection, Send() still queues but nothing is sent. With
+     * SocketConnect::setReconnect() on getSocket() the I/O thread connects again and this turns true again.
+     */
+    bool isConnected() const;
+
+    //!< messages dropped because the queue was full or SocketConnect couldn't send them
+    unsigned long long dropped() const;
+
+    //!< stop the I/O thread, send what is still queued and close the socket
+    void Close();
+
+    SendData *getSend();
+
+    //!< the message taken by the last Read(), valid until the next Read()
+    ReadData *getRead();
+};
+}
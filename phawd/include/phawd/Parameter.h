@@ -11,11 +11,15 @@
  */
 
 #pragma once
-#include <map>
+#include <array>
+#include <atomic>
 #include <string>
 #include <vector>
+#include <cstdio>
+#include <cstddef>
 #include <cstring>
 #include <utility>
+#include <type_traits>
 #include <iostream>
 #include <stdexcept>
 #include "phawd/phawd_config.h"
@@ -30,6 +34,12 @@ union PHAWD_DLLAPI ParameterValue {
     long int i;
     float vec3f[3];
     double vec3d[3];
+    // VECN_DOUBLE and MATRIX_DOUBLE, the rows * cols elements are stored outside of the parameter
+    struct {
+        unsigned int offset;    // index of the first element in the data arena
+        unsigned int rows;
+        unsigned int cols;      // 1 for VECN_DOUBLE
+    } array;
 
     ParameterValue();
     void init();
@@ -45,9 +55,13 @@ enum class ParameterKind: unsigned short int {
     DOUBLE = 1,
     S64 = 2,
     VEC3_FLOAT = 3,
-    VEC3_DOUBLE = 4
+    VEC3_DOUBLE = 4,
+    // waveform parameters in shared memory only, elements are in its data arena, see SharedParameters::setWaveArray()
+    VECN_DOUBLE = 5,
+    MATRIX_DOUBLE = 6
 };
 
+//!< kinds a control parameter may have
 const ParameterKind ParameterKinds[] = {
     ParameterKind::FLOAT,
     ParameterKind::DOUBLE,
@@ -59,12 +73,43 @@ const ParameterKind ParameterKinds[] = {
 PHAWD_DLLAPI ParameterKind getParameterKindFromString(const std::string& str);
 PHAWD_DLLAPI std::string ParameterKindToString(ParameterKind kind);
 
+/*!
+ * Loads of an odd sequence a reader spins through before it takes the value as it is, about a millisecond. A writer
+ * is never preempted inside a write for that long unless it died there, see Parameter::isStale().
+ */
+constexpr unsigned int SEQLOCK_MAX_SPINS = 1u << 20;
+
+template<typename T>
+class ParameterHandle;
+
+template<typename Struct>
+class ParameterBinding;
+
+/*!
+ * A named value of one of the ParameterKinds.
+ * Parameters are placed in shared memory and written by one process while another one reads them, so every
+ * setter/getter goes through a per-parameter sequence lock: the writer bumps m_seq to an odd number, modifies the
+ * parameter and bumps it back to even, the reader retries its copy until it sees the same even number before and
+ * after. Readers never block the writer and never observe a half-written value(e.g. x of a VEC3 from one control
+ * cycle and z from the next one). Each parameter must have only one writer at a time.
+ */
 class PHAWD_DLLAPI Parameter {
 private:
     bool m_set;
     char m_name[16] = {};
     ParameterKind m_kind;
+    std::atomic<unsigned int> m_seq{0};  // lives in the padding before m_value, sizeof(Parameter) is unchanged
     ParameterValue m_value;
+
+    void writeBegin();
+    void writeEnd();
+    unsigned int readBegin() const;
+    bool readRetry(unsigned int seq) const;
+
+    template<typename T>
+    friend class ParameterHandle;
+    template<typename Struct>
+    friend class ParameterBinding;
 public:
     Parameter();
     Parameter(const Parameter& parameter);
@@ -143,9 +188,48 @@ public:
     void setValue(const float* value);
     void setValue(const std::vector<float>& value);
     void setValue(const std::vector<double>& value);
+    void setValue(const std::array<float, 3>& value);
+    void setValue(const std::array<double, 3>& value);
     void setValue(ParameterKind kind, const ParameterValue& value);
     void setValueKind(ParameterKind kind);
 
+    /*!
+     * Store kind and value in one seqlock write section, used by the process which publishes this parameter.
+     * Unlike setValue(kind, value), the kind of this parameter may change.
+     * @param kind : the kind of value
+     * @param value : parameter value
+     */
+    void writeValue(ParameterKind kind, const ParameterValue& value);
+
+    /*!
+     * Take a consistent snapshot of this parameter without locking, retries while a write is in progress.
+     * @param value : receives the value
+     * @return the kind belonging to value
+     */
+    ParameterKind readValue(ParameterValue& value) const;
+
+    /*!
+     * True while a write is in progress. If it stays true, the writer died in the middle of a write, e.g. a robot
+     * program killed inside setValue(), and readers get whatever it left behind after SEQLOCK_MAX_SPINS.
+     */
+    bool isStale() const;
+
+    /*!
+     * Store a VECN_DOUBLE(cols is 1) or MATRIX_DOUBLE parameter, whose rows * cols elements(row major) are kept at
+     * arena + offset instead of in the parameter. The elements are copied in the same seqlock write section as the
+     * kind and size, so that readArray() never mixes elements of two writes.
+     */
+    void writeArray(double *arena, unsigned int offset, unsigned int rows, unsigned int cols, const double *values);
+
+    /*!
+     * readValue() which also copies the elements of a VECN_DOUBLE/MATRIX_DOUBLE parameter out of arena.
+     * @param arena_size : elements in arena, elements outside of it are never read
+     * @param capacity : elements values can take, the rest is not copied
+     * @return the kind belonging to value
+     */
+    ParameterKind readArray(const double *arena, size_t arena_size, ParameterValue& value, double *values,
+                            size_t capacity) const;
+
 //     template<typename T>
 //     T getValue();
     /*!
@@ -154,48 +238,131 @@ public:
      * @param kind : the kind of the control parameter
      * @return the value of the control parameter
      */
-    ParameterValue getValue(ParameterKind kind);
-    ParameterKind getValueKind();
-    std::string getName();
-    float getFloat();
-    double getDouble();
-    long int getS64();
-    double getFromVec3dByIndex(int idx);
-    float getFromVec3fByIndex(int idx);
+    ParameterValue getValue(ParameterKind kind) const;
+    ParameterKind getValueKind() const;
+    std::string getName() const;
 
-    std::vector<double> getVec3d();
-    std::vector<float> getVec3f();
+    //!< compare names without building strings, used to tell whether a message can be sent as delta
+    bool sameName(const Parameter &p) const;
+    float getFloat() const;
+    double getDouble() const;
+    long int getS64() const;
+    double getFromVec3dByIndex(int idx) const;
+    float getFromVec3fByIndex(int idx) const;
+
+    //!< allocate a new vector on every call, use the overloads below in a control loop
+    std::vector<double> getVec3d() const;
+    std::vector<float> getVec3f() const;
+
+    /*!
+     * Copy the value into value without allocating, all 3 elements come from the same write.
+     * Throws exception if the parameter isn't of type VEC3_DOUBLE/VEC3_FLOAT
+     */
+    void getVec3d(std::array<double, 3>& value) const;
+    void getVec3f(std::array<float, 3>& value) const;
 
     bool& isSet();
     void set(bool set);
 };
 
+static_assert(sizeof(Parameter) == 48, "Parameter layout is shared with other processes and over socket, keep it stable");
+
+/*!
+ * Sequence lock, reader side. Wait for an even sequence, copy the fields, then check with readRetry()
+ * that the sequence didn't move, otherwise the copy may be torn and has to be taken again.
+ * The wait is bounded by SEQLOCK_MAX_SPINS: an odd sequence which doesn't move is returned as it is, readRetry()
+ * accepts the copy while the sequence stays there, and isStale() reports it.
+ */
+inline unsigned int Parameter::readBegin() const {
+    unsigned int seq = m_seq.load(std::memory_order_acquire);
+    for (unsigned int spins = 0; (seq & 1u) && spins < SEQLOCK_MAX_SPINS; ++spins) {
+        seq = m_seq.load(std::memory_order_acquire);
+    }
+    return seq;
+}
+
+inline bool Parameter::readRetry(unsigned int seq) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return m_seq.load(std::memory_order_relaxed) != seq;
+}
+
+//!< ParameterKind of the values a ParameterHandle<T> reads
+template<typename T>
+struct ParameterKindOf;
+
+template<>
+struct ParameterKindOf<float> {
+    static constexpr ParameterKind kind = ParameterKind::FLOAT;
+};
+
+template<>
+struct ParameterKindOf<double> {
+    static constexpr ParameterKind kind = ParameterKind::DOUBLE;
+};
+
+template<>
+struct ParameterKindOf<long int> {
+    static constexpr ParameterKind kind = ParameterKind::S64;
+};
+
+template<>
+struct ParameterKindOf<std::array<float, 3>> {
+    static constexpr ParameterKind kind = ParameterKind::VEC3_FLOAT;
+};
+
+template<>
+struct ParameterKindOf<std::array<double, 3>> {
+    static constexpr ParameterKind kind = ParameterKind::VEC3_DOUBLE;
+};
+
 /*!
- * ControlParameterCollections contains a map of all the control parameters which facilitates Read Parameters
+ * ControlParameterCollections contains an index of all the control parameters which facilitates Read Parameters
  * Mainly used in webots robot program
+ *
+ * The index is a flat hash table of names and pointers, built once all parameters were added, so that a lookup
+ * hashes the name and compares it with one or two neighbouring slots instead of walking the nodes of a tree.
  */
 class PHAWD_DLLAPI ParameterCollection {
 private:
+    // a name is kept in its slot, probing doesn't touch the parameters themselves
+    struct Entry {
+        char name[16];
+        Parameter *parameter;
+    };
     std::string m_name;
+    std::vector<Parameter *> m_parameters;  // in the order they were added, without names added twice
+    std::vector<Entry> m_index;             // power of two slots, at most half of them used
+    bool m_built = true;
+
+    static size_t hashName(const char *name);
 public:
-    std::map<std::string, Parameter *> m_map;
     explicit ParameterCollection(std::string name="")
         : m_name(std::move(name))
     {}
     /*!
      * Use this to add a parameter for the first time in the
-     * Throws exception if you try to add a parameter twice.
+     * A name added twice keeps the first parameter.
      */
     void addParameter(Parameter *param);
 
+    /*!
+     * Build the index of lookup() from the parameters added so far. collectParameters() of the shared data calls
+     * it when it is done, whoever adds parameters by hand calls it before the first lookup().
+     */
+    void build();
+
     /*!
      * Lookup a control parameter by its name.
      * This does not modify the set field of the control parameter!
+     * Only reads the index, so that several threads may look up at the same time, and doesn't allocate.
      *
-     * Throws exception if parameter isn't found
+     * Throws exception if parameter isn't found, or if parameters were added since the last build()
      */
     Parameter &lookup(const std::string &name);
 
+    //!< number of parameters, a name added twice is counted once after build()
+    size_t size() const;
+
     //!< are all the control parameters initialized?
     bool checkIfAllSet();
 
@@ -209,4 +376,196 @@ public:
      */
     void clearAllParameters();
 };
+
+/*!
+ * A control parameter looked up once by name, for reading it every control cycle. The name is searched and the kind
+ * is checked when the handle is bound, get() only copies the value out of the parameter under its sequence lock:
+ * no map search, no std::string and no kind check.
+ * T is float, double, long int, std::array<float, 3> or std::array<double, 3>, like getFloat() to getVec3d().
+ *
+ * The handle points into the memory of the collection, bind it again after the collection was rebuilt,
+ * e.g. collectControlParameters() after SharedMemory::updateMapping().
+ */
+template<typename T>
+class ParameterHandle {
+private:
+    Parameter *m_parameter = nullptr;
+public:
+    ParameterHandle() = default;
+
+    //!< see bind()
+    ParameterHandle(ParameterCollection &collection, const std::string &name) {
+        bind(collection, name);
+    }
+
+    /*!
+     * Look up name in collection.
+     * Throws exception if the parameter isn't found or isn't of the kind of T
+     */
+    void bind(ParameterCollection &collection, const std::string &name) {
+        Parameter &parameter = collection.lookup(name);
+        if (parameter.getValueKind() != ParameterKindOf<T>::kind) {
+            printf("[ERROR]: ParameterHandle::bind() error, parameter(%s) is of type %s, not %s\n", name.c_str(),
+                   ParameterKindToString(parameter.getValueKind()).c_str(),
+                   ParameterKindToString(ParameterKindOf<T>::kind).c_str());
+            throw std::runtime_error("ParameterHandle::bind(): type error");
+        }
+        m_parameter = &parameter;
+    }
+
+    bool isBound() const {
+        return m_parameter != nullptr;
+    }
+
+    //!< the value of the parameter, bind() first
+    T get() const {
+        T value;
+        unsigned int seq;
+        do {
+            seq = m_parameter->readBegin();
+            std::memcpy(&value, &m_parameter->m_value, sizeof(T));
+        } while (m_parameter->readRetry(seq));
+        return value;
+    }
+
+    Parameter &parameter() const {
+        return *m_parameter;
+    }
+};
+
+/*!
+ * Fields of a plain struct(e.g. the gains of a controller) bound to control parameters of the same names, so that
+ * pull() copies all of them into the struct in one loop instead of a lookup() per field every control cycle.
+ * The fields are described once, with PHAWD_BIND_FIELD() or field(), then bind() looks up every name and checks its
+ * kind. pull() only copies each value under the sequence lock of its parameter. There is no push(), phawd is the only
+ * writer of the control parameters.
+ *
+ *     struct Gains { double kp; double kd; std::array<double, 3> offset; };
+ *     ParameterBinding<Gains> binding;
+ *     PHAWD_BIND_FIELD(binding, Gains, kp);
+ *     PHAWD_BIND_FIELD(binding, Gains, kd);
+ *     PHAWD_BIND_FIELD(binding, Gains, offset);
+ *     binding.bind(collection);
+ *     binding.pull(gains);      // every control cycle
+ *
+ * Like ParameterHandle, bind it again after the collection was rebuilt. All fields come from the same update of phawd
+ * if the collection is one bank of SharedParameters::acquireControlBank() and releaseControlBank() succeeds.
+ */
+template<typename Struct>
+class ParameterBinding {
+    static_assert(std::is_standard_layout<Struct>::value,
+                  "ParameterBinding: Struct must be a standard layout type, offsetof() isn't defined otherwise");
+private:
+    struct Field {
+        std::string name;
+        size_t offset;
+        ParameterKind kind;
+    };
+    struct Bound {
+        Parameter *parameter;
+        size_t offset;
+        ParameterKind kind;
+    };
+    std::vector<Field> m_fields;
+    std::vector<Bound> m_bound;     // same order as m_fields, empty until bind()
+
+    //!< bytes of the value of kind in ParameterValue
+    static constexpr size_t kindSize(ParameterKind kind) {
+        return kind == ParameterKind::FLOAT ? sizeof(float) :
+               kind == ParameterKind::DOUBLE ? sizeof(double) :
+               kind == ParameterKind::S64 ? sizeof(long int) :
+               kind == ParameterKind::VEC3_FLOAT ? sizeof(float[3]) :
+               kind == ParameterKind::VEC3_DOUBLE ? sizeof(double[3]) : 0;
+    }
+
+    // the size of every kind is a constant, so that the compiler turns each copy into a few moves instead of a call
+    static void copyValue(void *to, const void *from, ParameterKind kind) {
+        switch (kind) {
+            case ParameterKind::FLOAT:
+                std::memcpy(to, from, kindSize(ParameterKind::FLOAT));
+                break;
+            case ParameterKind::DOUBLE:
+                std::memcpy(to, from, kindSize(ParameterKind::DOUBLE));
+                break;
+            case ParameterKind::S64:
+                std::memcpy(to, from, kindSize(ParameterKind::S64));
+                break;
+            case ParameterKind::VEC3_FLOAT:
+                std::memcpy(to, from, kindSize(ParameterKind::VEC3_FLOAT));
+                break;
+            case ParameterKind::VEC3_DOUBLE:
+                std::memcpy(to, from, kindSize(ParameterKind::VEC3_DOUBLE));
+                break;
+            default:
+                break;
+        }
+    }
+
+public:
+    /*!
+     * Describe a field of type T at offset bytes of Struct, bound to the parameter name.
+     * T is float, double, long int, std::array<float, 3> or std::array<double, 3>, like ParameterHandle.
+     * Throws exception if the field is outside of Struct
+     */
+    template<typename T>
+    ParameterBinding &field(const std::string &name, size_t offset) {
+        static_assert(sizeof(T) == kindSize(ParameterKindOf<T>::kind),
+                      "ParameterBinding::field(): the field isn't the size of the value of its kind");
+        if (offset + sizeof(T) > sizeof(Struct)) {
+            printf("[ERROR]: ParameterBinding::field() error, field(%s) is outside of the struct\n", name.c_str());
+            throw std::runtime_error("ParameterBinding::field(): offset error");
+        }
+        m_fields.push_back(Field{name, offset, ParameterKindOf<T>::kind});
+        m_bound.clear();
+        return *this;
+    }
+
+    /*!
+     * Look up the parameter of every field in collection.
+     * Throws exception if a parameter isn't found or isn't of the kind of its field
+     */
+    void bind(ParameterCollection &collection) {
+        std::vector<Bound> bound;
+        bound.reserve(m_fields.size());
+        for (const Field &field : m_fields) {
+            Parameter &parameter = collection.lookup(field.name);
+            if (parameter.getValueKind() != field.kind) {
+                printf("[ERROR]: ParameterBinding::bind() error, parameter(%s) is of type %s, not %s\n",
+                       field.name.c_str(), ParameterKindToString(parameter.getValueKind()).c_str(),
+                       ParameterKindToString(field.kind).c_str());
+                throw std::runtime_error("ParameterBinding::bind(): type error");
+            }
+            bound.push_back(Bound{&parameter, field.offset, field.kind});
+        }
+        m_bound.swap(bound);
+    }
+
+    bool isBound() const {
+        return !m_fields.empty() && m_bound.size() == m_fields.size();
+    }
+
+    //!< number of fields described
+    size_t size() const {
+        return m_fields.size();
+    }
+
+    //!< copy the value of every bound parameter into its field of data, bind() first
+    void pull(Struct &data) const {
+        char *base = reinterpret_cast<char *>(&data);
+        for (const Bound &bound : m_bound) {
+            unsigned int seq;
+            do {
+                seq = bound.parameter->readBegin();
+                copyValue(base + bound.offset, &bound.parameter->m_value, bound.kind);
+            } while (bound.parameter->readRetry(seq));
+        }
+    }
+};
 }
+
+/*!
+ * Describe member of Struct for binding, bound to the parameter of the same name, e.g.
+ * PHAWD_BIND_FIELD(binding, Gains, kp). Struct must be a standard layout type.
+ */
+#define PHAWD_BIND_FIELD(binding, Struct, member) \
+    (binding).template field<decltype(Struct::member)>(#member, offsetof(Struct, member))
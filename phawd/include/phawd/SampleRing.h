@@ -0,0 +1,88 @@
+/*!
+ * PHAWD - Parameters Handler and Waveform Display
+ * Licensed under the GNU GPLv3 license. See LICENSE for more details.
+ * @author HuNing-He
+ * @date 2026-10-16
+ * @version 0.3
+ * @email 2689112371@qq.com
+ * @copyright (c) 2022 HuNing-He
+ * @file SampleRing.h
+ * @brief single producer single consumer sample ring of a waveform parameter in shared memory
+ */
+
+#pragma once
+#include <atomic>
+#include "phawd/Parameter.h"
+#include "phawd/Timestamp.h"
+
+namespace phawd {
+/*!
+ * One sample of a waveform parameter, the kind is the one of the parameter owning the ring
+ */
+struct PHAWD_DLLAPI WaveSample {
+    long long timestamp;    // getTimestamp() of the robot program when the sample was pushed
+    ParameterValue value;
+};
+
+/*!
+ * A lock-free ring of WaveSample placed in shared memory, one per waveform parameter.
+ * The robot program(the only producer) pushes every sample of its control cycle, the waveform displayer(the only
+ * consumer) drains all pending samples once per frame, so no sample is lost between two frames.
+ *
+ * head and tail are monotonic counters on separate cache lines, the ring is full when head - tail == capacity.
+ * push() is wait-free: if the consumer doesn't keep up, the new sample is dropped and counted instead of waiting.
+ *
+ * The ring is not constructed but laid out with init() in memory that is already mapped, use getSize() to reserve
+ * space for it.
+ */
+class PHAWD_DLLAPI SampleRing {
+private:
+    alignas(64) std::atomic<unsigned long long> m_head;     // written by producer only
+    std::atomic<unsigned long long> m_dropped;              // written by producer only
+    alignas(64) std::atomic<unsigned long long> m_tail;     // written by consumer only
+    alignas(64) size_t m_capacity;
+    WaveSample m_samples[];
+
+public:
+    SampleRing() = delete;
+    SampleRing(const SampleRing &ring) = delete;
+    SampleRing &operator=(const SampleRing &ring) = delete;
+
+    /*!
+     * @param capacity : number of samples the ring can hold
+     * @return bytes taken by a ring of this capacity, a multiple of the cache line size
+     */
+    static size_t getSize(size_t capacity);
+
+    /*!
+     * Reset counters and set capacity, the memory behind this must be at least getSize(capacity) bytes
+     */
+    void init(size_t capacity);
+
+    /*!
+     * Producer side, never blocks.
+     * @param timestamp : time of the sample, see getTimestamp()
+     * @return false if the ring is full and the sample was dropped
+     */
+    bool push(const ParameterValue &value, long long timestamp);
+
+    /*!
+     * Consumer side, copy out up to maxCount pending samples in the order they were pushed.
+     * @return number of samples copied
+     */
+    size_t pop(WaveSample *samples, size_t maxCount);
+
+    /*!
+     * Consumer side, throw away everything pending, e.g. before the displayer (re)starts drawing
+     */
+    void discard();
+
+    size_t capacity() const;
+
+    //!< number of samples waiting for the consumer
+    size_t pending() const;
+
+    //!< number of samples dropped by push() because the ring was full
+    unsigned long long dropped() const;
+};
+}
@@ -38,6 +38,25 @@
  */
 
 namespace phawd {
+/*!
+ * Options of createNew() and attach() for real-time programs, can be combined with |.
+ * Without them the pages are faulted in (and may be swapped out) whenever the control loop touches them first.
+ */
+enum SharedMemoryOption : unsigned int {
+    SHM_NO_OPTION = 0,
+    SHM_PREFAULT = 1u << 0,     // map all pages at once(MAP_POPULATE), no page fault later
+    SHM_MLOCK = 1u << 1,        // lock the pages in RAM(mlock), needs RLIMIT_MEMLOCK or CAP_IPC_LOCK, only warns if it fails
+    SHM_HUGE_PAGES = 1u << 2,   // create the segment in the hugetlbfs mounted at /dev/hugepages, falls back to normal
+                                // pages if it's not mounted or no huge page is reserved(vm.nr_hugepages).
+                                // attach() must be given this option as well to look for it there
+};
+
+/*!
+ * Address space every mapping reserves on linux, so that the segment can grow() in place and the pointers into it
+ * stay valid in all processes. Only the part inside the segment is backed by memory.
+ */
+constexpr size_t SHM_ADDRESS_RESERVE = 64 * 1024 * 1024;
+
 template<typename T>
 class PHAWD_DLLAPI SharedMemory{
 private:
@@ -48,23 +67,61 @@ private:
     HANDLE _fileMapping = nullptr;
 #elif __linux__
     int _fd = 0;
+    bool _hugePages = false;    // the segment is a file in hugetlbfs instead of a POSIX shared memory object
 #endif
     size_t _size = 0;
+    size_t _mappedSize = 0;     // address space mapped, the segment can grow up to it
+    unsigned int _options = SHM_NO_OPTION;
+    unsigned int _generation = 0;
     std::string _name{};
+    unsigned int _seenUpdate = 0;
+
+#if __linux__
+    //!< shm_open() and mmap() the POSIX shared memory object, used when huge pages are not asked or not available
+    void *mapNew(const std::string &name, bool allowOverwrite, int flags);
+    void *mapExisting(const std::string &name, int flags);
+#endif
 
 public:
     SharedMemory() = default;
 
     ~SharedMemory();
 
-    void createNew(const std::string &name, size_t size, bool allowOverwrite = true);
+    void createNew(const std::string &name, size_t size, bool allowOverwrite = true,
+                   unsigned int options = SHM_NO_OPTION);
 
-    void attach(const std::string &name, size_t size);
+    /*!
+     * Attach to shared memory created by another process, and check its header
+     * @param size : bytes to map, 0 to map the whole shared memory, then only the name is needed
+     */
+    void attach(const std::string &name, size_t size = 0, unsigned int options = SHM_NO_OPTION);
 
     void closeNew();
 
     void detach();
 
+    /*!
+     * Enlarge the segment to size bytes while other processes keep using it, the object in it should then lay out
+     * the new part and bump its generation, e.g. SharedParameters::addWaveParameters().
+     * Not supported on windows, and limited to SHM_ADDRESS_RESERVE(or the huge page the segment is rounded up to)
+     */
+    void grow(size_t size);
+
+    /*!
+     * Follow a change of the layout made by another process, cheap when there is none
+     * @return true if the generation of the object changed since the last call, the counts should be read again then
+     */
+    bool updateMapping();
+
+    size_t size() const { return _size; }
+
+    /*!
+     * Block until a producer calls notifyUpdate() on the object in shared memory, or until timeout
+     * @param milliseconds : timeout
+     * @return true if there was an update since the last call
+     */
+    bool waitForUpdate(long milliseconds);
+
     T *get();
 
     T &operator()();
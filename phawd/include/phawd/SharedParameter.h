@@ -13,6 +13,7 @@
 #pragma once
 
 #include "phawd/Parameter.h"
+#include "phawd/SampleRing.h"
 
 namespace phawd {
 struct PHAWD_DLLAPI GamepadCommand {
@@ -30,13 +31,86 @@ struct PHAWD_DLLAPI GamepadCommand {
     GamepadCommand();
 };
 
+constexpr unsigned int SHARED_MEMORY_MAGIC = 0x44574850;    // "PHWD" in little endian
+constexpr unsigned int SHARED_MEMORY_VERSION = 8;           // bumped whenever the layout of SharedParameters changes
+constexpr int SHARED_MEMORY_MAX_PRODUCERS = 16;
+
+enum ProducerState : unsigned int {
+    PRODUCER_FREE = 0,      // slot never used
+    PRODUCER_BUSY,          // being claimed by registerProducer()
+    PRODUCER_ACTIVE,
+    PRODUCER_LEFT,          // unregistered, the waveform parameters are kept for a producer of the same name
+};
+
+/*!
+ * One process publishing waveforms into the shared memory, e.g. estimator, planner and controller each register
+ * one. It owns the waveform parameters [waveBegin, waveBegin + waveCount) and their rings, nobody else writes them.
+ */
+struct PHAWD_DLLAPI ProducerSlot {
+    std::atomic<unsigned int> state;    // ProducerState
+    int pid;                            // process id of the producer, for diagnostics only
+    std::atomic<long long> heartbeat;   // getTimestamp() of the producer at its last heartbeat
+    char name[16];
+    size_t waveBegin;                   // index of its first waveform parameter, counted from numControlParams
+    size_t waveCount;
+    char padding[16];                   // one slot per cache line, so heartbeats of producers don't contend
+};
+static_assert(sizeof(ProducerSlot) == 64, "ProducerSlot should take one cache line");
+
+/*!
+ * The shared memory starts with a header describing itself, so that a client can attach by name only and find out
+ * the schema and where everything is without recomputing the size: magic, version, layout hash, the total size and
+ * the offsets of the parameters and the rings, then the counts.
+ *
+ * Waveform parameters of kind VECN_DOUBLE/MATRIX_DOUBLE keep their elements in the data arena at the end, so that a
+ * whole joint vector is published with one name and one copy, see setWaveArray().
+ */
 class PHAWD_DLLAPI SharedParameters {
 public:
-    int connected;                      // Number of connected objects, and whenever an object is connected, the value should manually increment 1
+    std::atomic<unsigned int> magic;    // SHARED_MEMORY_MAGIC once init() has finished, 0 before
+    unsigned int version;               // SHARED_MEMORY_VERSION of the creator
+    unsigned int layoutHash;            // getLayoutHash() of the creator, differs if sizes or alignment of the types differ
+    unsigned int parametersOffset;      // Byte offset of parameters[] from the beginning of this object
+    size_t totalSize;                   // Bytes used by everything, getSize() of the creator
     size_t numControlParams;            // Number of control parameters
     size_t numWaveParams;               // Number of waveform parameters
-    phawd::GamepadCommand gameCommand;  // Commands from joystick
-    Parameter parameters[];	            // (control parameters)[0, numControlParams) and (waveform parameters)[numControlParams, numControlParams + numWaveParams)
+    size_t waveParamsBegin;             // Index of the first waveform parameter in parameters[], see getWaveParameters()
+    bool separateRegions;               // Waveform parameters and producers start on cache lines of their own, see init()
+    size_t sampleRingCapacity;          // Samples per waveform ring, 0 if the shared memory is created without rings
+    size_t sampleRingOffset;            // Byte offset of the first waveform ring from the beginning of this object
+    size_t controlBankOffset;           // Byte offset of the second bank of control parameters, 0 if there is none
+    size_t dataArenaOffset;             // Byte offset of the data arena, 0 if there is none
+    size_t dataArenaSize;               // Doubles in the data arena
+
+    // The fields below are grouped by who writes them, a cache line for each group, so that the displayer and the
+    // robot programs don't keep stealing lines from each other
+
+    // written by the displayer
+    alignas(64) std::atomic<unsigned int> generation;   // Bumped twice by every change of the layout, odd while it is going on
+    std::atomic<unsigned int> controlBank;  // Bank of control parameters handed out by acquireControlBank(), 0 or 1
+    std::atomic<unsigned int> controlGeneration[2]; // Per bank, odd while commitControlUpdate() writes it
+
+    // written by the robot programs every control cycle
+    alignas(64) std::atomic<unsigned int> ringPushers;  // Number of pushWaveSamples()/setWaveArray() running, a layout change waits for them
+    std::atomic<unsigned int> updateSeq;    // Bumped by notifyUpdate(), the futex word waited on by waitForUpdate()
+    std::atomic<long long> waveTimestamp;   // getTimestamp() of the robot program at the last pushWaveSamples(), 0 if never
+
+    // written by the displayer every time it goes to sleep
+    alignas(64) std::atomic<unsigned int> updateWaiters;    // Number of threads blocked in waitForUpdate()
+
+    // written when robot programs come and go
+    alignas(64) std::atomic<int> connected; // Number of connected objects, kept by registerProducer() and unregisterProducer(),
+                                            // clients that don't register should increment it themselves
+    std::atomic<size_t> assignedWaveParams; // Waveform parameters handed out to producers, from the first one
+    std::atomic<size_t> dataArenaUsed;      // Doubles of the data arena handed out by setWaveArray()
+    alignas(64) ProducerSlot producers[SHARED_MEMORY_MAX_PRODUCERS];    // Registration table of the producers, a line each
+
+    alignas(64) phawd::GamepadCommand gameCommand;  // Commands from joystick, written by the displayer
+    alignas(64) Parameter parameters[];     // (control parameters)[0, numControlParams), their second bank and
+                                            // staging bank [numControlParams, 3 * numControlParams) and
+                                            // (waveform parameters)[waveParamsBegin, waveParamsBegin + numWaveParams)
+                                            // followed by numWaveParams SampleRings when sampleRingCapacity > 0
+                                            // and the data arena of dataArenaSize doubles
 
 private:
     SharedParameters();
@@ -44,6 +118,9 @@ private:
     SharedParameters(const SharedParameters &p);
 
     SharedParameters(SharedParameters &&p) noexcept;
+
+    //!< push the waveform parameters [begin, begin + count) to their rings
+    void pushSamples(size_t begin, size_t count, long long timestamp);
 public:
     SharedParameters& operator=(const SharedParameters &p);
 
@@ -51,6 +128,194 @@ public:
 
     void collectParameters(ParameterCollection *pc);
 
+    /*!
+     * Bytes of shared memory needed by the parameters and the optional waveform rings, used for
+     * SharedMemory::createNew() and SharedMemory::attach()
+     * @param sample_ring_capacity : samples per waveform ring, 0 means no ring
+     * @param separate_regions : see init()
+     * @param data_arena_size : doubles for the elements of VECN_DOUBLE/MATRIX_DOUBLE waveform parameters
+     */
+    static size_t getSize(size_t num_control_params, size_t num_wave_params, size_t sample_ring_capacity = 0,
+                          bool separate_regions = false, size_t data_arena_size = 0);
+
+    /*!
+     * Lay out the counts and waveform rings in shared memory just created with getSize() bytes, and write the header
+     * @param separate_regions : start the waveform parameters on a cache line of their own, and the range of every
+     * producer as well, so that writing control parameters and publishing waveforms on other cores never touch the
+     * same line. Clients have to find the waveform parameters with getWaveParameters() then, instead of right after
+     * the control parameters. numWaveParams then includes getProducerPadding() parameters on top of num_wave_params,
+     * room for the gaps in front of the ranges of producers. They are the last ones as long as no producer registered,
+     * so that clients which don't register still find theirs in the first numWaveParams - getProducerPadding().
+     */
+    void init(size_t num_control_params, size_t num_wave_params, size_t sample_ring_capacity = 0,
+              bool separate_regions = false, size_t data_arena_size = 0);
+
+    //!< index of the first waveform parameter in parameters[], behind the three banks of control parameters, padded up
+    //!< to a cache line if the regions are separate
+    static size_t getWaveParamsBegin(size_t num_control_params, bool separate_regions);
+
+    //!< waveform parameters reserved for the gaps registerProducer() leaves in front of every range but the first one
+    //!< when the regions are separate, 0 otherwise
+    static size_t getProducerPadding(bool separate_regions);
+
+    //!< the first waveform parameter, parameters + waveParamsBegin
+    Parameter *getWaveParameters();
+
+    /*!
+     * Hash of the sizes and alignments of every type laid out in shared memory, two programs can only share the
+     * memory if they agree on it
+     */
+    static unsigned int getLayoutHash();
+
+    /*!
+     * Throw if the header isn't a valid one written by init() of the same version and layout
+     * @param mapped_size : bytes mapped by the caller, should cover totalSize
+     */
+    void checkHeader(size_t mapped_size) const;
+
+    /*!
+     * Append count waveform parameters while the robot program keeps running, called by the creator after
+     * SharedMemory::grow() to getSize() of the new counts. Existing parameters stay where they are, the rings move
+     * behind the new parameters and restart empty, the data arena moves behind them with its elements. Other
+     * processes see the generation change, see SharedMemory::updateMapping().
+     * The banks of control parameters lie in front of the waveform parameters and are left alone, edits staged and
+     * not committed yet are kept.
+     */
+    void addWaveParameters(size_t count);
+
+    //!< the first double of the data arena, nullptr if the shared memory has none
+    double *getDataArena();
+
+    /*!
+     * Publish a vector(cols is 1, VECN_DOUBLE) or a row major matrix(MATRIX_DOUBLE) as one waveform parameter, e.g.
+     * all joint positions of the robot. The first call takes rows * cols doubles of the data arena for the parameter,
+     * later calls copy values there as long as they aren't larger than the previous one, a parameter growing takes a
+     * new range.
+     * Ranges are never given back, not when the parameter grows, nor when its producer unregisters: the arena has to
+     * hold every size the parameters ever take. The displayer shows every element as a curve of its own.
+     * Throws exception if the data arena is full.
+     * @return false if the write was skipped because waveform parameters are being added right now
+     */
+    bool setWaveArray(size_t wave_index, const double *values, unsigned int rows, unsigned int cols = 1);
+
+    /*!
+     * Copy the elements of a VECN_DOUBLE/MATRIX_DOUBLE waveform parameter, all of them from the same write.
+     * @param capacity : elements values can take
+     * @return the kind of the parameter, rows and cols are only set for VECN_DOUBLE/MATRIX_DOUBLE
+     */
+    ParameterKind getWaveArray(size_t wave_index, double *values, size_t capacity, unsigned int &rows,
+                               unsigned int &cols);
+
+    /*!
+     * @param wave_index : index of the waveform parameter, in [0, numWaveParams)
+     * @return the ring of this waveform parameter, nullptr if the shared memory has no rings
+     */
+    SampleRing *getSampleRing(size_t wave_index);
+
+    /*!
+     * Publish the waveform parameters of this control cycle, the robot program should call this once per cycle after
+     * updating them. It stamps waveTimestamp and pushes the current value of every waveform parameter to its ring.
+     * @param timestamp : time of this cycle, getTimestamp() by default
+     */
+    void pushWaveSamples();
+    void pushWaveSamples(long long timestamp);
+
+    /*!
+     * @param bank : 0 for parameters[] itself, 1 for the second bank, which moves when waveform parameters are added
+     * @return the first control parameter of the bank
+     */
+    Parameter *getControlParameters(unsigned int bank);
+
+    //!< add the control parameters of a bank to pc, the second bank moves when waveform parameters are added
+    void collectControlParameters(ParameterCollection *pc, unsigned int bank);
+
+    /*!
+     * Robot program side, called at the beginning of a control cycle. The control parameters of the returned bank
+     * belong to the same commitControlUpdate() if releaseControlBank() returns true, so a set of gains is never
+     * half applied:
+     *
+     *     do {
+     *         bank = shm->acquireControlBank(generation);
+     *         bindings[bank].pull(gains);
+     *     } while (!shm->releaseControlBank(bank, generation));
+     *
+     * Neither side ever waits for the other one, a robot program or the displayer dying in between doesn't hang
+     * anybody.
+     * @param generation : receives the generation of the bank, for releaseControlBank()
+     * @return the bank to read in this cycle, see getControlParameters()
+     */
+    unsigned int acquireControlBank(unsigned int &generation);
+
+    /*!
+     * End of the reads of a control cycle.
+     * @return false if a commit has overwritten the bank since acquireControlBank(), it has to be read again
+     */
+    bool releaseControlBank(unsigned int bank, unsigned int generation);
+
+    /*!
+     * Displayer side, the bank where edits of control parameters are staged, behind the second bank. It holds the
+     * current control parameters after every commitControlUpdate(), robot programs never read it.
+     */
+    Parameter *getControlStaging();
+
+    /*!
+     * Displayer side, publish everything staged since the last commit at once. The staging bank is copied into the
+     * bank not handed out to the robot programs, which flip to it at their next acquireControlBank(), then into the
+     * other one as well.
+     */
+    void commitControlUpdate();
+
+    /*!
+     * Lock-free registration of a producer process, several of them can publish into the same shared memory.
+     * A producer coming back under the same name(after unregisterProducer() or dying) gets its old slot and
+     * waveform parameters again.
+     * @param name : at most 15 characters, prefixes the names of its waveform parameters in the displayer
+     * @param num_wave_params : number of waveform parameters it publishes, taken from those not assigned yet
+     * @return id of the producer, throw if there is no free slot or not enough waveform parameters left
+     */
+    int registerProducer(const std::string &name, size_t num_wave_params);
+
+    void unregisterProducer(int id);
+
+    //!< tell the displayer that the producer is still alive, pushProducerSamples() does it as well
+    void heartbeat(int id);
+
+    /*!
+     * @param timeout : nanoseconds since the last heartbeat after which the producer is considered dead
+     */
+    bool isProducerAlive(int id, long long timeout = 1000000000LL);
+
+    //!< the first of the waveform parameters owned by the producer
+    Parameter *getProducerParameters(int id);
+
+    /*!
+     * pushWaveSamples() for the waveform parameters of one producer only, plus its heartbeat.
+     * With several producers each should use this instead of pushWaveSamples(), as the rings have one producer each.
+     */
+    void pushProducerSamples(int id);
+    void pushProducerSamples(int id, long long timestamp);
+
+    //!< id of the producer owning the waveform parameter, -1 if none
+    int getProducerOf(size_t wave_index);
+
+    //!< name of the waveform parameter as shown by the displayer, "producer/parameter" if it belongs to a producer
+    std::string getWaveLabel(size_t wave_index);
+
+    /*!
+     * Wake up everyone blocked in waitForUpdate(), called by pushWaveSamples(). A robot program that doesn't push
+     * samples should call it after attaching and setting the waveform parameters, so that they are detected at once.
+     * It only enters the kernel when somebody is waiting.
+     */
+    void notifyUpdate();
+
+    /*!
+     * Block until notifyUpdate() is called by any process, instead of polling.
+     * @param seen : the updateSeq seen by the caller last time, set to the current one on return
+     * @param milliseconds : timeout, returns immediately if it's not positive
+     * @return true if there was an update since seen, false on timeout
+     */
+    bool waitForUpdate(unsigned int &seen, long milliseconds);
+
     static SharedParameters* create(int num_control_params, int num_wave_params);
 
     static void destroy(SharedParameters* p);
@@ -81,6 +346,7 @@ public:
 
 class PHAWD_DLLAPI SocketToPhawd {
 public:
+    long long timestamp;                // getTimestamp() of the client when it was sent, stamped by SocketConnect::Send()
     size_t numWaveParams;
     Parameter parameters[];
 private:
@@ -18,13 +18,30 @@
 #include<netinet/in.h>
 #include<arpa/inet.h>
 #include<unistd.h>
+#include<sys/socket.h>
+#include<sys/un.h>
 #endif
 
 #pragma once
 #include "phawd/phawd_config.h"
+#include "phawd/SocketFrame.h"
 #include <string>
+#include <vector>
 
 namespace phawd {
+/*!
+ * Unix domain socket phawd listens on besides the TCP port, mount it into a container to connect from there.
+ * It lies in $XDG_RUNTIME_DIR, or in /tmp/phawd-<uid> if that isn't set, so only the user running phawd can connect.
+ */
+PHAWD_DLLAPI std::string getLocalSocketPath(unsigned short port);
+
+/*!
+ * Server side, before bind() to path: create its directory with mode 0700 if it is missing, and remove a socket file
+ * left there by a server of the same user.
+ * @return false if the directory or the file at path belongs to another user, or the file isn't a socket
+ */
+PHAWD_DLLAPI bool prepareLocalSocketPath(const std::string &path);
+
 /*!
  * This class is used for socket communication.
  * Server should call Init() first to create a socket and open internet library, then call bind() to bind the socket with an specified ip address.
@@ -34,8 +51,12 @@ namespace phawd {
  *
  * Client should call Init() first to create a socket and open internet library, then call connectToServer() to create a connection with the specified ip address.
  * Then the connection between server and client finished.
+ * On the same host connectToLocalServer()/listenToLocalClient() use a unix domain socket instead of TCP, everything
+ * else stays the same.
  *
  * Now we can use read()/send() to exchange data between server and client.
+ * Every message is sent as a frame(SocketFrameHeader + message), so that the reader can cut the byte stream of TCP
+ * back into whole messages, see FrameAssembler.
  * getRead()/setSent()
  * This member of message is used to provide internal errors and build information to the outside.
  *
@@ -49,15 +70,78 @@ private:
     bool isServer = false;
 #if _WIN32
     SOCKET socket_fd, connected_fd;
+    SOCKET _datagram_fd = INVALID_SOCKET;
     SOCKADDR_IN  _clientAddr{};
 #elif __linux
     int socket_fd, connected_fd;
+    int _datagram_fd = -1;
     sockaddr_in  _clientAddr{};
 #endif
     size_t _sendSize;
     size_t _readSize;
     SendData *_sendData = nullptr;
     ReadData *_readData = nullptr;
+    unsigned int _sendSequence = 0;
+    std::vector<char> _sendFrame;       // frame being sent, a frame is never cut by a full socket buffer
+    size_t _sendFrameOffset = 0;        // bytes of _sendFrame already sent
+    FrameAssembler _assembler;
+    unsigned int _keyframeInterval = 0;
+    unsigned int _framesSinceKeyframe = 0;
+    std::vector<char> _baseline;        // last message as the receiver has it, deltas are computed against it
+    bool _schemaHandshake = false;
+    bool _schemaSent = false;
+    unsigned int _schemaId = 0;
+    std::vector<std::string> _waveUnits;
+    bool _local = false;                // connected over a unix domain socket(SOCK_SEQPACKET)
+    std::vector<int> _descriptors;      // received by sendDescriptor() of the other side, not taken yet
+    bool _udpTelemetry = false;
+    unsigned int _datagramSequence = 0; // datagrams are counted apart from the frames over TCP
+    std::vector<char> _datagramFrame;
+    size_t _batchSamples = 0;           // messages per batch, 0 or 1 if SendBatched() doesn't batch
+    long long _batchDelay = 0;          // nanoseconds the oldest message of a batch may wait, 0 for no limit
+    std::vector<char> _batchFrame;      // batch being filled, swapped with _sendFrame when it is sent
+    unsigned int _batchCount = 0;
+    unsigned int _batchEntrySize = 0;
+    unsigned short _batchEntryType = 0;
+    long long _batchStarted = 0;        // getTimestamp() when the first message of the batch was added
+    bool _stampTimestamp = true;
+    std::string _localPath;             // server of connectToLocalServer(), connected to again by resumeConnection()
+    bool _reconnect = false;
+    bool _reconnecting = false;         // the connection was lost, Send()/Read() try to connect again
+    bool _connecting = false;           // a non-blocking connect() of resumeConnection() is in progress
+    long long _reconnectAt = 0;         // getTimestamp() of the next attempt, or when the one in progress gives up
+    long long _minBackoff = 0;          // nanoseconds between the attempts, doubled after every failed one
+    long long _maxBackoff = 0;
+    long long _backoff = 0;
+
+    //!< send the rest of _sendFrame, return 1 when it's all sent, 0 if the socket buffer is full, -1 on error
+    int flushFrame();
+
+    /*!
+     * Send a header and _sendData with one gather call, without copying them into _sendFrame. Only what the socket
+     * doesn't take is copied there, to be sent by flushFrame(). Return value as flushFrame().
+     */
+    int sendDirect(unsigned short type, unsigned int &sequence);
+
+    //!< receive one record of the unix domain socket into _assembler, like recv() returns its size, 0 or -1
+    int receiveRecord(size_t size);
+
+    //!< send _datagramFrame as one datagram, return 1 if sent, 0 if dropped by a full buffer, -1 on error
+    int sendDatagram();
+
+    //!< the socket used by Send()/Read() is open
+    bool isOpen() const;
+
+    //!< close a broken connection of a client with setReconnect(), resumeConnection() opens a new one later
+    void dropConnection();
+
+    /*!
+     * Take the next step of connecting again without waiting: start a non-blocking connect() once the backoff is
+     * over, or check whether the one in progress finished. A new connection starts a new session, the schema and a
+     * whole message are sent again.
+     * @return true once connected
+     */
+    bool resumeConnection();
 public:
     SocketConnect();
 
@@ -70,12 +154,121 @@ public:
     void listenToClient(unsigned short port, int listenQueueLength = 2, long int milliseconds = 60);
 
     /*!
-     * @return : -1 send failed , else send success
+     * Connect over a unix domain socket(AF_UNIX, SOCK_SEQPACKET) instead of TCP, for a client on the same host
+     * which can't share memory with phawd, e.g. in a container. Every frame is one record: the kernel keeps
+     * message boundaries and doesn't go through the TCP stack. Only supported on linux.
+     * @param path : socket file of the server, getLocalSocketPath(port) for phawd
+     */
+    void connectToLocalServer(const std::string &path);
+
+    //!< server side of connectToLocalServer(), a socket file of the same user at path is replaced, see
+    //!< prepareLocalSocketPath(). The socket file is only accessible to the user(0600)
+    void listenToLocalClient(const std::string &path, int listenQueueLength = 2, long int milliseconds = 60);
+
+    /*!
+     * Pass an open file descriptor(e.g. a memfd or shared memory) to the other side of a unix domain socket,
+     * it gets its own descriptor of the same file from takeDescriptor() after its next Read().
+     * @return false if not connected with connectToLocalServer()/listenToLocalClient() or the socket is busy
+     */
+    bool sendDescriptor(int fd);
+
+    //!< the oldest descriptor received and not taken yet, -1 if there is none. The caller has to close it.
+    int takeDescriptor();
+
+    /*!
+     * Send only the waveform parameters which changed since the last message, with a whole message every frames
+     * messages so that the receiver can't drift away. Names or number of parameters changing also send it whole.
+     * Only SocketToPhawd supports deltas, the receiver has to understand FRAME_TO_PHAWD_DELTA.
+     * @param frames : 0 or 1 sends every message whole, which is the default
+     */
+    void setKeyframeInterval(unsigned int frames);
+
+    /*!
+     * Send names, kinds and units of the waveform parameters once per connection, afterwards only their values
+     * are sent, see FRAME_WAVE_SCHEMA. The schema is sent again when names, kinds or their number change.
+     * Only SocketToPhawd supports it, the receiver has to understand FRAME_WAVE_SCHEMA.
+     */
+    void setSchemaHandshake(bool enable);
+
+    /*!
+     * Unit of the index-th waveform parameter shown by phawd, e.g. "rad/s", sent with the schema handshake
+     * @return false if unit is longer than 16 characters
+     */
+    bool setWaveUnit(size_t index, const std::string &unit);
+
+    /*!
+     * Send the waveform parameters of a client as UDP datagrams to the port of the server, one message per
+     * datagram without retransmit, so that a lost segment can't stall the following ones like it does on TCP.
+     * The schema of setSchemaHandshake() and everything read from the server stay on TCP. Deltas are not sent in
+     * this mode, a lost datagram would break all of them until the next keyframe.
+     */
+    void setUdpTelemetry(bool enable);
+
+    /*!
+     * Let SendBatched() collect the messages of several control cycles and send them as one frame
+     * (FRAME_TO_PHAWD_BATCH), which saves a syscall per cycle. Every message keeps its timestamp and phawd draws all
+     * of them. Only SocketToPhawd can be batched, the entries are values only with setSchemaHandshake().
+     * Batches always go over the connection, also with setUdpTelemetry(), and are never sent as deltas.
+     * On a unix domain socket a batch has to fit into the send buffer of the socket(about 200 KB by default).
+     * @param samples : messages per batch, 0 or 1 makes SendBatched() the same as Send()
+     * @param max_delay_us : a batch is sent early once its oldest message waited this long, 0 for no limit.
+     *                       It is only checked by SendBatched(), call FlushBatch() when the loop stops sending.
+     */
+    void setBatch(size_t samples, long long max_delay_us = 0);
+
+    /*!
+     * Send getSend() as one frame. If the socket buffer is full the rest of the frame goes out with the next calls,
+     * and new data is dropped until then instead of being interleaved with it.
+     * @return : -1 send failed or dropped, else bytes of the frame
      */
     int Send(bool verbose = false);
 
     /*!
-     * @return : -1 read failed , else read success
+     * Add getSend() to the batch of setBatch(), the batch is sent when it is full or too old. The buffers are
+     * reserved once, so adding a message doesn't allocate. If the last frame is still being sent the batch waits
+     * and keeps growing up to 4 batches, further messages are dropped. Send() sends the batch first, so that
+     * messages arrive in order when both are used.
+     * @return : -1 send failed or the message was dropped, 0 if the message was only added, else bytes of the batch
+     */
+    int SendBatched(bool verbose = false);
+
+    //!< send the messages added by SendBatched() now, return value as SendBatched()
+    int FlushBatch(bool verbose = false);
+
+    /*!
+     * Let a client connect again by itself when the connection is lost, e.g. phawd was restarted. Send()/Read() notice
+     * the broken connection and try again with a non-blocking connect() when they are called, min_backoff_ms after
+     * the loss and then twice as long after every failed attempt, up to max_backoff_ms. So a control loop never
+     * waits for the server, its messages are dropped(-1) until the connection is back.
+     * Buffers and settings stay as they are, the new connection is set up like the first one: the schema of
+     * setSchemaHandshake() and a whole message are sent first. A batch not sent yet is lost.
+     * Only for clients of connectToServer()/connectToLocalServer().
+     */
+    void setReconnect(bool enable, long long min_backoff_ms = 100, long long max_backoff_ms = 5000);
+
+    //!< the connection is up, false while a client of setReconnect() is connecting again
+    bool isConnected() const;
+
+    /*!
+     * Send() and SendBatched() stamp SocketToPhawd::timestamp with the time they are called. Turn it off when the
+     * messages are stamped where they are produced and sent later, like AsyncSocketConnect does.
+     */
+    void setStampTimestamp(bool enable);
+
+    /*!
+     * The socket used by Send()/Read(), to wait for it with select()/epoll instead of polling Read().
+     * Don't read or write it directly, the frames would get mixed up.
+     */
+#if _WIN32
+    SOCKET getDescriptor() const;
+#elif __linux__
+    int getDescriptor() const;
+#endif
+
+    /*!
+     * Receive everything available and copy the latest complete message into getRead(), frames arriving in pieces
+     * are put together across calls.
+     * @return : -1 read failed or no complete message yet, else bytes of the message
      */
     int Read(bool verbose = false);
 
@@ -0,0 +1,218 @@
+/*!
+ * PHAWD - Parameters Handler and Waveform Display
+ * Licensed under the GNU GPLv3 license. See LICENSE for more details.
+ * @author HuNing-He
+ * @date 2026-10-16
+ * @version 0.3
+ * @email 2689112371@qq.com
+ * @copyright (c) 2022 HuNing-He
+ * @file SocketFrame.h
+ * @brief framing of the messages exchanged over socket
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "phawd/phawd_config.h"
+#include "phawd/Parameter.h"
+
+namespace phawd {
+class SocketToPhawd;
+
+constexpr unsigned int SOCKET_FRAME_MAGIC = 0x46574850;        // "PHWF" in little endian
+constexpr unsigned int SOCKET_FRAME_MAX_LENGTH = 16 << 20;     // larger lengths are taken as corrupted headers
+
+enum SocketFrameType : unsigned short {
+    FRAME_TO_PHAWD = 1,     // SocketToPhawd, waveform parameters sent by the robot program
+    FRAME_FROM_PHAWD = 2,   // SocketFromPhawd, control parameters and gamepad sent by phawd
+    FRAME_TO_PHAWD_DELTA = 3,   // SocketDeltaHeader + changed waveform parameters, see encodeWaveDelta()
+    FRAME_WAVE_SCHEMA = 4,      // SocketSchemaHeader + SocketChannelSchema of every waveform parameter
+    FRAME_TO_PHAWD_SAMPLE = 5,  // SocketSampleHeader + values of every waveform parameter, see encodeWaveSample()
+    FRAME_DESCRIPTOR = 6,       // no payload, a file descriptor is attached, see SocketConnect::sendDescriptor()
+    FRAME_TO_PHAWD_BATCH = 7,   // SocketBatchHeader + messages of several control cycles, see SocketConnect::setBatch()
+};
+
+/*!
+ * Every message over socket is preceded by this header. TCP is a byte stream, a recv() may return part of a message
+ * or several of them, the length tells where one message ends and the next begins.
+ * Fields are in the byte order of the sender, like the messages themselves.
+ */
+struct PHAWD_DLLAPI SocketFrameHeader {
+    unsigned int magic;     // SOCKET_FRAME_MAGIC, used to find the next header again after garbage
+    unsigned int length;    // bytes of the message following the header
+    unsigned short type;    // SocketFrameType
+    unsigned short flags;   // 0, reserved
+    unsigned int sequence;  // counted up by the sender for every frame, a gap means frames were dropped
+
+    void init(unsigned short frame_type, unsigned int frame_length, unsigned int frame_sequence);
+};
+static_assert(sizeof(SocketFrameHeader) == 16, "SocketFrameHeader is sent over socket, keep it stable");
+
+/*!
+ * Reassembly buffer of the receiving side: append whatever recv() returned, then take out complete frames with next().
+ * Partial frames stay buffered until the rest arrives, bytes which don't start with a valid header are skipped until
+ * the next magic, so one corrupted frame doesn't misalign all the following ones.
+ */
+class PHAWD_DLLAPI FrameAssembler {
+private:
+    std::vector<char> m_buffer;
+    size_t m_begin = 0;                 // first byte not taken out yet
+    size_t m_end = 0;                   // end of the received bytes
+    unsigned int m_maxLength;
+    unsigned long long m_skipped = 0;   // bytes thrown away while looking for a header
+
+public:
+    explicit FrameAssembler(unsigned int max_length = SOCKET_FRAME_MAX_LENGTH);
+
+    /*!
+     * Make room to receive into the buffer directly, without copying.
+     * @return space for at least size bytes, pass the number of bytes really written to commit()
+     */
+    char *reserve(size_t size);
+    void commit(size_t size);
+
+    //!< reserve() + memcpy + commit()
+    void append(const void *data, size_t size);
+
+    /*!
+     * Take out the next complete frame.
+     * @param payload : set to the message of the frame, valid until the next reserve() or append()
+     * @return false if no complete frame is buffered
+     */
+    bool next(SocketFrameHeader &header, const char *&payload);
+
+    //!< drop everything buffered, e.g. when the connection is reset
+    void clear();
+
+    //!< bytes buffered but not taken out
+    size_t pending() const;
+
+    unsigned long long skipped() const;
+};
+
+/*!
+ * Loss accounting of frames received as datagrams, which may be lost or arrive out of order and are never
+ * retransmitted. A frame arriving after a newer one is late: it was counted as lost when the gap was seen,
+ * now it is counted as reordered instead. The missing frames of the last 64 sequences are remembered, a late frame
+ * which isn't one of them was already received, or is too old to tell, and is counted as duplicated.
+ */
+class PHAWD_DLLAPI SequenceTracker {
+private:
+    bool m_started = false;
+    unsigned int m_next = 0;                // sequence expected next
+    unsigned long long m_missing = 0;       // bit k is set if sequence m_next - 1 - k was counted as lost
+    unsigned long long m_received = 0;
+    unsigned long long m_lost = 0;
+    unsigned long long m_reordered = 0;
+    unsigned long long m_duplicated = 0;
+
+public:
+    /*!
+     * @param sequence : SocketFrameHeader::sequence of a received frame
+     * @return true if the frame is newer than all frames before, false if it is late and should be dropped
+     */
+    bool accept(unsigned int sequence);
+
+    //!< start over, e.g. when a new client connects
+    void clear();
+
+    unsigned long long received() const;
+    unsigned long long lost() const;
+    unsigned long long reordered() const;
+    unsigned long long duplicated() const;
+};
+
+/*!
+ * Payload of FRAME_TO_PHAWD_DELTA, followed by numChanges entries of
+ * unsigned short index + unsigned short ParameterKind + the bytes of the value used by that kind,
+ * e.g. 12 bytes for a changed double instead of the whole 48 bytes Parameter.
+ */
+struct PHAWD_DLLAPI SocketDeltaHeader {
+    long long timestamp;            // SocketToPhawd::timestamp
+    unsigned int numWaveParams;     // must match the SocketToPhawd it is applied to
+    unsigned int numChanges;
+};
+static_assert(sizeof(SocketDeltaHeader) == 16, "SocketDeltaHeader is sent over socket, keep it stable");
+
+/*!
+ * Append the waveform parameters of current which differ from baseline to frame, and update baseline with them.
+ * The receiver applies it onto the last message it got, so baseline has to be what was sent before.
+ * @return false if a whole message has to be sent instead: names or number of parameters changed, or the delta
+ *         wouldn't be smaller. frame is left as it was, baseline may be partially updated and should be replaced.
+ */
+PHAWD_DLLAPI bool encodeWaveDelta(const SocketToPhawd *current, SocketToPhawd *baseline, size_t message_size,
+                                  std::vector<char> &frame);
+
+/*!
+ * Apply the payload of a FRAME_TO_PHAWD_DELTA onto data, which has to hold the message sent before.
+ * @return false if the delta is malformed or belongs to another number of parameters, data is unchanged then
+ */
+PHAWD_DLLAPI bool applyWaveDelta(SocketToPhawd *data, const char *payload, size_t length);
+
+/*!
+ * With the schema handshake names, kinds and units of the waveform parameters are sent once as FRAME_WAVE_SCHEMA,
+ * afterwards every message is a FRAME_TO_PHAWD_SAMPLE holding only the values, packed in the order of the schema.
+ * The schema is sent again whenever names, kinds or the number of parameters change.
+ */
+struct PHAWD_DLLAPI SocketSchemaHeader {
+    unsigned int numWaveParams;
+    unsigned int schemaId;          // counted up by the sender, samples of another schema are ignored
+};
+static_assert(sizeof(SocketSchemaHeader) == 8, "SocketSchemaHeader is sent over socket, keep it stable");
+
+struct PHAWD_DLLAPI SocketChannelSchema {
+    char name[16];                  // not null terminated if 16 characters long, like Parameter
+    char unit[16];                  // may be empty
+    unsigned short kind;            // ParameterKind
+    unsigned short reserved;
+    unsigned int reserved2;
+};
+static_assert(sizeof(SocketChannelSchema) == 40, "SocketChannelSchema is sent over socket, keep it stable");
+
+struct PHAWD_DLLAPI SocketSampleHeader {
+    long long timestamp;            // SocketToPhawd::timestamp
+    unsigned int schemaId;
+    unsigned int reserved;
+};
+static_assert(sizeof(SocketSampleHeader) == 16, "SocketSampleHeader is sent over socket, keep it stable");
+
+/*!
+ * Payload of FRAME_TO_PHAWD_BATCH, followed by numSamples entries of sampleSize bytes. Every entry is what the payload
+ * of a frame of sampleType(FRAME_TO_PHAWD or FRAME_TO_PHAWD_SAMPLE) would be, with its own timestamp, so the receiver
+ * gets every control cycle although they arrive together.
+ */
+struct PHAWD_DLLAPI SocketBatchHeader {
+    unsigned int numSamples;
+    unsigned int sampleSize;
+    unsigned short sampleType;      // SocketFrameType of the entries
+    unsigned short reserved;
+    unsigned int reserved2;
+};
+static_assert(sizeof(SocketBatchHeader) == 16, "SocketBatchHeader is sent over socket, keep it stable");
+
+//!< number, names and kinds of the waveform parameters are the same, values aren't compared
+PHAWD_DLLAPI bool sameWaveSchema(const SocketToPhawd *a, const SocketToPhawd *b);
+
+//!< append the schema of data to frame, units[i] belongs to the i-th waveform parameter and may be missing
+PHAWD_DLLAPI void encodeWaveSchema(SocketToPhawd *data, const std::vector<std::string> &units,
+                                   unsigned int schema_id, std::vector<char> &frame);
+
+/*!
+ * Set number, names and kinds of the waveform parameters in data from the payload of a FRAME_WAVE_SCHEMA,
+ * values are reset until the next sample.
+ * @param max_params : parameters data has room for
+ * @return false if the schema is malformed or too large, data is unchanged then
+ */
+PHAWD_DLLAPI bool applyWaveSchema(SocketToPhawd *data, size_t max_params, const char *payload, size_t length,
+                                  unsigned int &schema_id, std::vector<std::string> &units);
+
+//!< append the values of data to frame, the kinds must be the ones of the schema last sent
+PHAWD_DLLAPI void encodeWaveSample(const SocketToPhawd *data, unsigned int schema_id, std::vector<char> &frame);
+
+/*!
+ * Write the values of a FRAME_TO_PHAWD_SAMPLE into data, which holds the schema set by applyWaveSchema()
+ * @return false if the sample is malformed or belongs to another schema, data is unchanged then
+ */
+PHAWD_DLLAPI bool applyWaveSample(SocketToPhawd *data, unsigned int schema_id, const char *payload, size_t length);
+}
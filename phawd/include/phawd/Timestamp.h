@@ -0,0 +1,23 @@
+/*!
+ * PHAWD - Parameters Handler and Waveform Display
+ * Licensed under the GNU GPLv3 license. See LICENSE for more details.
+ * @author HuNing-He
+ * @date 2026-10-16
+ * @version 0.3
+ * @email 2689112371@qq.com
+ * @copyright (c) 2022 HuNing-He
+ * @file Timestamp.h
+ * @brief monotonic timestamps of published waveform samples
+ */
+
+#pragma once
+#include "phawd/phawd_config.h"
+
+namespace phawd {
+/*!
+ * Nanoseconds of a monotonic clock(CLOCK_MONOTONIC on linux, QueryPerformanceCounter on windows).
+ * It is not affected by changes of the system time, so the difference of two timestamps taken by the robot program
+ * is its real loop period. The origin is arbitrary, never compare timestamps taken on different machines.
+ */
+PHAWD_DLLAPI long long getTimestamp();
+}
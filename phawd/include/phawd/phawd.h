@@ -13,7 +13,11 @@
 #ifndef PHAWD_H
 #define PHAWD_H
 #include "phawd/SocketConnect.h"
+#include "phawd/AsyncSocketConnect.h"
+#include "phawd/SocketFrame.h"
 #include "phawd/SharedMemory.h"
 #include "phawd/SharedParameter.h"
+#include "phawd/SampleRing.h"
+#include "phawd/Timestamp.h"
 
 #endif // PHAWD_H
@@ -0,0 +1,360 @@
+/*!
+ * PHAWD - Parameters Handler and Waveform Display
+ * Licensed under the GNU GPLv3 license. See LICENSE for more details.
+ * @author HuNing-He
+ * @date 2026-10-16
+ * @version 0.3
+ * @email 2689112371@qq.com
+ * @copyright (c) 2022 HuNing-He
+ * @file AsyncSocketConnect.cpp
+ * @brief socket client whose sends and reads are done by a background I/O thread
+ */
+
+#include <cerrno>
+#include <cstring>
+#include "phawd/AsyncSocketConnect.h"
+#include "phawd/SharedParameter.h"
+#include "phawd/Timestamp.h"
+#if __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+using namespace phawd;
+
+//!< set in MessageMailbox::m_middle while the slot handed over hasn't been taken by the consumer
+constexpr unsigned int MAILBOX_FRESH = 4;
+
+//!< slots are cache line aligned, so that the producer and the consumer don't write the same line
+static size_t slotSize(size_t size) {
+    return (size + 63) & ~(size_t)63;
+}
+
+void MessageMailbox::init(size_t size) {
+    m_slotSize = slotSize(size);
+    m_slots.assign(3 * m_slotSize, 0);
+    m_middle.store(0, std::memory_order_relaxed);
+    m_back = 1;
+    m_front = 2;
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+char *MessageMailbox::writeBuffer() {
+    return m_slots.data() + m_back * m_slotSize;
+}
+
+void MessageMailbox::publish() {
+    // the written slot becomes the middle one, the producer goes on with the one the consumer gave back or didn't take
+    m_back = m_middle.exchange(m_back | MAILBOX_FRESH, std::memory_order_acq_rel) & ~MAILBOX_FRESH;
+}
+
+bool MessageMailbox::fetch() {
+    if (!(m_middle.load(std::memory_order_relaxed) & MAILBOX_FRESH)) {
+        return false;
+    }
+    m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & ~MAILBOX_FRESH;
+    return true;
+}
+
+const char *MessageMailbox::readBuffer() const {
+    return m_slots.data() + m_front * m_slotSize;
+}
+
+void MessageQueue::init(size_t size, size_t capacity) {
+    m_slotSize = slotSize(size);
+    m_capacity = capacity;
+    m_slots.assign(m_capacity * m_slotSize, 0);
+    m_head.store(0, std::memory_order_relaxed);
+    m_tail.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+char *MessageQueue::reserve() {
+    unsigned long long head = m_head.load(std::memory_order_relaxed);
+    if (m_capacity == 0 || head - m_tail.load(std::memory_order_acquire) >= m_capacity) {
+        return nullptr;
+    }
+    return m_slots.data() + (head % m_capacity) * m_slotSize;
+}
+
+void MessageQueue::commit() {
+    m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+const char *MessageQueue::front() {
+    unsigned long long tail = m_tail.load(std::memory_order_relaxed);
+    if (m_head.load(std::memory_order_acquire) == tail) {
+        return nullptr;
+    }
+    return m_slots.data() + (tail % m_capacity) * m_slotSize;
+}
+
+void MessageQueue::pop() {
+    m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+size_t MessageQueue::pending() const {
+    return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+}
+
+/*!
+ * Waveform data is stamped when the control loop queues it, the I/O thread may send it a period later.
+ * Other kinds of data carry no timestamp.
+ */
+static void stampTimestamp(SocketToPhawd *data) {
+    data->timestamp = getTimestamp();
+}
+
+template<typename T>
+static void stampTimestamp(T *data) {}
+
+template<typename SendData, typename ReadData>
+AsyncSocketConnect<SendData, ReadData>::~AsyncSocketConnect() {
+    Close();
+}
+
+template<typename SendData, typename ReadData>
+void AsyncSocketConnect<SendData, ReadData>::Init(size_t sendSize, size_t readSize, size_t queueLength) {
+    if (sendSize <= 0 || readSize <= 0 || queueLength <= 0) {
+        printf("[ERROR] AsyncSocketConnect::Init() error, please input positive sendSize, readSize and queueLength!\n");
+        return;
+    }
+    _socket.Init(sendSize, readSize);
+    _socket.setStampTimestamp(false);
+    _sendSize = sendSize;
+    _readSize = readSize;
+    free(_sendData);
+    _sendData = (SendData *)calloc(1, _sendSize);
+    _outgoing.init(_sendSize, queueLength);
+    _incoming.init(_readSize);
+    _dropped.store(0, std::memory_order_relaxed);
+}
+
+template<typename SendData, typename ReadData>
+SocketConnect<SendData, ReadData> &AsyncSocketConnect<SendData, ReadData>::getSocket() {
+    return _socket;
+}
+
+#if _WIN32
+template<typename SendData, typename ReadData>
+void AsyncSocketConnect<SendData, ReadData>::Start(long long period_us) {
+    printf("[ERROR] AsyncSocketConnect::Start(): epoll is not supported on windows!\n");
+    throw std::runtime_error("[ERROR] AsyncSocketConnect::Start(): epoll is not supported on windows!");
+}
+
+template<typename SendData, typename ReadData>
+void AsyncSocketConnect<SendData, ReadData>::closeDescriptors() {}
+
+template<typename SendData, typename ReadData>
+void AsyncSocketConnect<SendData, ReadData>::ioLoop() {}
+
+#elif __linux__
+template<typename SendData, typename ReadData>
+void AsyncSocketConnect<SendData, ReadData>::Start(long long period_us) {
+    if (_sendData == nullptr) {
+        printf("[ERROR] AsyncSocketConnect::Start() failed, Init first!\n");
+        throw std::runtime_error("[ERROR] AsyncSocketConnect::Start() failed, Init first!");
+    }
+    if (_running.load(std::memory_order_acquire)) {
+        return;
+    }
+    int fd = _socket.getDescriptor();
+    if (fd <= 0 || period_us <= 0) {
+        printf("[ERROR] AsyncSocketConnect::Start(): connect first and use a positive period!\n");
+        throw std::runtime_error("[ERROR] AsyncSocketConnect::Start(): connect first and use a positive period!");
+    }
+    _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    _timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    _wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    itimerspec period{};
+    period.it_interval.tv_sec = period_us / 1000000;
+    period.it_interval.tv_nsec = (period_us % 1000000) * 1000;
+    period.it_value = period.it_interval;
+    epoll_event timerEvent{};
+    timerEvent.events = EPOLLIN;
+    timerEvent.data.fd = _timer_fd;
+    epoll_event wakeEvent{};
+    wakeEvent.events = EPOLLIN;
+    wakeEvent.data.fd = _wake_fd;
+    // a server closing the connection reports EPOLLRDHUP, so the I/O thread doesn't spin on a dead socket
+    epoll_event socketEvent{};
+    socketEvent.events = EPOLLIN | EPOLLRDHUP;
+    socketEvent.data.fd = fd;
+    if (_epoll_fd < 0 || _timer_fd < 0 || _wake_fd < 0 || timerfd_settime(_timer_fd, 0, &period, nullptr) != 0 ||
+        epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _timer_fd, &timerEvent) != 0 ||
+        epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _wake_fd, &wakeEvent) != 0 ||
+        epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &socketEvent) != 0) {
+        closeDescriptors();
+        printf("[ERROR] AsyncSocketConnect::Start(): create epoll, timer or eventfd failed!\n");
+        throw std::runtime_error("[ERROR] AsyncSocketConnect::Start(): create epoll, timer or eventfd failed!");
+    }
+    _connected.store(true, std::memory_order_release);
+    _running.store(true, std::memory_order_release);
+    _ioThread = std::thread(&AsyncSocketConnect::ioLoop, this);
+}
+
+template<typename SendData, typename ReadData>
+void AsyncSocketConnect<SendData, ReadData>::closeDescriptors() {
+    int fds[3] = {_epoll_fd, _timer_fd, _wake_fd};
+    for (int fd : fds) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    _epoll_fd = -1;
+    _timer_fd = -1;
+    _wake_fd = -1;
+}
+
+template<typename SendData, typename ReadData>
+void AsyncSocketConnect<SendData, ReadData>::ioLoop() {
+    int fd = _socket.getDescriptor();
+    bool watching = true;   // fd is in the epoll set
+    bool lost = false;      // the server is gone and the socket doesn't connect again
+    epoll_event events[3];
+    while (_running.load(std::memory_order_acquire)) {
+        int count = epoll_wait(_epoll_fd, events, 3, -1);
+        if (count < 0 && errno != EINTR) {
+            printf("[ERROR] AsyncSocketConnect: epoll_wait failed, the I/O thread stops!\n");
+            break;
+        }
+        bool readable = false;
+        bool closed = false;
+        for (int i = 0; i < count; ++i) {
+            if (events[i].data.fd == _timer_fd || events[i].data.fd == _wake_fd) {
+                unsigned long long expirations;
+                ssize_t ret = read(events[i].data.fd, &expirations, sizeof(expirations));
+                (void) ret;
+            } else {
+                readable = true;
+                closed = closed || (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0;
+            }
+        }
+        if (!lost) {
+            sendQueued();
+        } else {
+            // nothing can be sent anymore, drop what the control loop queues so that the queue doesn't stay full
+            while (_outgoing.front() != nullptr) {
+                _outgoing.pop();
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        // while a socket with SocketConnect::setReconnect() is connecting again, every wake up takes a step of it
+        if ((readable || !watching) && !lost && _socket.Read() > 0) {
+            memcpy(_incoming.writeBuffer(), _socket.getRead(), _readSize);
+            _incoming.publish();
+        }
+        if (closed && _socket.isConnected()) {
+            // the socket stays readable once the server is gone, stop watching it
+            epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+            watching = false;
+            lost = true;
+            printf("[AsyncSocketConnect] The server closed the connection\n");
+        }
+        if (!lost && watching && !_socket.isConnected()) {
+            // SocketConnect closed the broken socket, which also took it out of the epoll set
+            watching = false;
+        } else if (!lost && !watching && _socket.isConnected()) {
+            fd = _socket.getDescriptor();
+            epoll_event socketEvent{};
+            socketEvent.events = EPOLLIN | EPOLLRDHUP;
+            socketEvent.data.fd = fd;
+            watching = epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &socketEvent) == 0;
+        }
+        _connected.store(!lost && _socket.isConnected(), std::memory_order_release);
+    }
+}
+#endif
+
+template<typename SendData, typename ReadData>
+void AsyncSocketConnect<SendData, ReadData>::sendQueued() {
+    // in the order the control loop produced them, SocketConnect keeps them in order and batches them if asked to
+    const char *message;
+    while ((message = _outgoing.front()) != nullptr) {
+        // the message is raw bytes of a SendData of _sendSize, with its parameters behind it
+        memcpy(static_cast<void *>(_socket.getSend()), message, _sendSize);
+        _outgoing.pop();
+        if (_socket.SendBatched() < 0) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+template<typename SendData, typename ReadData>
+int AsyncSocketConnect<SendData, ReadData>::Send() {
+    if (_sendData == nullptr) {
+        printf("[ERROR] AsyncSocketConnect::Send() failed, Init first \n");
+        return -1;
+    }
+    stampTimestamp(_sendData);
+    char *slot = _outgoing.reserve();
+    if (slot == nullptr) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return -1;
+    }
+    memcpy(slot, _sendData, _sendSize);
+    _outgoing.commit();
+    return (int)_sendSize;
+}
+
+template<typename SendData, typename ReadData>
+int AsyncSocketConnect<SendData, ReadData>::Read() {
+    if (_readSize <= 0 || !_incoming.fetch()) {
+        return -1;
+    }
+    return (int)_readSize;
+}
+
+template<typename SendData, typename ReadData>
+bool AsyncSocketConnect<SendData, ReadData>::isConnected() const {
+    return _connected.load(std::memory_order_acquire);
+}
+
+template<typename SendData, typename ReadData>
+unsigned long long AsyncSocketConnect<SendData, ReadData>::dropped() const {
+    return _dropped.load(std::memory_order_relaxed);
+}
+
+template<typename SendData, typename ReadData>
+void AsyncSocketConnect<SendData, ReadData>::Close() {
+#if __linux__
+    if (_running.exchange(false, std::memory_order_acq_rel)) {
+        unsigned long long one = 1;
+        ssize_t ret = write(_wake_fd, &one, sizeof(one));
+        (void) ret;
+    }
+    if (_ioThread.joinable()) {
+        _ioThread.join();
+    }
+    // the I/O thread is gone, what the control loop queued last goes out from here
+    if (_connected.exchange(false, std::memory_order_acq_rel)) {
+        sendQueued();
+        _socket.FlushBatch();
+    }
+    closeDescriptors();
+#endif
+    if (_sendData != nullptr) {
+        _socket.Close();
+        free(_sendData);
+        _sendData = nullptr;
+    }
+}
+
+template<typename SendData, typename ReadData>
+SendData *AsyncSocketConnect<SendData, ReadData>::getSend() {
+    if (_sendData == nullptr) {
+        printf("[ERROR] AsyncSocketConnect::getSend() failed, Init first!\n");
+        throw std::runtime_error("[ERROR] AsyncSocketConnect::getSend() failed, Init first!");
+    }
+    return _sendData;
+}
+
+template<typename SendData, typename ReadData>
+ReadData *AsyncSocketConnect<SendData, ReadData>::getRead() {
+    if (_readSize <= 0) {
+        throw std::runtime_error("Init first!");
+    }
+    return (ReadData *)_incoming.readBuffer();
+}
+
+template class phawd::AsyncSocketConnect<SocketToPhawd, SocketFromPhawd>;
@@ -14,14 +14,6 @@
 #include <algorithm>
 using namespace phawd;
 
-/*!
- * Check if the unordered map contain the given element
- */
-template<typename T1, typename T2>
-bool mapContains(const std::map<T1, T2> &set, T1 key) {
-    return set.find(key) != set.end();
-}
-
 void ParameterValue::init() {
     d = 0;
     std::memset(this, 0, sizeof(ParameterValue));
@@ -44,6 +36,10 @@ std::string phawd::ParameterKindToString(phawd::ParameterKind kind) {
             return {"VEC3_FLOAT"};
         case ParameterKind::VEC3_DOUBLE:
             return {"VEC3_DOUBLE"};
+        case ParameterKind::VECN_DOUBLE:
+            return {"VECN_DOUBLE"};
+        case ParameterKind::MATRIX_DOUBLE:
+            return {"MATRIX_DOUBLE"};
         default:
             return {};
     }
@@ -55,6 +51,8 @@ ParameterKind phawd::getParameterKindFromString(const std::string& str){
     if(str == "S64") return ParameterKind::S64;
     if(str == "VEC3_FLOAT") return ParameterKind::VEC3_FLOAT;
     if(str == "VEC3_DOUBLE") return ParameterKind::VEC3_DOUBLE;
+    if(str == "VECN_DOUBLE") return ParameterKind::VECN_DOUBLE;
+    if(str == "MATRIX_DOUBLE") return ParameterKind::MATRIX_DOUBLE;
     return ParameterKind::DOUBLE;
 }
 
@@ -140,73 +138,171 @@ Parameter::Parameter(const std::string& name, const std::vector<float>& value) :
     m_kind = ParameterKind::VEC3_FLOAT;
 }
 
+/*!
+ * Sequence lock, writer side. m_seq is odd while the parameter is being modified.
+ * The release fence keeps the modification from being reordered before the odd sequence is visible.
+ */
+void Parameter::writeBegin() {
+    m_seq.store(m_seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void Parameter::writeEnd() {
+    m_seq.store(m_seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+bool Parameter::isStale() const {
+    return (m_seq.load(std::memory_order_acquire) & 1u) != 0;
+}
+
+void Parameter::writeValue(ParameterKind kind, const ParameterValue& value) {
+    writeBegin();
+    m_kind = kind;
+    std::memcpy(&m_value, &value, sizeof(ParameterValue));
+    m_set = true;
+    writeEnd();
+}
+
+ParameterKind Parameter::readValue(ParameterValue& value) const {
+    unsigned int seq;
+    ParameterKind kind;
+    do {
+        seq = readBegin();
+        kind = m_kind;
+        std::memcpy(&value, &m_value, sizeof(ParameterValue));
+    } while (readRetry(seq));
+    return kind;
+}
+
+void Parameter::writeArray(double *arena, unsigned int offset, unsigned int rows, unsigned int cols,
+                           const double *values) {
+    writeBegin();
+    m_kind = cols == 1 ? ParameterKind::VECN_DOUBLE : ParameterKind::MATRIX_DOUBLE;
+    m_value.array.offset = offset;
+    m_value.array.rows = rows;
+    m_value.array.cols = cols;
+    std::memcpy(arena + offset, values, (size_t)rows * cols * sizeof(double));
+    m_set = true;
+    writeEnd();
+}
+
+ParameterKind Parameter::readArray(const double *arena, size_t arena_size, ParameterValue& value, double *values,
+                                   size_t capacity) const {
+    unsigned int seq;
+    ParameterKind kind;
+    do {
+        seq = readBegin();
+        kind = m_kind;
+        std::memcpy(&value, &m_value, sizeof(ParameterValue));
+        if (kind == ParameterKind::VECN_DOUBLE || kind == ParameterKind::MATRIX_DOUBLE) {
+            // a torn read may see any offset and size, it is retried but must not read outside of the arena
+            size_t count = std::min((size_t)value.array.rows * value.array.cols, capacity);
+            if (value.array.offset <= arena_size && count <= arena_size - value.array.offset) {
+                std::memcpy(values, arena + value.array.offset, count * sizeof(double));
+            }
+        }
+    } while (readRetry(seq));
+    return kind;
+}
+
 void Parameter::setValueKind(ParameterKind kind) {
+    writeBegin();
     m_kind = kind;
+    writeEnd();
 }
 
-ParameterKind Parameter::getValueKind() {
-    return m_kind;
+ParameterKind Parameter::getValueKind() const {
+    unsigned int seq;
+    ParameterKind kind;
+    do {
+        seq = readBegin();
+        kind = m_kind;
+    } while (readRetry(seq));
+    return kind;
 }
 
 void Parameter::setValue(float value) {
+    writeBegin();
     m_kind = ParameterKind::FLOAT;
     m_value.f = value;
     m_set = true;
+    writeEnd();
 }
 
 void Parameter::setValue(double value){
+    writeBegin();
     m_kind = ParameterKind::DOUBLE;
     m_value.d = value;
     m_set = true;
+    writeEnd();
 }
 
 void Parameter::setValue(long int value){
+    writeBegin();
     m_kind = ParameterKind::S64;
     m_value.i = value;
     m_set = true;
+    writeEnd();
 }
 
 void Parameter::setValue(const double* value) {
     if(value == nullptr) return;
+    writeBegin();
     for (int j = 0; j < 3; ++j) {
         m_value.vec3d[j] = value[j];
     }
     m_kind = ParameterKind::VEC3_DOUBLE;
     m_set = true;
+    writeEnd();
 }
 
 void Parameter::setValue(const float* value) {
     if(value == nullptr) return;
+    writeBegin();
     for (int j = 0; j < 3; ++j) {
         m_value.vec3f[j] = value[j];
     }
     m_kind = ParameterKind::VEC3_FLOAT;
     m_set = true;
+    writeEnd();
+}
+
+void Parameter::setValue(const std::array<double, 3>& value) {
+    setValue(value.data());
+}
+
+void Parameter::setValue(const std::array<float, 3>& value) {
+    setValue(value.data());
 }
 
 void Parameter::setValue(const std::vector<double>& value) {
     auto range = value.size() > 3? 3 : value.size();
+    writeBegin();
     for (size_t j = 0; j < range; ++j) {
         m_value.vec3d[j] = value[j];
     }
     m_kind = ParameterKind::VEC3_DOUBLE;
     m_set = true;
+    writeEnd();
 }
 
 void Parameter::setValue(const std::vector<float>& value) {
     auto range = value.size() > 3? 3 : value.size();
+    writeBegin();
     for (size_t j = 0; j < range; ++j) {
         m_value.vec3f[j] = value[j];
     }
     m_kind = ParameterKind::VEC3_FLOAT;
     m_set = true;
+    writeEnd();
 }
 
 void Parameter::setValue(ParameterKind kind, const ParameterValue& value) {
-    if(m_kind != kind) {
+    if(getValueKind() != kind) {
         printf("[ERROR] Parameter::setValue(), The parameter type is different with setting type.");
         throw std::runtime_error("[ERROR] Parameter::setValue(), The parameter type is different with setting type.");
     }
+    writeBegin();
     switch(m_kind) {
         case ParameterKind::FLOAT:
             m_value.f = value.f;
@@ -229,9 +325,12 @@ void Parameter::setValue(ParameterKind kind, const ParameterValue& value) {
             }
             break;
         }
-        default:return;
+        default:
+            writeEnd();
+            return;
     }
     m_set = true;
+    writeEnd();
 }
 
 /*!
@@ -240,32 +339,33 @@ void Parameter::setValue(ParameterKind kind, const ParameterValue& value) {
 * @param kind : the kind of the  parameter
 * @return the value of the  parameter
 */
-ParameterValue Parameter::getValue(ParameterKind kind) {
-    ParameterValue value;
-    if (kind != m_kind) {
+ParameterValue Parameter::getValue(ParameterKind kind) const {
+    ParameterValue value, current;
+    ParameterKind currentKind = readValue(current);
+    if (kind != currentKind) {
         printf("[ERROR] Parameter::getValue(), The parameter type is different with getting type.");
         throw std::runtime_error("[ERROR] Parameter::getValue(), The parameter type is different with getting type.");
     }
-    switch (m_kind) {
+    switch (currentKind) {
         case ParameterKind::FLOAT:
-            value.f = m_value.f;
+            value.f = current.f;
             break;
         case ParameterKind::DOUBLE:
-            value.d = m_value.d;
+            value.d = current.d;
             break;
         case ParameterKind::S64:
-            value.i = m_value.i;
+            value.i = current.i;
             break;
         case ParameterKind::VEC3_FLOAT:{
-            value.vec3f[0] = m_value.vec3f[0];
-            value.vec3f[1] = m_value.vec3f[1];
-            value.vec3f[2] = m_value.vec3f[2];
+            value.vec3f[0] = current.vec3f[0];
+            value.vec3f[1] = current.vec3f[1];
+            value.vec3f[2] = current.vec3f[2];
             break;
         }
         case ParameterKind::VEC3_DOUBLE:{
-            value.vec3d[0] = m_value.vec3d[0];
-            value.vec3d[1] = m_value.vec3d[1];
-            value.vec3d[2] = m_value.vec3d[2];
+            value.vec3d[0] = current.vec3d[0];
+            value.vec3d[1] = current.vec3d[1];
+            value.vec3d[2] = current.vec3d[2];
             break;
         }
         default:{
@@ -292,7 +392,7 @@ T Parameter::getValue() {
         return {m_value.vec3f[0], m_value.vec3f[1], m_value.vec3f[2]};
     }
     if (std::is_same<T, std::vector<float>>::value && m_kind == ParameterKind::VEC3_DOUBLE){
-        return {m_value.vec3d[0], m_value.vec3d[1], m_value.vec3d[2]};
+        return {value.vec3d[0], value.vec3d[1], value.vec3d[2]};
     }
     if(std::is_same<T, float*>::value && m_kind == ParameterKind::VEC3_FLOAT){
         static float result[3] = {0, 0, 0};
@@ -313,31 +413,34 @@ T Parameter::getValue() {
 }
 */
 
-double Parameter::getDouble() {
-    if (m_kind != ParameterKind::DOUBLE){
+double Parameter::getDouble() const {
+    ParameterValue value;
+    if (readValue(value) != ParameterKind::DOUBLE){
         printf("[ERROR]: Try to use getDouble() for parameter(%s) "
                "that is not of type DOUBLE", m_name);
         throw std::runtime_error("Parameter::getDouble(): type error");
     }
-    return m_value.d;
+    return value.d;
 }
 
-float Parameter::getFloat() {
-    if (m_kind != ParameterKind::FLOAT){
+float Parameter::getFloat() const {
+    ParameterValue value;
+    if (readValue(value) != ParameterKind::FLOAT){
         printf("[ERROR]: Try to use getFloat() for parameter(%s) "
                "that is not of type FLOAT", m_name);
         throw std::runtime_error("Parameter::getDouble(): type error");
     }
-    return m_value.f;
+    return value.f;
 }
 
-long int Parameter::getS64(){
-    if (m_kind != ParameterKind::S64){
+long int Parameter::getS64() const {
+    ParameterValue value;
+    if (readValue(value) != ParameterKind::S64){
         printf("[ERROR]: Try to use getS64() for parameter(%s) "
                "that is not of type S64", m_name);
         throw std::runtime_error("Parameter::getS64(): type error");
     }
-    return m_value.i;
+    return value.i;
 }
 
 bool Parameter::setName(const std::string& name) {
@@ -345,49 +448,88 @@ bool Parameter::setName(const std::string& name) {
         printf("[Parameter]: The parameter name size is invalid when construct it. should be in range[1, 16]");
         return false;
     } else {
-        strcpy(m_name, name.c_str());
+        writeBegin();
+        std::memset(m_name, 0, sizeof(m_name));
+        std::memcpy(m_name, name.c_str(), name.length());
+        writeEnd();
         return true;
     }
 }
 
-std::string Parameter::getName() {
-    return m_name;
+std::string Parameter::getName() const {
+    char name[sizeof(m_name) + 1] = {};
+    unsigned int seq;
+    do {
+        seq = readBegin();
+        std::memcpy(name, m_name, sizeof(m_name));
+    } while (readRetry(seq));
+    return name;
+}
+
+bool Parameter::sameName(const Parameter &p) const {
+    char name[sizeof(m_name)], other[sizeof(m_name)];
+    unsigned int seq;
+    do {
+        seq = readBegin();
+        std::memcpy(name, m_name, sizeof(m_name));
+    } while (readRetry(seq));
+    do {
+        seq = p.readBegin();
+        std::memcpy(other, p.m_name, sizeof(m_name));
+    } while (p.readRetry(seq));
+    return std::memcmp(name, other, sizeof(m_name)) == 0;
+}
+
+std::vector<double> Parameter::getVec3d() const {
+    std::array<double, 3> value{};
+    getVec3d(value);
+    return {value[0], value[1], value[2]};
 }
 
-std::vector<double> Parameter::getVec3d() {
-    if (m_kind != ParameterKind::VEC3_DOUBLE){
+std::vector<float> Parameter::getVec3f() const {
+    std::array<float, 3> value{};
+    getVec3f(value);
+    return {value[0], value[1], value[2]};
+}
+
+void Parameter::getVec3d(std::array<double, 3>& value) const {
+    ParameterValue current;
+    if (readValue(current) != ParameterKind::VEC3_DOUBLE){
         printf("[ERROR]: Try to use getVec3d() for parameter(%s) "
                "that is not of type VEC3_DOUBLE", m_name);
         throw std::runtime_error("Parameter::getVec3d(): type error");
     }
-    return {m_value.vec3d[0], m_value.vec3d[1], m_value.vec3d[2]};
+    std::memcpy(value.data(), current.vec3d, sizeof(current.vec3d));
 }
 
-std::vector<float> Parameter::getVec3f() {
-    if (m_kind != ParameterKind::VEC3_FLOAT){
+void Parameter::getVec3f(std::array<float, 3>& value) const {
+    ParameterValue current;
+    if (readValue(current) != ParameterKind::VEC3_FLOAT){
         printf("[ERROR]: Try to use getVec3f() for parameter(%s) "
                "that is not of type VEC3_FLOAT", m_name);
         throw std::runtime_error("Parameter::getVec3f(): type error");
     }
-    return {m_value.vec3f[0], m_value.vec3f[1], m_value.vec3f[2]};
+    std::memcpy(value.data(), current.vec3f, sizeof(current.vec3f));
 }
 
-double Parameter::getFromVec3dByIndex(int idx) {
-    if (m_kind != ParameterKind::VEC3_DOUBLE || idx < 0){
+double Parameter::getFromVec3dByIndex(int idx) const {
+    ParameterValue value;
+    if (readValue(value) != ParameterKind::VEC3_DOUBLE || idx < 0 || idx > 2){
         printf("[ERROR]: Try to use getFromVec3dByIndex() for parameter(%s) "
                "that is not of type VEC3_DOUBLE", m_name);
         throw std::runtime_error("Parameter::getFromVec3dByIndex(): type error or index negative");
     }
-    return m_value.vec3d[idx];
+    return value.vec3d[idx];
 }
 
-float Parameter::getFromVec3fByIndex(int idx) {
-    if (m_kind != ParameterKind::VEC3_FLOAT || idx < 0){
+float Parameter::getFromVec3fByIndex(int idx) const {
+    ParameterValue value;
+    if (readValue(value) != ParameterKind::VEC3_FLOAT || idx < 0 || idx > 2){
         printf("[ERROR]: Try to use getFromVec3fByIndex() for parameter(%s) "
                "that is not of type VEC3_FLOAT", m_name);
         throw std::runtime_error("Parameter::getFromVec3fByIndex(): type error or index negative");
     }
-    return m_value.vec3f[idx];
+    return value.vec3f[idx];
 }
 
 Parameter::Parameter(const Parameter &parameter) : Parameter() {
@@ -400,21 +542,31 @@ Parameter::Parameter(Parameter &&parameter) noexcept : Parameter() {
 
 Parameter &Parameter::operator=(const Parameter &parameter) {
     if (this != &parameter) {
-        m_set = parameter.m_set;
-        m_kind = parameter.m_kind;
-        std::memcpy(m_name, parameter.m_name, sizeof(m_name));
-        std::memcpy(&m_value, &parameter.m_value, sizeof(ParameterValue));
+        bool set;
+        char name[sizeof(m_name)];
+        ParameterKind kind;
+        ParameterValue value;
+        unsigned int seq;
+        do {
+            seq = parameter.readBegin();
+            set = parameter.m_set;
+            kind = parameter.m_kind;
+            std::memcpy(name, parameter.m_name, sizeof(m_name));
+            std::memcpy(&value, &parameter.m_value, sizeof(ParameterValue));
+        } while (parameter.readRetry(seq));
+
+        writeBegin();
+        m_set = set;
+        m_kind = kind;
+        std::memcpy(m_name, name, sizeof(m_name));
+        std::memcpy(&m_value, &value, sizeof(ParameterValue));
+        writeEnd();
     }
     return *this;
 }
 
 Parameter &Parameter::operator=(Parameter &&parameter) noexcept{
-    if (this != &parameter) {
-        m_set = parameter.m_set;
-        m_kind = parameter.m_kind;
-        std::memcpy(m_name, parameter.m_name, sizeof(m_name));
-        std::memcpy(&m_value, &parameter.m_value, sizeof(ParameterValue));
-    }
+    *this = static_cast<const Parameter&>(parameter);
     return *this;
 }
 
@@ -426,35 +578,88 @@ void Parameter::set(bool set){
     m_set = set;
 }
 
+/*!
+ * FNV-1a over the whole zero padded name, names differing only in their last characters still spread
+ */
+size_t ParameterCollection::hashName(const char *name) {
+    unsigned long long hash = 14695981039346656037ull;
+    for (size_t i = 0; i < sizeof(Entry::name); ++i) {
+        hash = (hash ^ (unsigned char)name[i]) * 1099511628211ull;
+    }
+    return (size_t)(hash ^ (hash >> 32));
+}
+
 void ParameterCollection::addParameter(Parameter* param) {
-    std::string name = param->getName();
-    if (mapContains(m_map, name)) {
-        // printf("[ERROR] ParameterCollection %s: tried to add parameter %s twice!\n", m_name.c_str(), name.c_str());
-        return;
+    m_parameters.push_back(param);
+    m_built = false;
+}
+
+void ParameterCollection::build() {
+    size_t slots = 16;
+    while (slots < 2 * m_parameters.size()) {
+        slots *= 2;
+    }
+    m_index.assign(slots, Entry{});
+    size_t mask = slots - 1;
+    size_t count = 0;
+    for (Parameter *param : m_parameters) {
+        Entry entry{};
+        std::string name = param->getName();
+        std::memcpy(entry.name, name.data(), std::min(name.size(), sizeof(entry.name)));
+        entry.parameter = param;
+        size_t i = hashName(entry.name) & mask;
+        while (m_index[i].parameter != nullptr && std::memcmp(m_index[i].name, entry.name, sizeof(entry.name)) != 0) {
+            i = (i + 1) & mask;
+        }
+        if (m_index[i].parameter != nullptr) {
+            // printf("[ERROR] ParameterCollection %s: tried to add parameter %s twice!\n", m_name.c_str(), name.c_str());
+            continue;
+        }
+        m_index[i] = entry;
+        m_parameters[count++] = param;
     }
-    m_map[name] = param;
+    m_parameters.resize(count);
+    m_built = true;
 }
 
 Parameter& ParameterCollection::lookup(const std::string& name) {
-    if(mapContains(m_map, name)){
-        return *m_map[name];
-    } else {
-        printf("[ERROR]: ParameterCollection::lookup() error"
-               "Parameter named: %s not found", name.c_str());
-        throw std::runtime_error(" parameter " + name + " wasn't found in parameter collection " + m_name);
+    // building here would write m_index in what callers take for a read, e.g. from several control threads
+    if (!m_built) {
+        printf("[ERROR]: ParameterCollection::lookup() error, parameters were added to collection %s after build()\n",
+               m_name.c_str());
+        throw std::runtime_error("ParameterCollection::lookup(): call build() after addParameter()");
+    }
+    if (name.size() <= sizeof(Entry::name) && !m_index.empty()) {
+        char key[sizeof(Entry::name)] = {};
+        std::memcpy(key, name.data(), name.size());
+        size_t mask = m_index.size() - 1;
+        for (size_t i = hashName(key) & mask; m_index[i].parameter != nullptr; i = (i + 1) & mask) {
+            if (std::memcmp(m_index[i].name, key, sizeof(key)) == 0) {
+                return *m_index[i].parameter;
+            }
+        }
     }
+    printf("[ERROR]: ParameterCollection::lookup() error"
+           "Parameter named: %s not found", name.c_str());
+    throw std::runtime_error(" parameter " + name + " wasn't found in parameter collection " + m_name);
+}
+
+size_t ParameterCollection::size() const {
+    return m_parameters.size();
 }
 
 bool ParameterCollection::checkIfAllSet() {
-    return std::all_of(m_map.begin(), m_map.end(), [](const std::pair<std::string, Parameter*>& kv){return kv.second->isSet();});
+    return std::all_of(m_parameters.begin(), m_parameters.end(), [](Parameter *param){return param->isSet();});
 }
 
 void ParameterCollection::clearAllSet() {
-    for (auto& kv : m_map) {
-        kv.second->set(false);
+    for (Parameter *param : m_parameters) {
+        param->set(false);
     }
 }
 
 void ParameterCollection::clearAllParameters() {
-    m_map.clear();
+    m_parameters.clear();
+    m_index.clear();
+    m_built = true;
 }
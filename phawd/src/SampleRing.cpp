@@ -0,0 +1,69 @@
+/*!
+ * PHAWD - Parameters Handler and Waveform Display
+ * Licensed under the GNU GPLv3 license. See LICENSE for more details.
+ * @author HuNing-He
+ * @date 2026-10-16
+ * @version 0.3
+ * @email 2689112371@qq.com
+ * @copyright (c) 2022 HuNing-He
+ * @file SampleRing.cpp
+ */
+
+#include <cstddef>
+#include "phawd/SampleRing.h"
+using namespace phawd;
+
+size_t SampleRing::getSize(size_t capacity) {
+    size_t size = offsetof(SampleRing, m_samples) + capacity * sizeof(WaveSample);
+    return (size + 63) & ~(size_t)63;
+}
+
+void SampleRing::init(size_t capacity) {
+    m_head.store(0, std::memory_order_relaxed);
+    m_dropped.store(0, std::memory_order_relaxed);
+    m_tail.store(0, std::memory_order_relaxed);
+    m_capacity = capacity;
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+bool SampleRing::push(const ParameterValue &value, long long timestamp) {
+    unsigned long long head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) >= m_capacity) {
+        m_dropped.store(m_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return false;
+    }
+    WaveSample &sample = m_samples[head % m_capacity];
+    sample.timestamp = timestamp;
+    std::memcpy(&sample.value, &value, sizeof(ParameterValue));
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+size_t SampleRing::pop(WaveSample *samples, size_t maxCount) {
+    unsigned long long tail = m_tail.load(std::memory_order_relaxed);
+    unsigned long long count = m_head.load(std::memory_order_acquire) - tail;
+    if (count > maxCount) {
+        count = maxCount;
+    }
+    for (unsigned long long i = 0; i < count; ++i) {
+        std::memcpy(&samples[i], &m_samples[(tail + i) % m_capacity], sizeof(WaveSample));
+    }
+    m_tail.store(tail + count, std::memory_order_release);
+    return count;
+}
+
+void SampleRing::discard() {
+    m_tail.store(m_head.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+size_t SampleRing::capacity() const {
+    return m_capacity;
+}
+
+size_t SampleRing::pending() const {
+    return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+}
+
+unsigned long long SampleRing::dropped() const {
+    return m_dropped.load(std::memory_order_relaxed);
+}
@@ -10,6 +10,7 @@
  */
 
 #include <fcntl.h>
+#include <algorithm>
 #include <fstream>
 #include <sys/stat.h>
 
@@ -17,6 +18,8 @@
 #include "phawd/SharedParameter.h"
 #if __linux__
 #include <sys/mman.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
 #include "unistd.h"
 #elif _WIN32
 #include <share.h>
@@ -26,6 +29,28 @@ using namespace phawd;
 
 #if _WIN32
 
+namespace {
+/*!
+ * Windows counterpart of the real-time options, huge pages need SEC_LARGE_PAGES and a privilege and are not supported
+ */
+void applyOptions(void *mem, size_t size, unsigned int options, const std::string &name) {
+    if (options & SHM_HUGE_PAGES) {
+        printf("[Shared Memory] huge pages are not supported on windows, %s uses normal pages\n", name.c_str());
+    }
+    if (options & SHM_PREFAULT) {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        for (size_t offset = 0; offset < size; offset += info.dwPageSize) {
+            (void) ((volatile char *) mem)[offset];
+        }
+    }
+    if ((options & SHM_MLOCK) && !VirtualLock(mem, size)) {
+        printf("[Shared Memory] VirtualLock(%s) failed with error %lu, pages may be paged out\n",
+               name.c_str(), GetLastError());
+    }
+}
+}
+
 /*!
  * Allocate memory for the shared memory object and attach to it.
  * If allowOverwrite is true, and there's already an object with this name,
@@ -33,7 +58,7 @@ using namespace phawd;
  * initialized in a very weird state.
  */
 template<class T>
-void SharedMemory<T>::createNew(const std::string &name, size_t size, bool allowOverwrite) {
+void SharedMemory<T>::createNew(const std::string &name, size_t size, bool allowOverwrite, unsigned int options) {
     // Size should be an integer multiple of 4096, this automatically done by system
     if (size <= 0) {
         printf("[ERROR] SharedMemory::createNew: invalid size!");
@@ -123,6 +148,10 @@ void SharedMemory<T>::createNew(const std::string &name, size_t size, bool allow
     if (GetLastError() == ERROR_ACCESS_DENIED) {
         std::cout << GetLastError() << std::endl;
     }
+    _mappedSize = size;
+    _options = options;
+    _generation = 0;
+    applyOptions(shmBase, size, options, name);
     memset(shmBase, 0, size);
     _data = (T *)shmBase;
     CloseHandle(fileHandle);
@@ -137,11 +166,7 @@ void SharedMemory<T>::createNew(const std::string &name, size_t size, bool allow
  * Attach to an existing shared memory object.
  */
 template<class T>
-void SharedMemory<T>::attach(const std::string &name, size_t size) {
-    if (size <= 0) {
-        printf("[ERROR] SharedMemory::attach: invalid size!");
-        throw std::runtime_error("[ERROR] SharedMemory::attach: invalid size!");
-    }
+void SharedMemory<T>::attach(const std::string &name, size_t size, unsigned int options) {
     _size = size;
     if (name.length() == 0) {
         printf("[ERROR] SharedMemory::attach: name is NULL string!");
@@ -158,12 +183,34 @@ void SharedMemory<T>::attach(const std::string &name, size_t size) {
     // attention that MapViewOfFile treat FILE_MAP_ALL_ACCESS as FILE_MAP_WRITE
     void *shmBase =
             MapViewOfFile(_fileMapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (shmBase == nullptr) {
+        CloseHandle(_fileMapping);
+        _fileMapping = nullptr;
+        printf("[ERROR] SharedMemory::attach: MapViewOfFile failed!");
+        throw std::runtime_error("[ERROR] SharedMemory::attach: MapViewOfFile failed!");
+    }
+    if (_size == 0) {
+        // attach by name, the view covers the whole mapping
+        MEMORY_BASIC_INFORMATION info;
+        VirtualQuery(shmBase, &info, sizeof(info));
+        _size = info.RegionSize;
+    }
+    _mappedSize = _size;
+    _options = options;
+    applyOptions(shmBase, _size, options, name);
     _data = (T *)shmBase;
+    _attached = true;
+    try {
+        _data->checkHeader(_size);
+    } catch (std::runtime_error &err) {
+        detach();
+        throw;
+    }
+    _generation = _data->generation.load(std::memory_order_acquire);
     printf(
             "[Shared Memory] SharedMemory attach success(%s), map file to memory "
             "of size(%zu)\n",
-            name.c_str(), size);
-    _attached = true;
+            name.c_str(), _size);
 }
 /*!
  * Free memory associated with the current open shared memory object.  The
@@ -235,10 +282,129 @@ void SharedMemory<T>::detach() {
     _attached = false;
 }
 
+template<class T>
+void SharedMemory<T>::grow(size_t size) {
+    if (_data == nullptr) {
+        printf("[ERROR] SharedMemory::grow(): the shared memory doesn't exist!");
+        throw std::runtime_error("[ERROR] SharedMemory::grow(): the shared memory doesn't exist");
+    }
+    if (size <= _size) {
+        return;
+    }
+    // a file mapping can't be enlarged while it is mapped, and the views of other processes wouldn't follow
+    printf("[ERROR] SharedMemory::grow(%s): growing from %zu to %zu bytes is not supported on windows, "
+           "create a new one instead!", _name.c_str(), _size, size);
+    throw std::runtime_error("[ERROR] SharedMemory::grow(): not supported on windows!");
+}
+
+template<class T>
+bool SharedMemory<T>::updateMapping() {
+    unsigned int generation = get()->generation.load(std::memory_order_acquire);
+    if (generation == _generation || (generation & 1)) {
+        return false;
+    }
+    if (_data->totalSize > _size) {
+        printf("[ERROR] SharedMemory::updateMapping(%s): the segment has grown beyond the mapping!", _name.c_str());
+        throw std::runtime_error("[ERROR] SharedMemory::updateMapping(): the segment has grown beyond the mapping!");
+    }
+    _generation = generation;
+    return true;
+}
+
 #elif __linux__
 
+namespace {
+const char *hugePageDir = "/dev/hugepages/";
+
+std::string hugePagePath(const std::string &name) {
+    return hugePageDir + (name[0] == '/' ? name.substr(1) : name);
+}
+
+//! @return the huge page size if hugetlbfs is mounted at hugePageDir, otherwise 0
+size_t hugePageSize() {
+    struct statfs fs{};
+    if (statfs(hugePageDir, &fs) || fs.f_type != HUGETLBFS_MAGIC) {
+        return 0;
+    }
+    return fs.f_bsize;
+}
+
+/*!
+ * Create(if create is true) or open name in hugetlbfs and map it, size is rounded up to the huge page size.
+ * @return MAP_FAILED if huge pages are not available, then the caller falls back to shm_open()
+ */
+void *mapHugePages(const std::string &name, size_t &size, bool create, bool allowOverwrite, int flags, int &fd) {
+    size_t pageSize = hugePageSize();
+    if (pageSize == 0) {
+        printf("[Shared Memory] hugetlbfs isn't mounted at %s, %s uses normal pages\n", hugePageDir, name.c_str());
+        return MAP_FAILED;
+    }
+    std::string path = hugePagePath(name);
+    fd = open(path.c_str(), create ? O_RDWR | O_CREAT : O_RDWR, S_IWUSR | S_IRUSR | S_IWGRP | S_IRGRP | S_IROTH);
+    if (fd < 0) {
+        printf("[Shared Memory] open %s failed(%s), %s uses normal pages\n", path.c_str(), strerror(errno), name.c_str());
+        return MAP_FAILED;
+    }
+    struct stat s{};
+    if (fstat(fd, &s)) {
+        close(fd);
+        printf("[ERROR] SharedMemory, file state of %s error!", path.c_str());
+        throw std::runtime_error("[ERROR] SharedMemory, file state error!");
+    }
+    if (create) {
+        if (s.st_size && !allowOverwrite) {
+            close(fd);
+            printf("[Shared Memory] SharedMemory::createNew on something that wasn't new, %s has already existed!",
+                   path.c_str());
+            throw std::runtime_error("[Shared Memory] SharedMemory::createNew on something that "
+                                     "wasn't new, file has already existed!");
+        }
+        size = (size + pageSize - 1) / pageSize * pageSize;
+        if (ftruncate(fd, (off_t) size)) {
+            close(fd);
+            unlink(path.c_str());
+            printf("[Shared Memory] ftruncate %s failed(%s), %s uses normal pages\n",
+                   path.c_str(), strerror(errno), name.c_str());
+            return MAP_FAILED;
+        }
+    } else {
+        if ((size_t) s.st_size < size) {
+            close(fd);
+            printf("[ERROR] SharedMemory::attach() on incorrect size!");
+            throw std::runtime_error("[ERROR] SharedMemory::attach() on incorrect size!");
+        }
+        size = s.st_size;
+    }
+    void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if (mem == MAP_FAILED) {
+        // mostly no huge page is reserved, see vm.nr_hugepages
+        printf("[Shared Memory] mmap %s with huge pages failed(%s), %s uses normal pages\n",
+               path.c_str(), strerror(errno), name.c_str());
+        close(fd);
+        if (create) {
+            unlink(path.c_str());
+        }
+    }
+    return mem;
+}
+
+void prefaultPages(void *mem, size_t size) {
+    long pageSize = sysconf(_SC_PAGESIZE);
+    for (size_t offset = 0; offset < size; offset += pageSize) {
+        (void) ((volatile char *) mem)[offset];
+    }
+}
+
+void lockPages(void *mem, size_t size, const std::string &name) {
+    if (mlock(mem, size)) {
+        printf("[Shared Memory] mlock(%s) failed(%s), pages may be swapped out, "
+               "raise RLIMIT_MEMLOCK or grant CAP_IPC_LOCK\n", name.c_str(), strerror(errno));
+    }
+}
+}
+
 template<class T>
-void SharedMemory<T>::createNew(const std::string &name, size_t size, bool allowOverwrite){
+void SharedMemory<T>::createNew(const std::string &name, size_t size, bool allowOverwrite, unsigned int options){
     if (size <= 0) {
         printf("[ERROR] SharedMemory::createNew: invalid size!");
         throw std::runtime_error("[ERROR] SharedMemory::createNew: invalid size!");
@@ -250,6 +416,31 @@ void SharedMemory<T>::createNew(const std::string &name, size_t size, bool allow
             "[ERROR] SharedMemory::createNew: Shared memory name is NULL string!");
     }
     _name = name;
+    _mappedSize = _size;
+    _options = options;
+    _generation = 0;
+    _hugePages = false;
+    int mapFlags = (options & SHM_PREFAULT) ? MAP_SHARED | MAP_POPULATE : MAP_SHARED;
+    void *mem = MAP_FAILED;
+    if (options & SHM_HUGE_PAGES) {
+        mem = mapHugePages(name, _mappedSize, true, allowOverwrite, mapFlags, _fd);
+        _hugePages = mem != MAP_FAILED;
+    }
+    if (!_hugePages) {
+        mem = mapNew(name, allowOverwrite, mapFlags);
+    }
+    if (options & SHM_MLOCK) {
+        lockPages(mem, _size, name);
+    }
+    memset(mem, 0, _size);
+    _data = (T *) mem;
+    printf("[Shared Memory] SharedMemory create success(%s), map file to memory "
+           "of size (%ld)\n", name.c_str(), _size);
+    _closed = false;
+}
+
+template<class T>
+void *SharedMemory<T>::mapNew(const std::string &name, bool allowOverwrite, int flags){
     struct stat s{};  // restore file information
 
     _fd = shm_open(name.c_str(), O_RDWR | O_CREAT,
@@ -281,25 +472,18 @@ void SharedMemory<T>::createNew(const std::string &name, size_t size, bool allow
         throw std::runtime_error("[ERROR] SharedMemory::createNew(): ftruncate() error");
     }
 
-    void *mem = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    // pages of the reserve beyond the end of the segment are never touched
+    _mappedSize = std::max(_size, SHM_ADDRESS_RESERVE);
+    void *mem = mmap(nullptr, _mappedSize, PROT_READ | PROT_WRITE, flags, _fd, 0);
     if (mem == MAP_FAILED) {
         printf("[ERROR] SharedMemory::createNew() mmap failed!");
         throw std::runtime_error("[ERROR] SharedMemory::createNew() mmap failed!");
     }
-    memset(mem, 0, _size);
-    _data = (T *) mem;
-    printf("[Shared Memory] SharedMemory create success(%s), map file to memory "
-           "of size (%ld)\n", name.c_str(), _size);
-    _closed = false;
+    return mem;
 }
 
 template<class T>
-void SharedMemory<T>::attach(const std::string &name, size_t size){
-    if (size <= 0) {
-        printf("[ERROR] SharedMemory::attach(): invalid size!");
-        throw std::runtime_error(
-            "[Shared Memory] SharedMemory::attach: invalid size!");
-    }
+void SharedMemory<T>::attach(const std::string &name, size_t size, unsigned int options){
     _size = size;
     if (name.length() == 0) {
         printf("[ERROR] SharedMemory::attach(): Shared memory name is NULL string!");
@@ -308,6 +492,42 @@ void SharedMemory<T>::attach(const std::string &name, size_t size){
             "is NULL string!");
     }
     _name = name;
+    _mappedSize = _size;
+    _options = options;
+    _hugePages = false;
+    int mapFlags = (options & SHM_PREFAULT) ? MAP_SHARED | MAP_POPULATE : MAP_SHARED;
+    void *mem = MAP_FAILED;
+    if (options & SHM_HUGE_PAGES) {
+        mem = mapHugePages(name, _mappedSize, false, false, mapFlags, _fd);
+        _hugePages = mem != MAP_FAILED;
+        if (_hugePages && _size == 0) {
+            _size = _mappedSize;
+        }
+    }
+    if (!_hugePages) {
+        mem = mapExisting(name, mapFlags);
+    }
+    if (options & SHM_MLOCK) {
+        lockPages(mem, _size, name);
+    }
+    _data = (T *) mem;
+    _attached = true;
+    try {
+        _data->checkHeader(_size);
+    } catch (std::runtime_error &err) {
+        detach();
+        throw;
+    }
+    _generation = _data->generation.load(std::memory_order_acquire);
+
+    printf(
+        "[Shared Memory] SharedMemory attach success(%s), attached memory of "
+        "size(%ld)\n",
+        name.c_str(), _size);
+}
+
+template<class T>
+void *SharedMemory<T>::mapExisting(const std::string &name, int flags){
     struct stat s{};
 
     _fd = shm_open(name.c_str(), O_RDWR,
@@ -318,31 +538,29 @@ void SharedMemory<T>::attach(const std::string &name, size_t size){
             "[ERROR] SharedMemory::attach(): open file failed!");
     }
 
-    printf("[Shared Memory] open existing %s size %ld bytes\n", name.c_str(), _size);
-
     if (fstat(_fd, &s)) {
         printf("[ERROR] SharedMemory::attach(): file state error!");
         throw std::runtime_error("[ERROR] SharedMemory::attach(): file state error!");
     }
 
+    if (_size == 0) {
+        _size = s.st_size;  // attach by name, the header tells the rest
+    }
+    printf("[Shared Memory] open existing %s size %ld bytes\n", name.c_str(), _size);
+
     if (s.st_size != _size) {
         printf("[ERROR] SharedMemory::attach() on incorrect size!");
         throw std::runtime_error(
             "[ERROR] SharedMemory::attach() on incorrect size!");
     }
 
-    void *mem = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    _mappedSize = std::max(_size, SHM_ADDRESS_RESERVE);
+    void *mem = mmap(nullptr, _mappedSize, PROT_READ | PROT_WRITE, flags, _fd, 0);
     if (mem == MAP_FAILED) {
         printf("[ERROR] SharedMemory::attach(): mmap failed!");
         throw std::runtime_error("[ERROR] SharedMemory::attach(): mmap failed!");
     }
-    _data = (T *) mem;
-
-    printf(
-        "[Shared Memory] SharedMemory attach success(%s), attached memory of "
-        "size(%ld)\n",
-        name.c_str(), _size);
-    _attached = true;
+    return mem;
 }
 
 template<class T>
@@ -354,13 +572,13 @@ void SharedMemory<T>::closeNew(){
             "exist");
     }
 
-    if (munmap((void *) _data, _size)) {
+    if (munmap((void *) _data, _mappedSize)) {
         printf("[ERROR] SharedMemory::closeNew(): munmap failed!");
         throw std::runtime_error(
             "[ERROR] SharedMemory::closeNew(): munmap failed!");
     }
 
-    if (shm_unlink(_name.c_str())) {
+    if (_hugePages ? unlink(hugePagePath(_name).c_str()) : shm_unlink(_name.c_str())) {
         printf("[ERROR] SharedMemory::closeNew(): shm_unlink error!");
         throw std::runtime_error(
             "[ERROR] SharedMemory::closeNew() shm_unlink error!");
@@ -390,7 +608,7 @@ void SharedMemory<T>::detach(){
             "doesn't exist");
     }
 
-    if (munmap((void *) _data, _size)) {
+    if (munmap((void *) _data, _mappedSize)) {
         printf("[ERROR] SharedMemory::detach(): munmap failed!");
         throw std::runtime_error(
             "[ERROR] SharedMemory::detach(): munmap failed!");
@@ -410,6 +628,61 @@ void SharedMemory<T>::detach(){
     _attached = false;
 }
 
+template<class T>
+void SharedMemory<T>::grow(size_t size) {
+    if (_data == nullptr) {
+        printf("[ERROR] SharedMemory::grow(): the shared memory doesn't exist!");
+        throw std::runtime_error("[ERROR] SharedMemory::grow(): the shared memory doesn't exist");
+    }
+    if (size <= _size) {
+        return;
+    }
+    if (size > _mappedSize) {
+        printf("[ERROR] SharedMemory::grow(%s): %zu bytes exceed the reserved address space of %zu bytes!",
+               _name.c_str(), size, _mappedSize);
+        throw std::runtime_error("[ERROR] SharedMemory::grow(): size exceeds the reserved address space!");
+    }
+    // a segment in hugetlbfs is already as large as its mapping
+    if (!_hugePages && ftruncate(_fd, (off_t) size)) {
+        printf("[ERROR] SharedMemory::grow(%s): ftruncate() error %s", _name.c_str(), strerror(errno));
+        throw std::runtime_error("[ERROR] SharedMemory::grow(): ftruncate() error");
+    }
+    char *grown = (char *) _data + _size;
+    if (_options & SHM_PREFAULT) {
+        prefaultPages(grown, size - _size);
+    }
+    if (_options & SHM_MLOCK) {
+        lockPages(grown, size - _size, _name);
+    }
+    printf("[Shared Memory] SharedMemory::grow(%s) from %zu to %zu bytes\n", _name.c_str(), _size, size);
+    _size = size;
+}
+
+template<class T>
+bool SharedMemory<T>::updateMapping() {
+    unsigned int generation = get()->generation.load(std::memory_order_acquire);
+    if (generation == _generation || (generation & 1)) {
+        return false;
+    }
+    size_t size = _data->totalSize;
+    if (size > _mappedSize) {
+        printf("[ERROR] SharedMemory::updateMapping(%s): the segment has grown beyond the mapping!", _name.c_str());
+        throw std::runtime_error("[ERROR] SharedMemory::updateMapping(): the segment has grown beyond the mapping!");
+    }
+    if (size > _size) {
+        // the new part is already in our mapping, only the options are left to apply
+        if (_options & SHM_PREFAULT) {
+            prefaultPages((char *) _data + _size, size - _size);
+        }
+        if (_options & SHM_MLOCK) {
+            lockPages((char *) _data + _size, size - _size, _name);
+        }
+        _size = size;
+    }
+    _generation = generation;
+    return true;
+}
+
 #endif
 
 template<class T>
@@ -421,6 +694,11 @@ T* SharedMemory<T>::get(){
     return _data;
 }
 
+template<class T>
+bool SharedMemory<T>::waitForUpdate(long milliseconds){
+    return get()->waitForUpdate(_seenUpdate, milliseconds);
+}
+
 template<class T>
 T& SharedMemory<T>::operator()(){
     if (_data == nullptr){
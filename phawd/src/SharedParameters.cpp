@@ -9,9 +9,72 @@
  * @file SharedParameter.cpp
  */
 
+#include <new>
+#include <thread>
+#include <cstddef>
 #include <phawd/SharedParameter.h>
+#if __linux__
+#include <climits>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#elif _WIN32
+#include <windows.h>
+#include <process.h>
+#endif
 using namespace phawd;
 
+namespace {
+void clearProducers(std::atomic<size_t> &assigned, ProducerSlot *producers) {
+    assigned = 0;
+    for (int i = 0; i < SHARED_MEMORY_MAX_PRODUCERS; ++i) {
+        producers[i].state = PRODUCER_FREE;
+        producers[i].pid = 0;
+        producers[i].heartbeat = 0;
+        std::memset(producers[i].name, 0, sizeof(producers[i].name));
+        producers[i].waveBegin = 0;
+        producers[i].waveCount = 0;
+    }
+}
+
+size_t alignToCacheLine(size_t size) {
+    return (size + 63) & ~(size_t)63;
+}
+
+//!< first index not smaller than index whose parameter starts a cache line, parameters[] itself starts one
+size_t alignToParameterLine(size_t index) {
+    while ((index * sizeof(Parameter)) % 64 != 0) {
+        ++index;
+    }
+    return index;
+}
+
+//!< rings start on a cache line of their own after the parameters
+size_t getSampleRingOffset(size_t wave_params_begin, size_t num_wave_params) {
+    return alignToCacheLine(sizeof(SharedParameters) + (wave_params_begin + num_wave_params) * sizeof(Parameter));
+}
+
+//!< end of the waveform parameters and their rings, where the data arena starts
+size_t getWaveRegionEnd(size_t wave_params_begin, size_t num_wave_params, size_t sample_ring_capacity) {
+    size_t size = sizeof(SharedParameters) + (wave_params_begin + num_wave_params) * sizeof(Parameter);
+    if (sample_ring_capacity > 0) {
+        size = getSampleRingOffset(wave_params_begin, num_wave_params) +
+               num_wave_params * SampleRing::getSize(sample_ring_capacity);
+    }
+    return alignToCacheLine(size);
+}
+
+//!< copy the staging bank into bank of control, inside the write section of its generation
+void writeControlBank(std::atomic<unsigned int> &generation, Parameter *bank, const Parameter *staging, size_t count) {
+    generation.store(generation.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < count; ++i) {
+        bank[i] = staging[i];
+    }
+    generation.store(generation.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+}
+
 GamepadCommand::GamepadCommand(){
     down = false;
     left = false;
@@ -40,9 +103,31 @@ void GamepadCommand::init() {
 }
 
 SharedParameters::SharedParameters(){
+    magic = 0;
+    version = SHARED_MEMORY_VERSION;
+    layoutHash = getLayoutHash();
+    parametersOffset = offsetof(SharedParameters, parameters);
+    totalSize = 0;
+    generation = 0;
+    ringPushers = 0;
     connected = 0;
     numControlParams = 0;
     numWaveParams = 0;
+    waveParamsBegin = 0;
+    separateRegions = false;
+    sampleRingCapacity = 0;
+    sampleRingOffset = 0;
+    waveTimestamp = 0;
+    updateSeq = 0;
+    updateWaiters = 0;
+    controlBank = 0;
+    controlGeneration[0] = 0;
+    controlGeneration[1] = 0;
+    controlBankOffset = 0;
+    dataArenaOffset = 0;
+    dataArenaSize = 0;
+    dataArenaUsed = 0;
+    clearProducers(assignedWaveParams, producers);
     gameCommand.init();
 }
 
@@ -61,14 +146,39 @@ SharedParameters &SharedParameters::operator=(const SharedParameters &p) {
             printf("[ERROR] SharedParameters::operator=(), realloc error!");
             throw std::runtime_error("[ERROR] SharedParameters::operator=(), realloc error!");
         }
-        connected = p.connected;
+        magic = 0;                      // only init() marks shared memory as valid
+        version = p.version;
+        layoutHash = p.layoutHash;
+        parametersOffset = p.parametersOffset;
+        totalSize = 0;
+        generation = 0;
+        ringPushers = 0;
+        connected = p.connected.load();
         numControlParams = p.numControlParams;
         numWaveParams = p.numWaveParams;
+        waveParamsBegin = p.numControlParams;   // copies are packed
+        separateRegions = false;
+        sampleRingCapacity = 0;         // waveform rings are not copied
+        sampleRingOffset = 0;
+        waveTimestamp = p.waveTimestamp.load();
+        updateSeq = 0;
+        updateWaiters = 0;
+        controlBank = 0;
+        controlGeneration[0] = 0;
+        controlGeneration[1] = 0;
+        controlBankOffset = 0;          // nor is the second control bank
+        dataArenaOffset = 0;            // nor the data arena, the arrays of p are out of reach of this copy
+        dataArenaSize = 0;
+        dataArenaUsed = 0;
+        clearProducers(assignedWaveParams, producers);  // producers belong to the shared memory they registered in
         std::memcpy(&gameCommand, &p.gameCommand, sizeof(GamepadCommand));
 
-        for (size_t i = 0; i < count_real; ++i) {
+        for (size_t i = 0; i < p.numControlParams; ++i) {
             parameters[i] = p.parameters[i];
         }
+        for (size_t i = 0; i < p.numWaveParams; ++i) {
+            parameters[waveParamsBegin + i] = p.parameters[p.waveParamsBegin + i];
+        }
     }
     return *this;
 }
@@ -78,14 +188,39 @@ SharedParameters &SharedParameters::operator=(SharedParameters &&p) noexcept{
         size_t count_real = p.numControlParams + p.numWaveParams;
         realloc(this, sizeof(SharedParameters) + count_real * sizeof(Parameter));
 
-        connected = p.connected;
+        magic = 0;                      // only init() marks shared memory as valid
+        version = p.version;
+        layoutHash = p.layoutHash;
+        parametersOffset = p.parametersOffset;
+        totalSize = 0;
+        generation = 0;
+        ringPushers = 0;
+        connected = p.connected.load();
         numControlParams = p.numControlParams;
         numWaveParams = p.numWaveParams;
+        waveParamsBegin = p.numControlParams;   // copies are packed
+        separateRegions = false;
+        sampleRingCapacity = 0;         // waveform rings are not copied
+        sampleRingOffset = 0;
+        waveTimestamp = p.waveTimestamp.load();
+        updateSeq = 0;
+        updateWaiters = 0;
+        controlBank = 0;
+        controlGeneration[0] = 0;
+        controlGeneration[1] = 0;
+        controlBankOffset = 0;          // nor is the second control bank
+        dataArenaOffset = 0;            // nor the data arena, the arrays of p are out of reach of this copy
+        dataArenaSize = 0;
+        dataArenaUsed = 0;
+        clearProducers(assignedWaveParams, producers);  // producers belong to the shared memory they registered in
         std::memcpy(&gameCommand, &p.gameCommand, sizeof(GamepadCommand));
 
-        for (size_t i = 0; i < count_real; ++i) {
+        for (size_t i = 0; i < p.numControlParams; ++i) {
             parameters[i] = p.parameters[i];
         }
+        for (size_t i = 0; i < p.numWaveParams; ++i) {
+            parameters[waveParamsBegin + i] = p.parameters[p.waveParamsBegin + i];
+        }
         free(&p);
     }
     return *this;
@@ -109,7 +244,29 @@ SharedParameters *SharedParameters::create(int num_control_params, int num_wave_
     }
     sp->numControlParams = num_control_params;
     sp->numWaveParams = num_wave_params;
+    sp->waveParamsBegin = num_control_params;
+    sp->separateRegions = false;
+    sp->sampleRingCapacity = 0;
+    sp->sampleRingOffset = 0;
+    sp->waveTimestamp = 0;
+    sp->updateSeq = 0;
+    sp->updateWaiters = 0;
+    sp->controlBank = 0;
+    sp->controlGeneration[0] = 0;
+    sp->controlGeneration[1] = 0;
+    sp->controlBankOffset = 0;
+    sp->dataArenaOffset = 0;
+    sp->dataArenaSize = 0;
+    sp->dataArenaUsed = 0;
+    sp->magic = 0;
+    sp->version = SHARED_MEMORY_VERSION;
+    sp->layoutHash = getLayoutHash();
+    sp->parametersOffset = offsetof(SharedParameters, parameters);
+    sp->totalSize = 0;
+    sp->generation = 0;
+    sp->ringPushers = 0;
     sp->connected = 0;
+    clearProducers(sp->assignedWaveParams, sp->producers);
     sp->gameCommand.init();
     for (int i = 0; i < num_wave_params + num_control_params; ++i) {
         sp->parameters[i] = Parameter();
@@ -123,9 +280,450 @@ void SharedParameters::destroy(SharedParameters *p){
 }
 
 void SharedParameters::collectParameters(ParameterCollection *pc) {
-    for (size_t i = 0; i < numControlParams + numWaveParams; ++i) {
+    for (size_t i = 0; i < numControlParams; ++i) {
         pc->addParameter(&parameters[i]);
     }
+    for (size_t i = 0; i < numWaveParams; ++i) {
+        pc->addParameter(&getWaveParameters()[i]);
+    }
+    pc->build();
+}
+
+size_t SharedParameters::getSize(size_t num_control_params, size_t num_wave_params, size_t sample_ring_capacity,
+                                 bool separate_regions, size_t data_arena_size) {
+    size_t size = getWaveRegionEnd(getWaveParamsBegin(num_control_params, separate_regions),
+                                   num_wave_params + getProducerPadding(separate_regions), sample_ring_capacity);
+    if (data_arena_size > 0) {
+        size = alignToCacheLine(size) + data_arena_size * sizeof(double);
+    }
+    return size;
+}
+
+size_t SharedParameters::getWaveParamsBegin(size_t num_control_params, bool separate_regions) {
+    // the control parameters are followed by their second bank and the staging bank, which never move
+    size_t begin = 3 * num_control_params;
+    return separate_regions ? alignToParameterLine(begin) : begin;
+}
+
+size_t SharedParameters::getProducerPadding(bool separate_regions) {
+    // a range starting on a cache line wastes less than a line-aligned group of parameters in front of it
+    return separate_regions ? (SHARED_MEMORY_MAX_PRODUCERS - 1) * (alignToParameterLine(1) - 1) : 0;
+}
+
+Parameter *SharedParameters::getWaveParameters() {
+    return parameters + waveParamsBegin;
+}
+
+void SharedParameters::init(size_t num_control_params, size_t num_wave_params, size_t sample_ring_capacity,
+                            bool separate_regions, size_t data_arena_size) {
+    magic.store(0, std::memory_order_relaxed);
+    version = SHARED_MEMORY_VERSION;
+    layoutHash = getLayoutHash();
+    parametersOffset = offsetof(SharedParameters, parameters);
+    totalSize = getSize(num_control_params, num_wave_params, sample_ring_capacity, separate_regions, data_arena_size);
+    generation = 0;
+    ringPushers = 0;
+    connected = 0;
+    clearProducers(assignedWaveParams, producers);
+    numControlParams = num_control_params;
+    numWaveParams = num_wave_params + getProducerPadding(separate_regions);
+    waveParamsBegin = getWaveParamsBegin(num_control_params, separate_regions);
+    separateRegions = separate_regions;
+    gameCommand.init();
+    sampleRingCapacity = 0;
+    sampleRingOffset = 0;
+    waveTimestamp = 0;
+    updateSeq = 0;
+    updateWaiters = 0;
+    controlBank = 0;
+    controlGeneration[0] = 0;
+    controlGeneration[1] = 0;
+    controlBankOffset = 0;
+    if (num_control_params > 0) {
+        controlBankOffset = parametersOffset + num_control_params * sizeof(Parameter);
+        for (size_t i = 0; i < num_control_params; ++i) {
+            new (getControlParameters(1) + i) Parameter();
+            new (getControlStaging() + i) Parameter();
+        }
+    }
+    if (sample_ring_capacity > 0) {
+        sampleRingOffset = getSampleRingOffset(waveParamsBegin, numWaveParams);
+        sampleRingCapacity = sample_ring_capacity;
+        for (size_t i = 0; i < numWaveParams; ++i) {
+            getSampleRing(i)->init(sample_ring_capacity);
+        }
+    }
+    dataArenaUsed = 0;
+    dataArenaSize = data_arena_size;
+    dataArenaOffset = 0;
+    if (data_arena_size > 0) {
+        // the arena comes last, its end is the end of the shared memory
+        dataArenaOffset = totalSize - data_arena_size * sizeof(double);
+        std::memset(getDataArena(), 0, data_arena_size * sizeof(double));
+    }
+    // published last, a client seeing the magic sees the whole header
+    magic.store(SHARED_MEMORY_MAGIC, std::memory_order_release);
+}
+
+unsigned int SharedParameters::getLayoutHash() {
+    const size_t layout[] = {sizeof(size_t), sizeof(long), sizeof(long long),
+                             sizeof(Parameter), alignof(Parameter), sizeof(ParameterValue),
+                             sizeof(GamepadCommand), alignof(GamepadCommand),
+                             sizeof(SharedParameters), alignof(SharedParameters), offsetof(SharedParameters, parameters),
+                             sizeof(WaveSample), alignof(SampleRing), SampleRing::getSize(0)};
+    // FNV-1a
+    unsigned int hash = 2166136261u;
+    for (size_t value : layout) {
+        for (size_t i = 0; i < sizeof(value); ++i) {
+            hash = (hash ^ (unsigned char) (value >> (8 * i))) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+void SharedParameters::checkHeader(size_t mapped_size) const {
+    const char *error = nullptr;
+    if (magic.load(std::memory_order_acquire) != SHARED_MEMORY_MAGIC) {
+        error = "not a phawd shared memory, or it isn't initialized yet";
+    } else if (version != SHARED_MEMORY_VERSION) {
+        error = "version mismatch, both sides should use the same phawd";
+    } else if (layoutHash != getLayoutHash() || parametersOffset != offsetof(SharedParameters, parameters)) {
+        error = "layout mismatch, both sides should be built with the same phawd and the same kind of compiler";
+    } else if (totalSize > mapped_size) {
+        error = "mapped size is smaller than the size in header";
+    }
+    if (error != nullptr) {
+        printf("[ERROR] SharedParameters::checkHeader(), %s!", error);
+        throw std::runtime_error(std::string("[ERROR] SharedParameters::checkHeader(), ") + error + "!");
+    }
+}
+
+SampleRing *SharedParameters::getSampleRing(size_t wave_index) {
+    if (sampleRingCapacity == 0 || wave_index >= numWaveParams) {
+        return nullptr;
+    }
+    return (SampleRing *) ((char *) this + sampleRingOffset + wave_index * SampleRing::getSize(sampleRingCapacity));
+}
+
+Parameter *SharedParameters::getControlParameters(unsigned int bank) {
+    if (bank == 0 || controlBankOffset == 0) {
+        return parameters;
+    }
+    return (Parameter *) ((char *) this + controlBankOffset);
+}
+
+void SharedParameters::collectControlParameters(ParameterCollection *pc, unsigned int bank) {
+    Parameter *control = getControlParameters(bank);
+    for (size_t i = 0; i < numControlParams; ++i) {
+        pc->addParameter(&control[i]);
+    }
+    pc->build();
+}
+
+unsigned int SharedParameters::acquireControlBank(unsigned int &generation) {
+    for (;;) {
+        unsigned int bank = controlBank.load(std::memory_order_acquire);
+        generation = controlGeneration[bank].load(std::memory_order_acquire);
+        // odd: the displayer flipped away from it since we loaded controlBank and is writing it, follow the flip
+        if ((generation & 1u) == 0) {
+            return bank;
+        }
+    }
+}
+
+bool SharedParameters::releaseControlBank(unsigned int bank, unsigned int generation) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return controlGeneration[bank].load(std::memory_order_relaxed) == generation;
+}
+
+Parameter *SharedParameters::getControlStaging() {
+    if (controlBankOffset == 0) {
+        return parameters;
+    }
+    return getControlParameters(1) + numControlParams;
+}
+
+void SharedParameters::commitControlUpdate() {
+    Parameter *staging = getControlStaging();
+    if (staging != parameters) {
+        // never waits for the robot programs: only the bank they aren't handed out is written, a control cycle still
+        // reading it from before the last flip sees the generation move in releaseControlBank() and reads again
+        unsigned int bank = controlBank.load(std::memory_order_relaxed) ^ 1u;
+        writeControlBank(controlGeneration[bank], getControlParameters(bank), staging, numControlParams);
+        controlBank.store(bank, std::memory_order_release);
+        // both banks hold the latest commit, so that programs reading parameters[] directly see every commit as well
+        writeControlBank(controlGeneration[bank ^ 1u], getControlParameters(bank ^ 1u), staging, numControlParams);
+    }
+    notifyUpdate();
+}
+
+void SharedParameters::pushWaveSamples() {
+    pushWaveSamples(getTimestamp());
+}
+
+void SharedParameters::pushWaveSamples(long long timestamp) {
+    if (sampleRingCapacity > 0) {
+        // seq_cst pairs with addWaveParameters(): either it waits for us, or we see the odd generation and skip
+        ringPushers.fetch_add(1, std::memory_order_seq_cst);
+        if ((generation.load(std::memory_order_seq_cst) & 1) == 0) {
+            pushSamples(0, numWaveParams, timestamp);
+        }
+        ringPushers.fetch_sub(1, std::memory_order_release);
+    }
+    waveTimestamp.store(timestamp, std::memory_order_release);
+    notifyUpdate();
+}
+
+void SharedParameters::pushSamples(size_t begin, size_t count, long long timestamp) {
+    ParameterValue value;
+    for (size_t i = begin; i < begin + count && i < numWaveParams; ++i) {
+        parameters[waveParamsBegin + i].readValue(value);
+        getSampleRing(i)->push(value, timestamp);
+    }
+}
+
+int SharedParameters::registerProducer(const std::string &name, size_t num_wave_params) {
+    ProducerSlot slot_name{};
+    if (name.empty() || name.length() >= sizeof(slot_name.name)) {
+        printf("[ERROR] SharedParameters::registerProducer(), name of producer should have 1 to 15 characters!");
+        throw std::runtime_error("[ERROR] SharedParameters::registerProducer(), "
+                                 "name of producer should have 1 to 15 characters!");
+    }
+    std::memcpy(slot_name.name, name.c_str(), name.length());
+    int id = -1;
+    bool takeOver = false;
+    // a producer coming back takes its slot again, if it left or died without unregistering
+    for (int i = 0; i < SHARED_MEMORY_MAX_PRODUCERS && id < 0; ++i) {
+        unsigned int state = producers[i].state.load(std::memory_order_acquire);
+        if ((state == PRODUCER_LEFT || (state == PRODUCER_ACTIVE && !isProducerAlive(i))) &&
+            std::memcmp(producers[i].name, slot_name.name, sizeof(slot_name.name)) == 0 &&
+            producers[i].waveCount >= num_wave_params &&
+            producers[i].state.compare_exchange_strong(state, PRODUCER_BUSY, std::memory_order_acq_rel)) {
+            id = i;
+            takeOver = state == PRODUCER_ACTIVE;
+        }
+    }
+    for (int i = 0; i < SHARED_MEMORY_MAX_PRODUCERS && id < 0; ++i) {
+        unsigned int state = PRODUCER_FREE;
+        if (!producers[i].state.compare_exchange_strong(state, PRODUCER_BUSY, std::memory_order_acq_rel)) {
+            continue;
+        }
+        // the waveform parameters are handed out in order and never taken back
+        size_t assigned = assignedWaveParams.load(std::memory_order_relaxed);
+        size_t begin;
+        do {
+            // with separate regions every producer starts on a cache line of its own
+            begin = separateRegions ? alignToParameterLine(waveParamsBegin + assigned) - waveParamsBegin : assigned;
+            if (begin + num_wave_params > numWaveParams) {
+                producers[i].state.store(PRODUCER_FREE, std::memory_order_release);
+                printf("[ERROR] SharedParameters::registerProducer(), not enough waveform parameters left for %s!",
+                       name.c_str());
+                throw std::runtime_error("[ERROR] SharedParameters::registerProducer(), "
+                                         "not enough waveform parameters left!");
+            }
+        } while (!assignedWaveParams.compare_exchange_weak(assigned, begin + num_wave_params, std::memory_order_relaxed));
+        producers[i].waveBegin = begin;
+        producers[i].waveCount = num_wave_params;
+        std::memcpy(producers[i].name, slot_name.name, sizeof(slot_name.name));
+        id = i;
+    }
+    if (id < 0) {
+        printf("[ERROR] SharedParameters::registerProducer(), all %d producer slots are taken!", SHARED_MEMORY_MAX_PRODUCERS);
+        throw std::runtime_error("[ERROR] SharedParameters::registerProducer(), all producer slots are taken!");
+    }
+#if _WIN32
+    producers[id].pid = _getpid();
+#else
+    producers[id].pid = getpid();
+#endif
+    producers[id].heartbeat.store(getTimestamp(), std::memory_order_relaxed);
+    producers[id].state.store(PRODUCER_ACTIVE, std::memory_order_release);
+    if (!takeOver) {
+        connected.fetch_add(1);
+    }
+    notifyUpdate();
+    return id;
+}
+
+void SharedParameters::unregisterProducer(int id) {
+    unsigned int state = PRODUCER_ACTIVE;
+    if (id >= 0 && id < SHARED_MEMORY_MAX_PRODUCERS &&
+        producers[id].state.compare_exchange_strong(state, PRODUCER_LEFT, std::memory_order_acq_rel)) {
+        connected.fetch_sub(1);
+        notifyUpdate();
+    }
+}
+
+void SharedParameters::heartbeat(int id) {
+    producers[id].heartbeat.store(getTimestamp(), std::memory_order_release);
+}
+
+bool SharedParameters::isProducerAlive(int id, long long timeout) {
+    return producers[id].state.load(std::memory_order_acquire) == PRODUCER_ACTIVE &&
+           getTimestamp() - producers[id].heartbeat.load(std::memory_order_acquire) < timeout;
+}
+
+Parameter *SharedParameters::getProducerParameters(int id) {
+    return &parameters[waveParamsBegin + producers[id].waveBegin];
+}
+
+void SharedParameters::pushProducerSamples(int id) {
+    pushProducerSamples(id, getTimestamp());
+}
+
+void SharedParameters::pushProducerSamples(int id, long long timestamp) {
+    if (sampleRingCapacity > 0) {
+        ringPushers.fetch_add(1, std::memory_order_seq_cst);
+        if ((generation.load(std::memory_order_seq_cst) & 1) == 0) {
+            pushSamples(producers[id].waveBegin, producers[id].waveCount, timestamp);
+        }
+        ringPushers.fetch_sub(1, std::memory_order_release);
+    }
+    producers[id].heartbeat.store(timestamp, std::memory_order_release);
+    waveTimestamp.store(timestamp, std::memory_order_release);
+    notifyUpdate();
+}
+
+int SharedParameters::getProducerOf(size_t wave_index) {
+    for (int i = 0; i < SHARED_MEMORY_MAX_PRODUCERS; ++i) {
+        unsigned int state = producers[i].state.load(std::memory_order_acquire);
+        if ((state == PRODUCER_ACTIVE || state == PRODUCER_LEFT) && wave_index >= producers[i].waveBegin &&
+            wave_index < producers[i].waveBegin + producers[i].waveCount) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+std::string SharedParameters::getWaveLabel(size_t wave_index) {
+    std::string name = parameters[waveParamsBegin + wave_index].getName();
+    int id = getProducerOf(wave_index);
+    if (id < 0) {
+        return name;
+    }
+    return std::string(producers[id].name, strnlen(producers[id].name, sizeof(producers[id].name))) + "/" + name;
+}
+
+void SharedParameters::addWaveParameters(size_t count) {
+    if (count == 0) {
+        return;
+    }
+    generation.fetch_add(1, std::memory_order_seq_cst);
+    while (ringPushers.load(std::memory_order_seq_cst) != 0) {
+        std::this_thread::yield();
+    }
+    size_t begin = waveParamsBegin + numWaveParams;
+    numWaveParams += count;
+    totalSize = getSize(numControlParams, numWaveParams - getProducerPadding(separateRegions), sampleRingCapacity,
+                        separateRegions, dataArenaSize);
+    if (dataArenaSize > 0) {
+        size_t offset = totalSize - dataArenaSize * sizeof(double);
+        std::memmove((char *) this + offset, getDataArena(), dataArenaSize * sizeof(double));
+        dataArenaOffset = offset;
+    }
+    // the new parameters take the place of the first rings
+    for (size_t i = begin; i < begin + count; ++i) {
+        new (&parameters[i]) Parameter();
+    }
+    if (sampleRingCapacity > 0) {
+        sampleRingOffset = getSampleRingOffset(waveParamsBegin, numWaveParams);
+        for (size_t i = 0; i < numWaveParams; ++i) {
+            getSampleRing(i)->init(sampleRingCapacity);
+        }
+    }
+    generation.fetch_add(1, std::memory_order_release);
+    notifyUpdate();
+}
+
+double *SharedParameters::getDataArena() {
+    if (dataArenaSize == 0) {
+        return nullptr;
+    }
+    return (double *) ((char *) this + dataArenaOffset);
+}
+
+bool SharedParameters::setWaveArray(size_t wave_index, const double *values, unsigned int rows, unsigned int cols) {
+    if (wave_index >= numWaveParams || values == nullptr || rows == 0 || cols == 0) {
+        printf("[ERROR] SharedParameters::setWaveArray(), invalid waveform parameter or size!");
+        throw std::runtime_error("[ERROR] SharedParameters::setWaveArray(), invalid waveform parameter or size!");
+    }
+    // seq_cst pairs with addWaveParameters(), which moves the arena: either it waits for us, or we see the odd
+    // generation and skip, before a range is taken for a write that doesn't happen
+    ringPushers.fetch_add(1, std::memory_order_seq_cst);
+    if (generation.load(std::memory_order_seq_cst) & 1) {
+        ringPushers.fetch_sub(1, std::memory_order_release);
+        return false;
+    }
+    Parameter &parameter = getWaveParameters()[wave_index];
+    ParameterValue value;
+    ParameterKind kind = parameter.readValue(value);
+    size_t count = (size_t) rows * cols;
+    size_t offset = value.array.offset;
+    // the range of the parameter is kept as long as the new size fits into it
+    if ((kind != ParameterKind::VECN_DOUBLE && kind != ParameterKind::MATRIX_DOUBLE) ||
+        (size_t) value.array.rows * value.array.cols < count || offset + count > dataArenaSize) {
+        // several producers may take their ranges at the same time
+        size_t used = dataArenaUsed.load(std::memory_order_relaxed);
+        do {
+            if (used + count > dataArenaSize) {
+                ringPushers.fetch_sub(1, std::memory_order_release);
+                printf("[ERROR] SharedParameters::setWaveArray(), the data arena of %zu doubles is full!",
+                       dataArenaSize);
+                throw std::runtime_error("[ERROR] SharedParameters::setWaveArray(), the data arena is full!");
+            }
+        } while (!dataArenaUsed.compare_exchange_weak(used, used + count, std::memory_order_relaxed));
+        offset = used;
+    }
+    parameter.writeArray(getDataArena(), (unsigned int) offset, rows, cols, values);
+    ringPushers.fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+ParameterKind SharedParameters::getWaveArray(size_t wave_index, double *values, size_t capacity, unsigned int &rows,
+                                             unsigned int &cols) {
+    ParameterValue value;
+    ParameterKind kind = getWaveParameters()[wave_index].readArray(getDataArena(), dataArenaSize, value, values,
+                                                                    capacity);
+    if (kind == ParameterKind::VECN_DOUBLE || kind == ParameterKind::MATRIX_DOUBLE) {
+        rows = value.array.rows;
+        cols = value.array.cols;
+    }
+    return kind;
+}
+
+void SharedParameters::notifyUpdate() {
+    // seq_cst pairs with waitForUpdate(): either we see the waiter, or the waiter sees the new updateSeq
+    updateSeq.fetch_add(1, std::memory_order_seq_cst);
+    if (updateWaiters.load(std::memory_order_seq_cst) > 0) {
+#if __linux__
+        // no FUTEX_PRIVATE_FLAG, the word is shared between processes
+        syscall(SYS_futex, &updateSeq, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+    }
+}
+
+bool SharedParameters::waitForUpdate(unsigned int &seen, long milliseconds) {
+    unsigned int seq = updateSeq.load(std::memory_order_acquire);
+    if (seq == seen && milliseconds > 0) {
+        updateWaiters.fetch_add(1, std::memory_order_seq_cst);
+#if __linux__
+        // the kernel only puts us to sleep if updateSeq still equals seq, so a notifyUpdate() in between isn't lost
+        struct timespec timeout{};
+        timeout.tv_sec = milliseconds / 1000;
+        timeout.tv_nsec = (milliseconds % 1000) * 1000000;
+        syscall(SYS_futex, &updateSeq, FUTEX_WAIT, seq, &timeout, nullptr, 0);
+#elif _WIN32
+        // WaitOnAddress() only works inside one process, fall back to sleeping in small steps
+        for (long i = 0; i < milliseconds && updateSeq.load(std::memory_order_acquire) == seq; ++i) {
+            Sleep(1);
+        }
+#endif
+        updateWaiters.fetch_sub(1, std::memory_order_seq_cst);
+        seq = updateSeq.load(std::memory_order_acquire);
+    }
+    bool updated = seq != seen;
+    seen = seq;
+    return updated;
 }
 
 SocketFromPhawd::SocketFromPhawd(){
@@ -202,9 +800,11 @@ void SocketFromPhawd::collectParameters(ParameterCollection *pc){
     for (size_t i = 0; i < numControlParams; ++i) {
         pc->addParameter(&parameters[i]);
     }
+    pc->build();
 }
 
 SocketToPhawd::SocketToPhawd(){
+    timestamp = 0;
     numWaveParams = 0;
 }
 
@@ -223,6 +823,7 @@ SocketToPhawd &SocketToPhawd::operator=(const SocketToPhawd &p){
             printf("[ERROR] SocketToPhawd::operator=(), realloc error!");
             throw std::runtime_error("[ERROR] SocketToPhawd::operator=(), realloc error!");
         }
+        timestamp = p.timestamp;
         numWaveParams = p.numWaveParams;
         for (size_t i = 0; i < count_real; ++i) {
             parameters[i] = p.parameters[i];
@@ -236,6 +837,7 @@ SocketToPhawd &SocketToPhawd::operator=(SocketToPhawd &&p) noexcept{
         size_t count_real = p.numWaveParams;
         realloc(this, sizeof(SocketToPhawd) + count_real * sizeof(Parameter));
 
+        timestamp = p.timestamp;
         numWaveParams = p.numWaveParams;
 
         for (size_t i = 0; i < count_real; ++i) {
@@ -257,6 +859,7 @@ SocketToPhawd *SocketToPhawd::create(int num_params){
         printf("[ERROR] SocketToPhawd::create(), malloc error!");
         throw std::runtime_error("[ERROR] SocketToPhawd::create(), malloc error!");
     }
+    sp->timestamp = 0;
     sp->numWaveParams = num_params;
     for (int i = 0; i < num_params; ++i) {
         sp->parameters[i] = Parameter();
@@ -273,4 +876,5 @@ void SocketToPhawd::collectParameters(ParameterCollection *pc){
     for (size_t i = 0; i < numWaveParams; ++i) {
         pc->addParameter(&parameters[i]);
     }
+    pc->build();
 }
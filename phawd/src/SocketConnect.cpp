@@ -10,10 +10,179 @@
  * @brief definition of socket communication in phawd
  */
 
+#include <cerrno>
+#include <cstdlib>
+#include <algorithm>
+#if __linux__
+#include <poll.h>
+#include <sys/stat.h>
+#endif
 #include "phawd/SharedParameter.h"
 #include "phawd/SocketConnect.h"
+#include "phawd/Timestamp.h"
 using namespace phawd;
 
+/*!
+ * Waveform data is stamped right before it is sent, so the displayer can draw it at the time the robot produced it.
+ * Other kinds of data carry no timestamp.
+ */
+static void stampTimestamp(SocketToPhawd *data) {
+    data->timestamp = getTimestamp();
+}
+
+template<typename T>
+static void stampTimestamp(T *data) {}
+
+std::string phawd::getLocalSocketPath(unsigned short port) {
+#if __linux__
+    // a directory only the user can enter, not a name in /tmp any other user could take first
+    const char *runtimeDir = getenv("XDG_RUNTIME_DIR");
+    std::string dir = runtimeDir != nullptr && runtimeDir[0] == '/' ? runtimeDir
+                                                                     : "/tmp/phawd-" + std::to_string(getuid());
+    return dir + "/phawd_" + std::to_string(port) + ".sock";
+#else
+    return "phawd_" + std::to_string(port) + ".sock";
+#endif
+}
+
+bool phawd::prepareLocalSocketPath(const std::string &path) {
+#if __linux__
+    size_t slash = path.find_last_of('/');
+    if (slash != std::string::npos && slash > 0) {
+        std::string dir = path.substr(0, slash);
+        struct stat info{};
+        if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+            printf("[ERROR] prepareLocalSocketPath(): can't create %s: %s\n", dir.c_str(), strerror(errno));
+            return false;
+        }
+        // the directory may have been made by another user before us
+        if (lstat(dir.c_str(), &info) != 0 || !S_ISDIR(info.st_mode) ||
+            (info.st_uid != getuid() && info.st_uid != 0)) {
+            printf("[ERROR] prepareLocalSocketPath(): %s isn't a directory of this user\n", dir.c_str());
+            return false;
+        }
+    }
+    struct stat info{};
+    if (lstat(path.c_str(), &info) != 0) {
+        return errno == ENOENT;
+    }
+    // a socket file left by a server of this user which didn't exit cleanly would make bind fail
+    if (!S_ISSOCK(info.st_mode) || info.st_uid != getuid()) {
+        printf("[ERROR] prepareLocalSocketPath(): %s exists and isn't a socket of this user\n", path.c_str());
+        return false;
+    }
+    return unlink(path.c_str()) == 0;
+#else
+    return false;
+#endif
+}
+
+//!< records of a unix domain socket can't be received in pieces, the buffer must hold the largest one at once
+constexpr size_t LOCAL_RECORD_SIZE = 64 * 1024;
+
+//!< append data as delta to frame, false if it has to be sent whole, see encodeWaveDelta()
+static bool encodeDelta(const SocketToPhawd *data, std::vector<char> &baseline, std::vector<char> &frame) {
+    return encodeWaveDelta(data, (SocketToPhawd *)baseline.data(), baseline.size(), frame);
+}
+
+template<typename T>
+static bool encodeDelta(const T *data, std::vector<char> &baseline, std::vector<char> &frame) {
+    return false;
+}
+
+//!< fill in the header in front of the frame starting at begin of buffer, its payload reaches to the end of buffer
+static void finishFrame(std::vector<char> &buffer, size_t begin, unsigned short type, unsigned int &sequence) {
+    SocketFrameHeader header{};
+    header.init(type, (unsigned int)(buffer.size() - begin - sizeof(SocketFrameHeader)), sequence++);
+    memcpy(buffer.data() + begin, &header, sizeof(SocketFrameHeader));
+}
+
+//!< names and kinds of data differ from baseline, the last message the receiver has
+static bool needsSchema(const SocketToPhawd *data, const std::vector<char> &baseline) {
+    return baseline.empty() || !sameWaveSchema(data, (const SocketToPhawd *)baseline.data());
+}
+
+template<typename T>
+static bool needsSchema(const T *data, const std::vector<char> &baseline) {
+    return false;
+}
+
+//!< fill buffer, which holds room for one header at its start, with the FRAME_WAVE_SCHEMA of data
+static void encodeSchema(SocketToPhawd *data, const std::vector<std::string> &units, unsigned int &schema_id,
+                         unsigned int &sequence, std::vector<char> &buffer) {
+    encodeWaveSchema(data, units, ++schema_id, buffer);
+    finishFrame(buffer, 0, FRAME_WAVE_SCHEMA, sequence);
+}
+
+template<typename T>
+static void encodeSchema(T *data, const std::vector<std::string> &units, unsigned int &schema_id,
+                         unsigned int &sequence, std::vector<char> &buffer) {}
+
+/*!
+ * Append data as FRAME_TO_PHAWD_SAMPLE, preceded by a FRAME_WAVE_SCHEMA if the receiver doesn't have the schema yet
+ * or names and kinds differ from baseline. buffer holds room for one header at its start.
+ * @return false if data has no schema handshake
+ */
+static bool encodeWithSchema(SocketToPhawd *data, const std::vector<char> &baseline, bool send_schema,
+                             const std::vector<std::string> &units, unsigned int &schema_id, unsigned int &sequence,
+                             unsigned int &sample_sequence, std::vector<char> &buffer, size_t &sample_begin) {
+    sample_begin = 0;
+    if (send_schema || needsSchema(data, baseline)) {
+        encodeSchema(data, units, schema_id, sequence, buffer);
+        sample_begin = buffer.size();
+        buffer.resize(sample_begin + sizeof(SocketFrameHeader));
+    }
+    encodeWaveSample(data, schema_id, buffer);
+    finishFrame(buffer, sample_begin, FRAME_TO_PHAWD_SAMPLE, sample_sequence);
+    return true;
+}
+
+template<typename T>
+static bool encodeWithSchema(T *data, const std::vector<char> &baseline, bool send_schema,
+                             const std::vector<std::string> &units, unsigned int &schema_id, unsigned int &sequence,
+                             unsigned int &sample_sequence, std::vector<char> &buffer, size_t &sample_begin) {
+    return false;
+}
+
+//!< frame type of each kind of message
+static unsigned short frameType(const SocketToPhawd *) {
+    return FRAME_TO_PHAWD;
+}
+
+static unsigned short frameType(const SocketFromPhawd *) {
+    return FRAME_FROM_PHAWD;
+}
+
+//!< batches kept by SendBatched() while the socket is still busy with the frame before
+constexpr size_t BATCH_BACKLOG = 4;
+
+//!< append data to the entries of a batch, only values with the schema handshake, return the frame type of the entry
+static unsigned short appendBatchEntry(const SocketToPhawd *data, size_t size, bool schema, unsigned int schema_id,
+                                       std::vector<char> &batch) {
+    if (schema) {
+        encodeWaveSample(data, schema_id, batch);
+        return FRAME_TO_PHAWD_SAMPLE;
+    }
+    batch.insert(batch.end(), (const char *)data, (const char *)data + size);
+    return FRAME_TO_PHAWD;
+}
+
+template<typename T>
+static unsigned short appendBatchEntry(const T *data, size_t size, bool schema, unsigned int schema_id,
+                                       std::vector<char> &batch) {
+    batch.insert(batch.end(), (const char *)data, (const char *)data + size);
+    return frameType(data);
+}
+
+//!< the last send()/recv() failed only because the non-block socket isn't ready
+static bool wouldBlock() {
+#if _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#elif __linux__
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
 #if _WIN32
 template<typename SendData, typename ReadData>
 SocketConnect<SendData, ReadData>::SocketConnect() : socket_fd(INVALID_SOCKET), connected_fd(INVALID_SOCKET) {
@@ -77,6 +246,9 @@ void SocketConnect<SendData, ReadData>::Init(size_t sendSize, size_t readSize, b
     _readData = (ReadData *)malloc(_readSize);
     memset(_sendData, 0, _sendSize);
     memset(_readData, 0, _readSize);
+    // Send() and Read() only reuse these afterwards, a control loop doesn't allocate
+    _sendFrame.reserve(sizeof(SocketFrameHeader) + _sendSize);
+    _assembler.reserve(2 * (sizeof(SocketFrameHeader) + _readSize));
     printf("[Socket Connect] Init Success!\n");
 }
 
@@ -242,6 +414,11 @@ void SocketConnect<SendData, ReadData>::Close() {
         WSACleanup();
     }
 
+    if(_datagram_fd != INVALID_SOCKET){
+        closesocket(_datagram_fd);
+        _datagram_fd = INVALID_SOCKET;
+    }
+
     if(_sendData){
         free(_sendData);
         _sendData = nullptr;
@@ -251,6 +428,21 @@ void SocketConnect<SendData, ReadData>::Close() {
         free(_readData);
         _readData = nullptr;
     }
+    _sendFrame.clear();
+    _sendFrameOffset = 0;
+    _sendSequence = 0;
+    _assembler.clear();
+    _baseline.clear();
+    _framesSinceKeyframe = 0;
+    _schemaSent = false;
+    _datagramSequence = 0;
+    _batchFrame.clear();
+    _batchCount = 0;
+    _descriptors.clear();
+    _local = false;
+    _localPath.clear();
+    _reconnecting = false;
+    _connecting = false;
     printf("[SocketConnect] Close Success\n");
 }
 
@@ -285,6 +477,9 @@ void SocketConnect<SendData, ReadData>::Init(size_t sendSize, size_t readSize, b
     _readData = (ReadData *)malloc(_readSize);
     memset(_sendData, 0, _sendSize);
     memset(_readData, 0, _readSize);
+    // Send() and Read() only reuse these afterwards, a control loop doesn't allocate
+    _sendFrame.reserve(sizeof(SocketFrameHeader) + _sendSize);
+    _assembler.reserve(2 * (sizeof(SocketFrameHeader) + _readSize));
     printf("[SocketConnect] Init Success!\n");
 }
 
@@ -391,6 +586,11 @@ void SocketConnect<SendData, ReadData>::Close(){
         socket_fd = -1;
     }
 
+    if(_datagram_fd >= 0){
+        close(_datagram_fd);
+        _datagram_fd = -1;
+    }
+
     if(_sendData){
         free(_sendData);
         _sendData = nullptr;
@@ -400,6 +600,24 @@ void SocketConnect<SendData, ReadData>::Close(){
         free(_readData);
         _readData = nullptr;
     }
+    _sendFrame.clear();
+    _sendFrameOffset = 0;
+    _sendSequence = 0;
+    _assembler.clear();
+    _baseline.clear();
+    _framesSinceKeyframe = 0;
+    _schemaSent = false;
+    _datagramSequence = 0;
+    _batchFrame.clear();
+    _batchCount = 0;
+    for (int fd : _descriptors) {
+        ::close(fd);
+    }
+    _descriptors.clear();
+    _local = false;
+    _localPath.clear();
+    _reconnecting = false;
+    _connecting = false;
     printf("[Socket Connect] Close Success\n");
 }
 #endif
@@ -409,14 +627,351 @@ SocketConnect<SendData, ReadData>::~SocketConnect() {
     Close();
 }
 
+template<typename SendData, typename ReadData>
+void SocketConnect<SendData, ReadData>::setKeyframeInterval(unsigned int frames) {
+    _keyframeInterval = frames;
+    _framesSinceKeyframe = 0;
+}
+
+template<typename SendData, typename ReadData>
+void SocketConnect<SendData, ReadData>::setSchemaHandshake(bool enable) {
+    _schemaHandshake = enable;
+    _schemaSent = false;
+    _baseline.clear();
+    _framesSinceKeyframe = 0;
+}
+
+template<typename SendData, typename ReadData>
+bool SocketConnect<SendData, ReadData>::setWaveUnit(size_t index, const std::string &unit) {
+    if (unit.length() > 16) {
+        printf("[SocketConnect] The unit size is invalid, should be at most 16 characters\n");
+        return false;
+    }
+    if (_waveUnits.size() <= index) {
+        _waveUnits.resize(index + 1);
+    }
+    if (_waveUnits[index] != unit) {
+        _waveUnits[index] = unit;
+        _schemaSent = false;
+    }
+    return true;
+}
+
+template<typename SendData, typename ReadData>
+void SocketConnect<SendData, ReadData>::setUdpTelemetry(bool enable) {
+    _udpTelemetry = enable;
+    _framesSinceKeyframe = 0;
+}
+
+template<typename SendData, typename ReadData>
+void SocketConnect<SendData, ReadData>::setBatch(size_t samples, long long max_delay_us) {
+    _batchSamples = samples;
+    _batchDelay = max_delay_us * 1000;
+}
+
+template<typename SendData, typename ReadData>
+void SocketConnect<SendData, ReadData>::connectToLocalServer(const std::string &path) {
+#if _WIN32
+    printf("[ERROR] SocketConnect::connectToLocalServer(): unix domain sockets are not supported on windows!\n");
+    throw std::runtime_error("[ERROR] SocketConnect::connectToLocalServer(): unix domain sockets are not supported on windows!");
+#elif __linux__
+    sockaddr_un serverAddr{};
+    serverAddr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(serverAddr.sun_path)) {
+        printf("[ERROR] SocketConnect::connectToLocalServer(): invalid socket path!\n");
+        throw std::runtime_error("[ERROR] SocketConnect::connectToLocalServer(): invalid socket path!");
+    }
+    memcpy(serverAddr.sun_path, path.c_str(), path.size());
+    // Init() created a TCP socket, replace it
+    if (socket_fd > 0) {
+        close(socket_fd);
+    }
+    socket_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0);
+    if (socket_fd < 0) {
+        printf("[ERROR] SocketConnect::connectToLocalServer(): create socket error!\n");
+        throw std::runtime_error("[ERROR] SocketConnect::connectToLocalServer(): create socket error!");
+    }
+    // connecting a unix domain socket doesn't wait for the server, it is listening or not
+    if (connect(socket_fd, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) != 0) {
+        close(socket_fd);
+        socket_fd = -1;
+        printf("[ERROR] SocketConnect::connectToLocalServer(): connect error, is the server listening on %s?\n", path.c_str());
+        throw std::runtime_error("[ERROR] SocketConnect::connectToLocalServer(): connect error, is the server listening?");
+    }
+    _local = true;
+    _localPath = path;
+    printf("[SocketConnect] Connect success!\n");
+#endif
+}
+
+template<typename SendData, typename ReadData>
+void SocketConnect<SendData, ReadData>::listenToLocalClient(const std::string &path, int listenQueueLength, long int milliseconds) {
+#if _WIN32
+    printf("[ERROR] SocketConnect::listenToLocalClient(): unix domain sockets are not supported on windows!\n");
+    throw std::runtime_error("[ERROR] SocketConnect::listenToLocalClient(): unix domain sockets are not supported on windows!");
+#elif __linux__
+    sockaddr_un serverAddr{};
+    serverAddr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(serverAddr.sun_path)) {
+        printf("[ERROR] SocketConnect::listenToLocalClient(): invalid socket path!\n");
+        throw std::runtime_error("[ERROR] SocketConnect::listenToLocalClient(): invalid socket path!");
+    }
+    memcpy(serverAddr.sun_path, path.c_str(), path.size());
+    if (socket_fd > 0) {
+        close(socket_fd);
+    }
+    socket_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0);
+    if (socket_fd < 0) {
+        printf("[ERROR] SocketConnect::listenToLocalClient(): create socket error!\n");
+        throw std::runtime_error("[ERROR] SocketConnect::listenToLocalClient(): create socket error!");
+    }
+    if (!prepareLocalSocketPath(path) || bind(socket_fd, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == -1 ||
+        chmod(path.c_str(), 0600) != 0) {
+        close(socket_fd);
+        socket_fd = -1;
+        printf("[ERROR] SocketConnect::listenToLocalClient(): bind socket error!\n");
+        throw std::runtime_error("[ERROR] SocketConnect::listenToLocalClient(): bind socket error!");
+    }
+    if (listen(socket_fd, listenQueueLength) == -1) {
+        close(socket_fd);
+        socket_fd = -1;
+        printf("[ERROR] SocketConnect::listenToLocalClient(): listen socket error!\n");
+        throw std::runtime_error("[ERROR] SocketConnect::listenToLocalClient(): listen socket error!");
+    }
+
+    fd_set r_set;
+    FD_ZERO(&r_set);
+    FD_SET(socket_fd, &r_set);
+    struct timeval interval{};
+    interval.tv_sec = milliseconds;
+    interval.tv_usec = 0;
+    int n = select(socket_fd + 1, &r_set, nullptr, nullptr, &interval);
+    if (n <= 0) {
+        close(socket_fd);
+        socket_fd = -1;
+        printf("[ERROR] SocketConnect::listenToLocalClient(): listen timeout!\n");
+        throw std::runtime_error("[ERROR] SocketConnect::listenToLocalClient(): listen timeout!");
+    }
+    connected_fd = accept4(socket_fd, nullptr, nullptr, SOCK_NONBLOCK);
+    if (connected_fd < 0) {
+        printf("[ERROR] SocketConnect::listenToLocalClient(): accept error!\n");
+        throw std::runtime_error("[ERROR] SocketConnect::listenToLocalClient(): accept error!");
+    }
+    _local = true;
+    printf("[SocketConnect] Bind and Listen success!\n");
+#endif
+}
+
+template<typename SendData, typename ReadData>
+bool SocketConnect<SendData, ReadData>::sendDescriptor(int fd) {
+#if _WIN32
+    return false;
+#elif __linux__
+    int socket = isServer ? connected_fd : socket_fd;
+    // the frames left by Send() go first, the descriptor must not be attached to one of them
+    if (!_local || socket < 0 || flushFrame() != 1) {
+        return false;
+    }
+    SocketFrameHeader header{};
+    header.init(FRAME_DESCRIPTOR, 0, _sendSequence);
+    iovec iov{&header, sizeof(header)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    if (sendmsg(socket, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(header)) {
+        return false;
+    }
+    ++_sendSequence;
+    return true;
+#endif
+}
+
+template<typename SendData, typename ReadData>
+int SocketConnect<SendData, ReadData>::takeDescriptor() {
+    if (_descriptors.empty()) {
+        return -1;
+    }
+    int fd = _descriptors.front();
+    _descriptors.erase(_descriptors.begin());
+    return fd;
+}
+
+template<typename SendData, typename ReadData>
+int SocketConnect<SendData, ReadData>::receiveRecord(size_t size) {
+#if _WIN32
+    return -1;
+#elif __linux__
+    int fd = isServer ? connected_fd : socket_fd;
+    size = std::max(size, LOCAL_RECORD_SIZE);
+    iovec iov{_assembler.reserve(size), size};
+    alignas(cmsghdr) char control[CMSG_SPACE(4 * sizeof(int))];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    int count = (int)recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    if (count <= 0) {
+        return count;
+    }
+    // descriptors of a record which is dropped, or which came with more than fit, are closed instead of handed out
+    bool keep = !(msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC));
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < num; ++i) {
+                int received;
+                memcpy(&received, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                if (keep) {
+                    _descriptors.push_back(received);
+                } else {
+                    ::close(received);
+                }
+            }
+        }
+    }
+    if (msg.msg_flags & MSG_CTRUNC) {
+        printf("[ERROR] SocketConnect::Read(), more descriptors than fit were attached, all of them were closed\n");
+    }
+    if (msg.msg_flags & MSG_TRUNC) {
+        // the rest of the record is gone, taking the part would misalign the frames after it
+        printf("[ERROR] SocketConnect::Read(), a record larger than %zu bytes was dropped\n", size);
+        return count;
+    }
+    _assembler.commit(count);
+    return count;
+#endif
+}
+
+template<typename SendData, typename ReadData>
+int SocketConnect<SendData, ReadData>::sendDatagram() {
+    size_t size = _datagramFrame.size();
+    if (size > 65507) {
+        printf("[ERROR] SocketConnect::Send(), %zu bytes are too large for a UDP datagram\n", size);
+        return -1;
+    }
+#if _WIN32
+    if (_datagram_fd == INVALID_SOCKET) {
+        _datagram_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        unsigned long mode = 1;
+        if (_datagram_fd == INVALID_SOCKET || ioctlsocket(_datagram_fd, FIONBIO, &mode) != 0) {
+            printf("[ERROR] SocketConnect::Send(), Create UDP socket failed!\n");
+            return -1;
+        }
+        // phawd tells the datagrams of several clients on one host apart by the port of their TCP connection
+        SOCKADDR_IN local{};
+        int length = sizeof(local);
+        if (getsockname(socket_fd, (LPSOCKADDR)&local, &length) == 0) {
+            bind(_datagram_fd, (LPSOCKADDR)&local, length);
+        }
+    }
+    int nRet = sendto(_datagram_fd, _datagramFrame.data(), (int)size, 0, (LPSOCKADDR)&_clientAddr, sizeof(SOCKADDR_IN));
+#elif __linux__
+    if (_datagram_fd < 0) {
+        _datagram_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if (_datagram_fd < 0) {
+            printf("[ERROR] SocketConnect::Send(), Create UDP socket failed!\n");
+            return -1;
+        }
+        // phawd tells the datagrams of several clients on one host apart by the port of their TCP connection
+        struct sockaddr_in local{};
+        socklen_t length = sizeof(local);
+        if (getsockname(socket_fd, (struct sockaddr*)&local, &length) == 0) {
+            bind(_datagram_fd, (struct sockaddr*)&local, length);
+        }
+    }
+    int nRet = (int)sendto(_datagram_fd, _datagramFrame.data(), size, 0, (struct sockaddr*)&_clientAddr, sizeof(_clientAddr));
+#endif
+    if (nRet < 0) {
+        // a full send buffer drops the datagram, just like the network may do
+        return wouldBlock() ? 0 : -1;
+    }
+    return 1;
+}
+
+template<typename SendData, typename ReadData>
+bool SocketConnect<SendData, ReadData>::isOpen() const {
+#if _WIN32
+    return isServer ? connected_fd != INVALID_SOCKET : socket_fd != INVALID_SOCKET;
+#elif __linux__
+    return isServer ? connected_fd > 0 : socket_fd > 0;
+#endif
+}
+
+template<typename SendData, typename ReadData>
+int SocketConnect<SendData, ReadData>::flushFrame() {
+#if _WIN32
+    SOCKET fd = isServer ? connected_fd : socket_fd;
+    int flags = 0;
+#elif __linux__
+    int fd = isServer ? connected_fd : socket_fd;
+    int flags = MSG_NOSIGNAL;   // a closed peer is reported by the return value, not by SIGPIPE
+#endif
+    while (_sendFrameOffset < _sendFrame.size()) {
+        int nRet = send(fd, _sendFrame.data() + _sendFrameOffset, (int)(_sendFrame.size() - _sendFrameOffset), flags);
+        if (nRet <= 0) {
+            return nRet < 0 && wouldBlock() ? 0 : -1;
+        }
+        _sendFrameOffset += nRet;
+    }
+    return 1;
+}
+
+template<typename SendData, typename ReadData>
+int SocketConnect<SendData, ReadData>::sendDirect(unsigned short type, unsigned int &sequence) {
+    SocketFrameHeader header{};
+    header.init(type, (unsigned int)_sendSize, sequence++);
+    size_t size = sizeof(SocketFrameHeader) + _sendSize;
+#if _WIN32
+    SOCKET fd = isServer ? connected_fd : socket_fd;
+    WSABUF buffers[2] = {{(ULONG)sizeof(SocketFrameHeader), (char *)&header}, {(ULONG)_sendSize, (char *)_sendData}};
+    DWORD bytes = 0;
+    int nRet = WSASend(fd, buffers, 2, &bytes, 0, nullptr, nullptr) == 0 ? (int)bytes : -1;
+#elif __linux__
+    int fd = isServer ? connected_fd : socket_fd;
+    iovec buffers[2] = {{&header, sizeof(SocketFrameHeader)}, {_sendData, _sendSize}};
+    msghdr msg{};
+    msg.msg_iov = buffers;
+    msg.msg_iovlen = 2;
+    int nRet = (int)sendmsg(fd, &msg, MSG_NOSIGNAL);
+#endif
+    if (nRet < 0 && !wouldBlock()) {
+        return -1;
+    }
+    size_t sent = nRet > 0 ? (size_t)nRet : 0;
+    if (sent == size) {
+        _sendFrame.clear();
+        _sendFrameOffset = 0;
+        return 1;
+    }
+    // the socket buffer is full, the frame is kept like any other and the rest goes out with the next calls
+    _sendFrame.resize(size);
+    memcpy(_sendFrame.data(), &header, sizeof(SocketFrameHeader));
+    memcpy(_sendFrame.data() + sizeof(SocketFrameHeader), _sendData, _sendSize);
+    _sendFrameOffset = sent;
+    return 0;
+}
+
 template<typename SendData, typename ReadData>
 int SocketConnect<SendData, ReadData>::Send(bool verbose){
     if ( _sendSize <= 0 || _sendData == nullptr ) {
         printf("[ERROR] SocketConnect::Send() failed, Init first \n");
         return -1;
     }
-    char *sendBuff = new char[_sendSize];
-    memcpy(sendBuff ,_sendData, _sendSize);
+    if (_reconnecting && !resumeConnection()) {
+        return -1;
+    }
+    if (_stampTimestamp) {
+        stampTimestamp(_sendData);
+    }
     int nRet = 0;
     bool judge1 = false;
     bool judge2 = false;
@@ -429,81 +984,427 @@ int SocketConnect<SendData, ReadData>::Send(bool verbose){
     judge2 = socket_fd > 0;
 #endif
 
-    if (isServer) {
-        if(judge1) {
-            nRet = send(connected_fd, sendBuff, _sendSize, 0);
-            if (nRet <= 0){
-                if (verbose){
-                    printf("[SocketConnect] Send failed! \n");
+    if ((isServer && judge1) || (!isServer && judge2)) {
+        // messages added by SendBatched() are older and go first, then the frame left by the last call,
+        // the receiver can only cut the stream at frame boundaries
+        if (_batchCount > 0) {
+            FlushBatch(verbose);
+        }
+        int flushed = flushFrame();
+        if (flushed == 1) {
+            bool datagram = _udpTelemetry && !isServer && !_local;
+            unsigned int &dataSequence = datagram ? _datagramSequence : _sendSequence;
+            size_t dataBegin = 0;   // the frame of the message itself, frames before it are schema
+            bool direct = false;    // a whole message is sent straight from _sendData
+            _sendFrame.resize(sizeof(SocketFrameHeader));
+            if (!datagram && _framesSinceKeyframe > 0 && _framesSinceKeyframe < _keyframeInterval
+                && _baseline.size() == _sendSize && encodeDelta(_sendData, _baseline, _sendFrame)) {
+                finishFrame(_sendFrame, 0, FRAME_TO_PHAWD_DELTA, _sendSequence);
+                ++_framesSinceKeyframe;
+            } else {
+                if (_schemaHandshake && encodeWithSchema(_sendData, _baseline, !_schemaSent, _waveUnits, _schemaId,
+                                                         _sendSequence, dataSequence, _sendFrame, dataBegin)) {
+                    _schemaSent = true;
+                } else if (!datagram) {
+                    direct = true;
+                } else {
+                    _sendFrame.resize(sizeof(SocketFrameHeader) + _sendSize);
+                    memcpy(_sendFrame.data() + sizeof(SocketFrameHeader), _sendData, _sendSize);
+                    finishFrame(_sendFrame, 0, frameType(_sendData), dataSequence);
+                }
+                if (_keyframeInterval > 1 || _schemaHandshake) {
+                    _baseline.assign((const char *)_sendData, (const char *)_sendData + _sendSize);
+                    _framesSinceKeyframe = 1;
                 }
-                nRet = -1;
             }
-        }
-    } else {
-        if(judge2){
-            nRet = send(socket_fd, sendBuff, _sendSize, 0);
-            if (nRet <= 0){
-                if (verbose){
-                    printf("[SocketConnect] Send failed! \n");
+            if (direct) {
+                nRet = (int)(sizeof(SocketFrameHeader) + _sendSize);
+                flushed = sendDirect(frameType(_sendData), dataSequence);
+            } else {
+                nRet = (int)_sendFrame.size();
+                if (datagram) {
+                    // the schema has to arrive and stays on TCP, the message itself is never retransmitted
+                    _datagramFrame.assign(_sendFrame.begin() + (long)dataBegin, _sendFrame.end());
+                    _sendFrame.resize(dataBegin);
+                }
+                _sendFrameOffset = 0;
+                flushed = flushFrame();
+            }
+            if (datagram && flushed >= 0) {
+                int sent = sendDatagram();
+                if (sent < 0) {
+                    flushed = -1;
+                } else if (sent == 0) {
+                    nRet = -1;
                 }
-                nRet = -1;
             }
+        } else if (flushed == 0) {
+            if (verbose){
+                printf("[SocketConnect] Send dropped, the last frame is still being sent! \n");
+            }
+            nRet = -1;
+        }
+        if (flushed < 0) {
+            if (verbose){
+                printf("[SocketConnect] Send failed! \n");
+            }
+            nRet = -1;
+            dropConnection();
         }
     }
 
-    delete []sendBuff;
-    sendBuff = nullptr;
     if (verbose){
         printf("[SocketConnect] Send Finished! \n");
     }
     return nRet;
 }
 
+template<typename SendData, typename ReadData>
+int SocketConnect<SendData, ReadData>::SendBatched(bool verbose) {
+    if (_batchSamples <= 1 || _sendData == nullptr || frameType(_sendData) != FRAME_TO_PHAWD) {
+        return Send(verbose);
+    }
+    if (_stampTimestamp) {
+        stampTimestamp(_sendData);
+    }
+    if (_reconnecting && !resumeConnection()) {
+        return -1;
+    }
+    if (!isOpen()) {
+        return -1;
+    }
+    // the receiver can't tell how far the batch moved it, so the next Send() has to be a whole message
+    _framesSinceKeyframe = 0;
+    unsigned short entryType = _schemaHandshake ? FRAME_TO_PHAWD_SAMPLE : FRAME_TO_PHAWD;
+    bool schema = _schemaHandshake && (!_schemaSent || needsSchema(_sendData, _baseline));
+    if (_batchCount > 0 && (schema || entryType != _batchEntryType || _batchCount >= BATCH_BACKLOG * _batchSamples)) {
+        // messages of the old schema have to arrive before the new one, which can't be applied to them
+        FlushBatch(verbose);
+        if (_batchCount > 0) {
+            if (verbose) {
+                printf("[SocketConnect] Send dropped, the last batch is still waiting to be sent! \n");
+            }
+            return -1;
+        }
+    }
+    if (schema) {
+        int flushed = flushFrame();
+        if (flushed != 1) {
+            if (flushed < 0) {
+                dropConnection();
+            }
+            return -1;
+        }
+        _sendFrame.resize(sizeof(SocketFrameHeader));
+        encodeSchema(_sendData, _waveUnits, _schemaId, _sendSequence, _sendFrame);
+        _sendFrameOffset = 0;
+        _schemaSent = true;
+        _baseline.assign((const char *)_sendData, (const char *)_sendData + _sendSize);
+        if (flushFrame() < 0) {
+            dropConnection();
+            return -1;
+        }
+    }
+
+    if (_batchCount == 0) {
+        // _batchFrame and _sendFrame take turns, both hold the largest batch once reserved
+        size_t capacity = sizeof(SocketFrameHeader) + sizeof(SocketBatchHeader) + BATCH_BACKLOG * _batchSamples * _sendSize;
+        _batchFrame.reserve(capacity);
+        _sendFrame.reserve(capacity);
+        _batchFrame.resize(sizeof(SocketFrameHeader) + sizeof(SocketBatchHeader));
+        _batchStarted = getTimestamp();
+    }
+    size_t entryBegin = _batchFrame.size();
+    _batchEntryType = appendBatchEntry(_sendData, _sendSize, _schemaHandshake, _schemaId, _batchFrame);
+    _batchEntrySize = (unsigned int)(_batchFrame.size() - entryBegin);
+    ++_batchCount;
+
+    if (_batchCount >= _batchSamples || (_batchDelay > 0 && getTimestamp() - _batchStarted >= _batchDelay)) {
+        return FlushBatch(verbose);
+    }
+    return 0;
+}
+
+template<typename SendData, typename ReadData>
+int SocketConnect<SendData, ReadData>::FlushBatch(bool verbose) {
+    if (_batchCount == 0) {
+        return 0;
+    }
+    int flushed = isOpen() ? flushFrame() : -1;
+    if (flushed <= 0) {
+        // the batch stays, the next call tries again
+        if (verbose) {
+            printf(flushed == 0 ? "[SocketConnect] Batch delayed, the last frame is still being sent! \n"
+                                : "[SocketConnect] Send failed! \n");
+        }
+        if (flushed < 0) {
+            dropConnection();
+        }
+        return flushed;
+    }
+    SocketBatchHeader batch{};
+    batch.numSamples = _batchCount;
+    batch.sampleSize = _batchEntrySize;
+    batch.sampleType = _batchEntryType;
+    memcpy(_batchFrame.data() + sizeof(SocketFrameHeader), &batch, sizeof(SocketBatchHeader));
+    finishFrame(_batchFrame, 0, FRAME_TO_PHAWD_BATCH, _sendSequence);
+    _sendFrame.swap(_batchFrame);
+    _sendFrameOffset = 0;
+    _batchCount = 0;
+    int nRet = (int)_sendFrame.size();
+    if (flushFrame() < 0) {
+        if (verbose) {
+            printf("[SocketConnect] Send failed! \n");
+        }
+        dropConnection();
+        return -1;
+    }
+    return nRet;
+}
+
+template<typename SendData, typename ReadData>
+void SocketConnect<SendData, ReadData>::setReconnect(bool enable, long long min_backoff_ms, long long max_backoff_ms) {
+    _reconnect = enable;
+    _minBackoff = std::max(min_backoff_ms, 1LL) * 1000000;
+    _maxBackoff = std::max(max_backoff_ms * 1000000, _minBackoff);
+    _backoff = _minBackoff;
+}
+
+template<typename SendData, typename ReadData>
+bool SocketConnect<SendData, ReadData>::isConnected() const {
+    return isOpen() && !_reconnecting;
+}
+
+template<typename SendData, typename ReadData>
+void SocketConnect<SendData, ReadData>::dropConnection() {
+    if (!_reconnect || isServer || _reconnecting) {
+        return;
+    }
+#if _WIN32
+    if (socket_fd != INVALID_SOCKET) {
+        closesocket(socket_fd);
+        socket_fd = INVALID_SOCKET;
+    }
+    // the UDP socket is bound to the port of the TCP connection, the next one gets another port
+    if (_datagram_fd != INVALID_SOCKET) {
+        closesocket(_datagram_fd);
+        _datagram_fd = INVALID_SOCKET;
+    }
+#elif __linux__
+    if (socket_fd > 0) {
+        close(socket_fd);
+        socket_fd = -1;
+    }
+    // the UDP socket is bound to the port of the TCP connection, the next one gets another port
+    if (_datagram_fd >= 0) {
+        close(_datagram_fd);
+        _datagram_fd = -1;
+    }
+    for (int fd : _descriptors) {
+        ::close(fd);
+    }
+    _descriptors.clear();
+#endif
+    // nothing of the old session is valid on the new connection, the buffers keep their capacity
+    _sendFrame.clear();
+    _sendFrameOffset = 0;
+    _assembler.clear();
+    _baseline.clear();
+    _framesSinceKeyframe = 0;
+    _schemaSent = false;
+    _batchCount = 0;
+    _reconnecting = true;
+    _connecting = false;
+    _backoff = _minBackoff;
+    _reconnectAt = getTimestamp() + _backoff;
+    printf("[SocketConnect] Connection lost, connecting again\n");
+}
+
+template<typename SendData, typename ReadData>
+bool SocketConnect<SendData, ReadData>::resumeConnection() {
+    long long now = getTimestamp();
+    bool connected = false;
+    bool failed = false;
+#if _WIN32
+    if (!_connecting) {
+        if (now < _reconnectAt) {
+            return false;
+        }
+        socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+        unsigned long mode = 1;
+        if (socket_fd == INVALID_SOCKET || ioctlsocket(socket_fd, FIONBIO, &mode) != 0) {
+            failed = true;
+        } else if (connect(socket_fd, (LPSOCKADDR)&_clientAddr, sizeof(SOCKADDR_IN)) == 0) {
+            connected = true;
+        } else if (WSAGetLastError() == WSAEWOULDBLOCK) {
+            _connecting = true;
+            _reconnectAt = now + _maxBackoff;
+        } else {
+            failed = true;
+        }
+    } else {
+        fd_set w_set, e_set;
+        FD_ZERO(&w_set);
+        FD_ZERO(&e_set);
+        FD_SET(socket_fd, &w_set);
+        FD_SET(socket_fd, &e_set);
+        struct timeval interval{};
+        int n = select(0, nullptr, &w_set, &e_set, &interval);
+        if (n < 0 || FD_ISSET(socket_fd, &e_set)) {
+            failed = true;
+        } else if (n > 0) {
+            connected = true;
+        } else if (now >= _reconnectAt) {
+            failed = true;
+        }
+    }
+    if (failed && socket_fd != INVALID_SOCKET) {
+        closesocket(socket_fd);
+        socket_fd = INVALID_SOCKET;
+    }
+#elif __linux__
+    if (!_connecting) {
+        if (now < _reconnectAt) {
+            return false;
+        }
+        int result;
+        if (_local) {
+            sockaddr_un serverAddr{};
+            serverAddr.sun_family = AF_UNIX;
+            memcpy(serverAddr.sun_path, _localPath.c_str(), _localPath.size());
+            socket_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0);
+            result = socket_fd < 0 ? -1 : connect(socket_fd, (struct sockaddr*)&serverAddr, sizeof(serverAddr));
+        } else {
+            socket_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+            result = socket_fd < 0 ? -1 : connect(socket_fd, (struct sockaddr*)&_clientAddr, sizeof(_clientAddr));
+        }
+        if (result == 0) {
+            connected = true;
+        } else if (socket_fd >= 0 && errno == EINPROGRESS) {
+            // the handshake goes on in the kernel, the next calls check whether it finished
+            _connecting = true;
+            _reconnectAt = now + _maxBackoff;
+        } else {
+            failed = true;
+        }
+    } else {
+        pollfd p{socket_fd, POLLOUT, 0};
+        int n = poll(&p, 1, 0);
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (n < 0 || (n > 0 && (getsockopt(socket_fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0))) {
+            failed = true;
+        } else if (n > 0) {
+            connected = true;
+        } else if (now >= _reconnectAt) {
+            failed = true;
+        }
+    }
+    if (failed && socket_fd >= 0) {
+        close(socket_fd);
+        socket_fd = -1;
+    }
+#endif
+    if (failed) {
+        _connecting = false;
+        _reconnectAt = now + _backoff;
+        _backoff = std::min(_backoff * 2, _maxBackoff);
+        return false;
+    }
+    if (!connected) {
+        return false;
+    }
+    _connecting = false;
+    _reconnecting = false;
+    _backoff = _minBackoff;
+    _sendSequence = 0;
+    _datagramSequence = 0;
+    printf("[SocketConnect] Connect success!\n");
+    return true;
+}
+
+template<typename SendData, typename ReadData>
+void SocketConnect<SendData, ReadData>::setStampTimestamp(bool enable) {
+    _stampTimestamp = enable;
+}
+
+#if _WIN32
+template<typename SendData, typename ReadData>
+SOCKET SocketConnect<SendData, ReadData>::getDescriptor() const {
+    return isServer ? connected_fd : socket_fd;
+}
+#elif __linux__
+template<typename SendData, typename ReadData>
+int SocketConnect<SendData, ReadData>::getDescriptor() const {
+    return isServer ? connected_fd : socket_fd;
+}
+#endif
+
 template<typename SendData, typename ReadData>
 int SocketConnect<SendData, ReadData>::Read(bool verbose){
     if (_readSize <= 0 || _readData == nullptr){
         printf("[ERROR] SocketConnect::Read() failed, Init first \n");
         return -1;
     }
+    if (_reconnecting && !resumeConnection()) {
+        return -1;
+    }
 
-    char *readBuff = new char[_readSize];
-    int nRet = 0;
+    int nRet = -1;
     bool judge1 = false;
     bool judge2 = false;
 #if _WIN32
     judge1 = connected_fd != INVALID_SOCKET;
     judge2 = socket_fd != INVALID_SOCKET;
-
+    SOCKET fd = isServer ? connected_fd : socket_fd;
 #elif __linux__
     judge1 = connected_fd > 0;
     judge2 = socket_fd > 0;
+    int fd = isServer ? connected_fd : socket_fd;
 #endif
-    if (isServer) {
-        if(judge1){
-            nRet = recv(connected_fd, readBuff, _readSize, 0);
-            if (nRet <= 0){
-                if (verbose){
-                    printf("[SocketConnect] Read failed! \n");
+    if ((isServer && judge1) || (!isServer && judge2)) {
+        // take everything the kernel holds, it may be a piece of a frame or several frames
+        size_t chunk = sizeof(SocketFrameHeader) + _readSize;
+        for (;;) {
+            int count;
+            if (_local) {
+                count = receiveRecord(chunk);
+            } else {
+                count = recv(fd, _assembler.reserve(chunk), (int)chunk, 0);
+                if (count > 0) {
+                    _assembler.commit(count);
                 }
-                nRet = -1;
             }
-        }
-    } else {
-        if(judge2){
-            nRet = recv(socket_fd, readBuff, _readSize, 0);
-            if (nRet <= 0){
+            bool closed = false;
+            if (count <= 0) {
+                if (count != 0 && wouldBlock()) {
+                    break;
+                }
+                closed = true;
+            }
+            // frames are taken out after every chunk, so the buffer never holds more than a chunk and a partial frame
+            SocketFrameHeader header{};
+            const char *payload = nullptr;
+            while (_assembler.next(header, payload)) {
+                // unknown frames are skipped, so that newer senders can add types
+                if (header.type == frameType(_readData) && header.length == _readSize) {
+                    memcpy(_readData, payload, _readSize);
+                    nRet = (int)_readSize;
+                }
+            }
+            if (closed) {
                 if (verbose){
                     printf("[SocketConnect] Read failed! \n");
                 }
-                nRet = -1;
+                dropConnection();
+                // frames which arrived before the peer closed are still handed out, the next Read() reports it
+                return nRet > 0 ? nRet : -1;
+            }
+            if (!_local && (size_t)count < chunk) {
+                break;
             }
         }
     }
-    if (nRet > 0){
-        memcpy(_readData, readBuff, _readSize);
-    }
-    delete []readBuff;
-    readBuff = nullptr;
     if (verbose){
         printf("[SocketConnect] Read Finished! \n");
     }
@@ -0,0 +1,388 @@
+/*!
+ * PHAWD - Parameters Handler and Waveform Display
+ * Licensed under the GNU GPLv3 license. See LICENSE for more details.
+ * @author HuNing-He
+ * @date 2026-10-16
+ * @version 0.3
+ * @email 2689112371@qq.com
+ * @copyright (c) 2022 HuNing-He
+ * @file SocketFrame.cpp
+ */
+
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include "phawd/SocketFrame.h"
+#include "phawd/SharedParameter.h"
+using namespace phawd;
+
+void SocketFrameHeader::init(unsigned short frame_type, unsigned int frame_length, unsigned int frame_sequence) {
+    magic = SOCKET_FRAME_MAGIC;
+    length = frame_length;
+    type = frame_type;
+    flags = 0;
+    sequence = frame_sequence;
+}
+
+FrameAssembler::FrameAssembler(unsigned int max_length) : m_maxLength(max_length) {}
+
+char *FrameAssembler::reserve(size_t size) {
+    if (m_begin == m_end) {
+        m_begin = 0;
+        m_end = 0;
+    }
+    if (m_buffer.size() - m_end < size) {
+        // move the partial frame to the front before growing, the buffer settles at a few frames
+        if (m_begin > 0) {
+            std::memmove(m_buffer.data(), m_buffer.data() + m_begin, m_end - m_begin);
+            m_end -= m_begin;
+            m_begin = 0;
+        }
+        if (m_buffer.size() - m_end < size) {
+            m_buffer.resize(m_end + size);
+        }
+    }
+    return m_buffer.data() + m_end;
+}
+
+void FrameAssembler::commit(size_t size) {
+    m_end += size;
+}
+
+void FrameAssembler::append(const void *data, size_t size) {
+    std::memcpy(reserve(size), data, size);
+    commit(size);
+}
+
+bool FrameAssembler::next(SocketFrameHeader &header, const char *&payload) {
+    while (m_end - m_begin >= sizeof(SocketFrameHeader)) {
+        std::memcpy(&header, m_buffer.data() + m_begin, sizeof(SocketFrameHeader));
+        if (header.magic != SOCKET_FRAME_MAGIC || header.length > m_maxLength) {
+            // not at a header, skip to the next byte that may start one
+            ++m_begin;
+            ++m_skipped;
+            continue;
+        }
+        if (m_end - m_begin < sizeof(SocketFrameHeader) + header.length) {
+            return false;
+        }
+        payload = m_buffer.data() + m_begin + sizeof(SocketFrameHeader);
+        m_begin += sizeof(SocketFrameHeader) + header.length;
+        return true;
+    }
+    return false;
+}
+
+void FrameAssembler::clear() {
+    m_begin = 0;
+    m_end = 0;
+}
+
+size_t FrameAssembler::pending() const {
+    return m_end - m_begin;
+}
+
+unsigned long long FrameAssembler::skipped() const {
+    return m_skipped;
+}
+
+bool SequenceTracker::accept(unsigned int sequence) {
+    ++m_received;
+    if (!m_started) {
+        m_started = true;
+        m_next = sequence + 1;
+        m_missing = 0;
+        return true;
+    }
+    // the difference is taken as signed, so that the wrap around of the sequence counts as going forward
+    auto ahead = (int)(sequence - m_next);
+    if (ahead >= 0) {
+        m_lost += (unsigned int)ahead;
+        m_next = sequence + 1;
+        // sequence takes bit 0, the ahead frames skipped before it the bits above
+        m_missing = ahead < 63 ? m_missing << (ahead + 1) : 0;
+        m_missing |= ahead < 63 ? ((1ULL << ahead) - 1) << 1 : ~1ULL;
+        return true;
+    }
+    auto behind = (unsigned int)(m_next - 1 - sequence);
+    if (behind < 64 && (m_missing & (1ULL << behind))) {
+        m_missing &= ~(1ULL << behind);
+        ++m_reordered;
+        --m_lost;
+    } else {
+        ++m_duplicated;
+    }
+    return false;
+}
+
+void SequenceTracker::clear() {
+    m_started = false;
+    m_next = 0;
+    m_missing = 0;
+    m_received = 0;
+    m_lost = 0;
+    m_reordered = 0;
+    m_duplicated = 0;
+}
+
+unsigned long long SequenceTracker::received() const {
+    return m_received;
+}
+
+unsigned long long SequenceTracker::lost() const {
+    return m_lost;
+}
+
+unsigned long long SequenceTracker::reordered() const {
+    return m_reordered;
+}
+
+unsigned long long SequenceTracker::duplicated() const {
+    return m_duplicated;
+}
+
+//!< bytes of a value of kind on the wire, 0 for an unknown kind. S64 is always sent as int64_t, long int is only
+//!< 4 bytes on windows
+static size_t valueSize(ParameterKind kind) {
+    switch (kind) {
+        case ParameterKind::FLOAT:
+            return sizeof(float);
+        case ParameterKind::DOUBLE:
+            return sizeof(double);
+        case ParameterKind::S64:
+            return sizeof(int64_t);
+        case ParameterKind::VEC3_FLOAT:
+            return 3 * sizeof(float);
+        case ParameterKind::VEC3_DOUBLE:
+            return 3 * sizeof(double);
+        default:
+            return 0;
+    }
+}
+
+//!< write the valueSize(kind) bytes of value to out
+static void writeWireValue(ParameterKind kind, const ParameterValue &value, char *out) {
+    if (kind == ParameterKind::S64) {
+        auto i = (int64_t)value.i;
+        std::memcpy(out, &i, sizeof(i));
+    } else {
+        std::memcpy(out, &value, valueSize(kind));
+    }
+}
+
+//!< read a value written by writeWireValue()
+static void readWireValue(ParameterKind kind, const char *in, ParameterValue &value) {
+    if (kind == ParameterKind::S64) {
+        int64_t i;
+        std::memcpy(&i, in, sizeof(i));
+        value.i = (long int)i;
+    } else {
+        std::memcpy(&value, in, valueSize(kind));
+    }
+}
+
+bool phawd::encodeWaveDelta(const SocketToPhawd *current, SocketToPhawd *baseline, size_t message_size,
+                            std::vector<char> &frame) {
+    size_t count = current->numWaveParams;
+    if (count != baseline->numWaveParams || count > 0xFFFF) {
+        return false;
+    }
+    const size_t begin = frame.size();
+    SocketDeltaHeader delta{};
+    delta.timestamp = current->timestamp;
+    delta.numWaveParams = (unsigned int)count;
+    frame.resize(begin + sizeof(SocketDeltaHeader));
+
+    for (size_t i = 0; i < count; ++i) {
+        const Parameter &param = current->parameters[i];
+        Parameter &sent = baseline->parameters[i];
+        if (!param.sameName(sent)) {
+            frame.resize(begin);
+            return false;
+        }
+        ParameterValue value, sentValue;
+        ParameterKind kind = param.readValue(value);
+        ParameterKind sentKind = sent.readValue(sentValue);
+        size_t size = valueSize(kind);
+        char bytes[3 * sizeof(double)], sentBytes[3 * sizeof(double)];
+        writeWireValue(kind, value, bytes);
+        writeWireValue(sentKind, sentValue, sentBytes);
+        if (kind == sentKind && std::memcmp(bytes, sentBytes, size) == 0) {
+            continue;
+        }
+        if (frame.size() - begin + 2 * sizeof(unsigned short) + size >= message_size) {
+            frame.resize(begin);
+            return false;
+        }
+        unsigned short entry[2] = {(unsigned short)i, (unsigned short)kind};
+        size_t offset = frame.size();
+        frame.resize(offset + sizeof(entry) + size);
+        std::memcpy(frame.data() + offset, entry, sizeof(entry));
+        std::memcpy(frame.data() + offset + sizeof(entry), bytes, size);
+        sent.writeValue(kind, value);
+        ++delta.numChanges;
+    }
+    std::memcpy(frame.data() + begin, &delta, sizeof(SocketDeltaHeader));
+    return true;
+}
+
+bool phawd::applyWaveDelta(SocketToPhawd *data, const char *payload, size_t length) {
+    SocketDeltaHeader delta{};
+    if (length < sizeof(SocketDeltaHeader)) {
+        return false;
+    }
+    std::memcpy(&delta, payload, sizeof(SocketDeltaHeader));
+    if (delta.numWaveParams != data->numWaveParams) {
+        return false;
+    }
+    // check the whole delta first, a malformed one must not leave half of the parameters updated
+    const char *end = payload + length;
+    for (int pass = 0; pass < 2; ++pass) {
+        const char *entry = payload + sizeof(SocketDeltaHeader);
+        for (unsigned int i = 0; i < delta.numChanges; ++i) {
+            unsigned short index_kind[2];
+            if ((size_t)(end - entry) < sizeof(index_kind)) {
+                return false;
+            }
+            std::memcpy(index_kind, entry, sizeof(index_kind));
+            auto kind = (ParameterKind)index_kind[1];
+            size_t size = valueSize(kind);
+            entry += sizeof(index_kind);
+            if (index_kind[0] >= delta.numWaveParams || size == 0 || (size_t)(end - entry) < size) {
+                return false;
+            }
+            if (pass == 1) {
+                ParameterValue value;
+                readWireValue(kind, entry, value);
+                data->parameters[index_kind[0]].writeValue(kind, value);
+            }
+            entry += size;
+        }
+        if (entry != end) {
+            return false;
+        }
+    }
+    data->timestamp = delta.timestamp;
+    return true;
+}
+
+bool phawd::sameWaveSchema(const SocketToPhawd *a, const SocketToPhawd *b) {
+    if (a->numWaveParams != b->numWaveParams) {
+        return false;
+    }
+    for (size_t i = 0; i < a->numWaveParams; ++i) {
+        ParameterValue value;
+        if (!a->parameters[i].sameName(b->parameters[i]) ||
+            a->parameters[i].readValue(value) != b->parameters[i].readValue(value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void phawd::encodeWaveSchema(SocketToPhawd *data, const std::vector<std::string> &units,
+                             unsigned int schema_id, std::vector<char> &frame) {
+    SocketSchemaHeader schema{};
+    schema.numWaveParams = (unsigned int)data->numWaveParams;
+    schema.schemaId = schema_id;
+    size_t offset = frame.size();
+    frame.resize(offset + sizeof(SocketSchemaHeader) + data->numWaveParams * sizeof(SocketChannelSchema));
+    std::memcpy(frame.data() + offset, &schema, sizeof(SocketSchemaHeader));
+    offset += sizeof(SocketSchemaHeader);
+
+    for (size_t i = 0; i < data->numWaveParams; ++i) {
+        // getName() allocates, but a schema is only sent once per session
+        Parameter &param = data->parameters[i];
+        SocketChannelSchema channel{};
+        std::string name = param.getName();
+        std::memcpy(channel.name, name.data(), std::min(name.size(), sizeof(channel.name)));
+        if (i < units.size()) {
+            std::memcpy(channel.unit, units[i].data(), std::min(units[i].size(), sizeof(channel.unit)));
+        }
+        ParameterValue value;
+        channel.kind = (unsigned short)param.readValue(value);
+        std::memcpy(frame.data() + offset, &channel, sizeof(SocketChannelSchema));
+        offset += sizeof(SocketChannelSchema);
+    }
+}
+
+bool phawd::applyWaveSchema(SocketToPhawd *data, size_t max_params, const char *payload, size_t length,
+                            unsigned int &schema_id, std::vector<std::string> &units) {
+    SocketSchemaHeader schema{};
+    if (length < sizeof(SocketSchemaHeader)) {
+        return false;
+    }
+    std::memcpy(&schema, payload, sizeof(SocketSchemaHeader));
+    if (schema.numWaveParams > max_params ||
+        length != sizeof(SocketSchemaHeader) + schema.numWaveParams * sizeof(SocketChannelSchema)) {
+        return false;
+    }
+    const char *channels = payload + sizeof(SocketSchemaHeader);
+    for (unsigned int i = 0; i < schema.numWaveParams; ++i) {
+        SocketChannelSchema channel{};
+        std::memcpy(&channel, channels + i * sizeof(SocketChannelSchema), sizeof(SocketChannelSchema));
+        if (valueSize((ParameterKind)channel.kind) == 0 || channel.name[0] == '\0') {
+            return false;
+        }
+    }
+
+    units.resize(schema.numWaveParams);
+    for (unsigned int i = 0; i < schema.numWaveParams; ++i) {
+        SocketChannelSchema channel{};
+        std::memcpy(&channel, channels + i * sizeof(SocketChannelSchema), sizeof(SocketChannelSchema));
+        data->parameters[i].setName(std::string(channel.name, strnlen(channel.name, sizeof(channel.name))));
+        data->parameters[i].writeValue((ParameterKind)channel.kind, ParameterValue());
+        units[i].assign(channel.unit, strnlen(channel.unit, sizeof(channel.unit)));
+    }
+    data->numWaveParams = schema.numWaveParams;
+    schema_id = schema.schemaId;
+    return true;
+}
+
+void phawd::encodeWaveSample(const SocketToPhawd *data, unsigned int schema_id, std::vector<char> &frame) {
+    SocketSampleHeader sample{};
+    sample.timestamp = data->timestamp;
+    sample.schemaId = schema_id;
+    size_t offset = frame.size();
+    frame.resize(offset + sizeof(SocketSampleHeader) + data->numWaveParams * sizeof(ParameterValue));
+    std::memcpy(frame.data() + offset, &sample, sizeof(SocketSampleHeader));
+    offset += sizeof(SocketSampleHeader);
+
+    for (size_t i = 0; i < data->numWaveParams; ++i) {
+        ParameterValue value;
+        ParameterKind kind = data->parameters[i].readValue(value);
+        writeWireValue(kind, value, frame.data() + offset);
+        offset += valueSize(kind);
+    }
+    frame.resize(offset);
+}
+
+bool phawd::applyWaveSample(SocketToPhawd *data, unsigned int schema_id, const char *payload, size_t length) {
+    SocketSampleHeader sample{};
+    if (length < sizeof(SocketSampleHeader)) {
+        return false;
+    }
+    std::memcpy(&sample, payload, sizeof(SocketSampleHeader));
+    if (sample.schemaId != schema_id) {
+        return false;
+    }
+    // the kinds come from the schema, so the size of the sample is known before anything is written
+    size_t expected = sizeof(SocketSampleHeader);
+    ParameterValue value;
+    for (size_t i = 0; i < data->numWaveParams; ++i) {
+        expected += valueSize(data->parameters[i].readValue(value));
+    }
+    if (length != expected) {
+        return false;
+    }
+
+    const char *values = payload + sizeof(SocketSampleHeader);
+    for (size_t i = 0; i < data->numWaveParams; ++i) {
+        ParameterKind kind = data->parameters[i].readValue(value);
+        readWireValue(kind, values, value);
+        data->parameters[i].writeValue(kind, value);
+        values += valueSize(kind);
+    }
+    data->timestamp = sample.timestamp;
+    return true;
+}
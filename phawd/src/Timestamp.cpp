@@ -0,0 +1,32 @@
+/*!
+ * PHAWD - Parameters Handler and Waveform Display
+ * Licensed under the GNU GPLv3 license. See LICENSE for more details.
+ * @author HuNing-He
+ * @date 2026-10-16
+ * @version 0.3
+ * @email 2689112371@qq.com
+ * @copyright (c) 2022 HuNing-He
+ * @file Timestamp.cpp
+ */
+
+#include "phawd/Timestamp.h"
+#if _WIN32
+#include <windows.h>
+#else
+#include <ctime>
+#endif
+
+long long phawd::getTimestamp() {
+#if _WIN32
+    static LARGE_INTEGER frequency = [](){ LARGE_INTEGER f; QueryPerformanceFrequency(&f); return f; }();
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (long long)(counter.QuadPart / frequency.QuadPart) * 1000000000LL +
+           (long long)(counter.QuadPart % frequency.QuadPart) * 1000000000LL / frequency.QuadPart;
+#else
+    // linux and the other POSIX systems
+    struct timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+#endif
+}
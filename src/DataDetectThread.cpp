@@ -23,18 +23,89 @@ void DataDetect::clearPtr(){
 void DataDetect::doDetection() {
     // clear the parameters name list before next check
     QStringList _paramsNameList;
-    size_t vecCount = 0;
+    QStringList lastDetected;
+    size_t extraCount = 0;      // curves beyond one per waveform parameter
+    size_t waveCount = 0;
+    unsigned int seenUpdate = 0;
+    // what the last scan saw, a wake-up only scans again if one of them changed or a second has passed
+    unsigned int lastGeneration = 0;
+    size_t lastNumWaveParams = 0;
+    int lastConnected = 0;
+    unsigned int lastStates[phawd::SHARED_MEMORY_MAX_PRODUCERS] = {};
+    QElapsedTimer sinceScan;
+    // Keep detecting while the shared memory is open, robot programs may register or go away at any time and every
+    // change of the parameters they publish is sent to the waveform displayer
     while (!m_stop) {
-        vecCount = 0;
+        // sleep until the robot program publishes something instead of polling, the timeout keeps m_stop checked
+        // and still catches programs that never call notifyUpdate()
+        phawd::SharedParameters *sharedMessage = m_sharedMessage;
+        if (sharedMessage != nullptr) {
+            sharedMessage->waitForUpdate(seenUpdate, 1000);
+        } else {
+            QThread::currentThread()->msleep(1000);
+        }
+        // producers notify every control cycle, the names only change with the layout or the producers, labels,
+        // liveness and sizes of arrays are picked up by the scan once a second
+        if (m_sharedMessage == nullptr || m_sharedMessage->connected <= 0) {
+            sinceScan.invalidate();
+            continue;
+        }
+        bool changed = !sinceScan.isValid() || sinceScan.elapsed() >= 1000;
+        if (m_sharedMessage->generation.load() != lastGeneration) {
+            lastGeneration = m_sharedMessage->generation.load();
+            changed = true;
+        }
+        if (m_sharedMessage->numWaveParams != lastNumWaveParams) {
+            lastNumWaveParams = m_sharedMessage->numWaveParams;
+            changed = true;
+        }
+        if (m_sharedMessage->connected.load() != lastConnected) {
+            lastConnected = m_sharedMessage->connected.load();
+            changed = true;
+        }
+        for (int id = 0; id < phawd::SHARED_MEMORY_MAX_PRODUCERS; id++) {
+            unsigned int state = m_sharedMessage->producers[id].state.load();
+            if (state != lastStates[id]) {
+                lastStates[id] = state;
+                changed = true;
+            }
+        }
+        if (!changed) {
+            continue;
+        }
+        sinceScan.start();
+        extraCount = 0;
+        waveCount = 0;
         _paramsNameList.clear();
         if (m_sharedMessage != nullptr && m_sharedMessage->connected > 0) {
-            for (size_t i = m_sharedMessage->numControlParams;
-                 i < m_sharedMessage->numControlParams + m_sharedMessage->numWaveParams; i++) {
-                std::string paramName = m_sharedMessage->parameters[i].getName();
-                if (paramName.empty() || !m_sharedMessage->parameters[i].isSet()){
+            // programs using registerProducer() only publish their own range, and only the alive ones are shown
+            bool withProducers = false;
+            for (int id = 0; id < phawd::SHARED_MEMORY_MAX_PRODUCERS; id++) {
+                if (m_sharedMessage->producers[id].state.load() != phawd::PRODUCER_FREE) {
+                    withProducers = true;
+                    break;
+                }
+            }
+            // programs which only bump connected fill the waveform parameters from the first one, the parameters
+            // reserved at the end for the gaps between producers stay unset then and aren't theirs
+            size_t numWaveParams = m_sharedMessage->numWaveParams;
+            if (!withProducers) {
+                numWaveParams -= phawd::SharedParameters::getProducerPadding(m_sharedMessage->separateRegions);
+            }
+            for (size_t i = 0; i < numWaveParams; i++) {
+                if (withProducers) {
+                    int id = m_sharedMessage->getProducerOf(i);
+                    if (id < 0 || !m_sharedMessage->isProducerAlive(id)) {
+                        continue;
+                    }
+                }
+                waveCount++;
+                phawd::Parameter &parameter = m_sharedMessage->getWaveParameters()[i];
+                std::string paramName = m_sharedMessage->getWaveLabel(i);
+                if (parameter.getName().empty() || !parameter.isSet()){
                     continue;
                 }
-                switch (m_sharedMessage->parameters[i].getValueKind()){
+                switch (parameter.getValueKind()){
                     case phawd::ParameterKind::VEC3_DOUBLE: {
                         std::string paramNameX = paramName + "-x";
                         std::string paramNameY = paramName + "-y";
@@ -42,7 +113,7 @@ void DataDetect::doDetection() {
                         _paramsNameList.append(QString::fromStdString(paramNameX));
                         _paramsNameList.append(QString::fromStdString(paramNameY));
                         _paramsNameList.append(QString::fromStdString(paramNameZ));
-                        vecCount++;
+                        extraCount += 2;
                         break;
                     }
                     case phawd::ParameterKind::VEC3_FLOAT: {
@@ -52,7 +123,31 @@ void DataDetect::doDetection() {
                         _paramsNameList.append(QString::fromStdString(paramNameX));
                         _paramsNameList.append(QString::fromStdString(paramNameY));
                         _paramsNameList.append(QString::fromStdString(paramNameZ));
-                        vecCount++;
+                        extraCount += 2;
+                        break;
+                    }
+                    // every element is a curve of its own, "name[i]" of a vector and "name[r,c]" of a matrix
+                    case phawd::ParameterKind::VECN_DOUBLE:
+                    case phawd::ParameterKind::MATRIX_DOUBLE: {
+                        phawd::ParameterValue value;
+                        phawd::ParameterKind kind = parameter.readValue(value);
+                        unsigned int rows = value.array.rows;
+                        unsigned int cols = value.array.cols;
+                        // a size which doesn't fit into the arena is a torn or garbage value, not that many curves
+                        if ((size_t)value.array.offset + (size_t)rows * cols > m_sharedMessage->dataArenaSize) {
+                            continue;
+                        }
+                        QString name = QString::fromStdString(paramName);
+                        for (unsigned int r = 0; r < rows; r++) {
+                            for (unsigned int c = 0; c < cols; c++) {
+                                if (kind == phawd::ParameterKind::VECN_DOUBLE) {
+                                    _paramsNameList.append(QString("%1[%2]").arg(name).arg(r));
+                                } else {
+                                    _paramsNameList.append(QString("%1[%2,%3]").arg(name).arg(r).arg(c));
+                                }
+                            }
+                        }
+                        extraCount += rows * cols - 1;
                         break;
                     }
                     default:
@@ -64,7 +159,7 @@ void DataDetect::doDetection() {
             if (_paramsNameList.isEmpty()) {
                 continue;
             }
-            if (_paramsNameList.count() != m_sharedMessage->numWaveParams + 2 * vecCount ){
+            if (_paramsNameList.count() != waveCount + extraCount ){
                 continue;
             }
 
@@ -82,9 +177,10 @@ void DataDetect::doDetection() {
                 continue;
             }
 
-            emit detected(_paramsNameList);
-            break;
+            if (_paramsNameList != lastDetected) {
+                lastDetected = _paramsNameList;
+                emit detected(_paramsNameList);
+            }
         }
-        QThread::currentThread()->msleep(1000);
     }
 }
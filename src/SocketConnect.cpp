@@ -10,13 +10,24 @@
  * @brief socket connection
  */
 #include"SocketConnect.h"
+#include <algorithm>
+#if __linux__
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "phawd/SocketConnect.h"
+#endif
+
+//!< messages of batches kept per waveform parameter until they are drawn, 4 s at 2 kHz
+constexpr size_t SOCKET_RING_CAPACITY = 8192;
 
 SocketConnect::SocketConnect(QObject *parent): QObject(parent) {
     m_numWaveParams = 0;
 }
 
 void SocketConnect::init(unsigned short port, size_t numWaveParams){
-    m_Socket = nullptr;
     m_Server = nullptr;
     m_Server = new QTcpServer();
 
@@ -24,96 +35,582 @@ void SocketConnect::init(unsigned short port, size_t numWaveParams){
         delete m_Server;
         throw std::runtime_error("[Socket Connect]: The listening status is abnormal\n");
     }
+    // telemetry over UDP is optional, without it only robot programs sending over TCP are shown
+    m_udpSocket = new QUdpSocket();
+    if(m_udpSocket->bind(QHostAddress::Any, port)){
+        connect(m_udpSocket, SIGNAL(readyRead()), this, SLOT(readDatagrams()));
+    }else{
+        printf("[Socket Connect]: Binding UDP port %u failed(%s), only telemetry over TCP is received\n", port,
+               m_udpSocket->errorString().toStdString().c_str());
+        delete m_udpSocket;
+        m_udpSocket = nullptr;
+    }
+    listenLocal(port);
 
     m_numWaveParams = numWaveParams;
-    m_socketToPhawd = (phawd::SocketToPhawd *) malloc(sizeof(phawd::SocketToPhawd) + numWaveParams * sizeof(phawd::Parameter));
+    m_ringSize = phawd::SampleRing::getSize(SOCKET_RING_CAPACITY);
     connect(m_Server, SIGNAL(newConnection()), this, SLOT(slotNewConnection()));
 }
 
+SocketClient *SocketConnect::addClient(){
+    auto *client = new SocketClient;
+    // the number of a robot which left is given to the next one, so that reconnecting keeps its curves
+    client->id = 1;
+    while (findClient(client->id) != nullptr){
+        client->id++;
+    }
+    client->data = (phawd::SocketToPhawd *) calloc(1, sizeof(phawd::SocketToPhawd) + m_numWaveParams * sizeof(phawd::Parameter));
+    client->received = (phawd::SocketToPhawd *) calloc(1, sizeof(phawd::SocketToPhawd) + m_numWaveParams * sizeof(phawd::Parameter));
+    m_clients.append(client);
+    return client;
+}
+
+SocketClient *SocketConnect::findClient(int id) const {
+    for (SocketClient *client : m_clients){
+        if (client->id == id){
+            return client;
+        }
+    }
+    return nullptr;
+}
+
+void SocketConnect::removeClient(SocketClient *client){
+    int index = m_clients.indexOf(client);
+    if (index < 0){
+        return;
+    }
+    emit connected(index, false);
+    m_clients.removeAt(index);
+    freeClient(client);
+    // the waveform parameters of the client are gone
+    emit schemaReady();
+}
+
+void SocketConnect::freeClient(SocketClient *client){
+    if(client->socket != nullptr){
+        disconnect(client->socket, SIGNAL(readyRead()), this, SLOT(readData()));
+        disconnect(client->socket, SIGNAL(disconnected()) ,this, SLOT(closeSocket()));
+        client->socket->close();
+        client->socket->deleteLater();
+        client->socket = nullptr;
+    }
+#if __linux__
+    if(client->localNotifier != nullptr){
+        client->localNotifier->setEnabled(false);
+        client->localNotifier->deleteLater();
+        client->localNotifier = nullptr;
+    }
+    if(client->localFd >= 0){
+        ::close(client->localFd);
+        client->localFd = -1;
+    }
+#endif
+    free(client->data);
+    free(client->received);
+    if(client->sampleRings != nullptr){
+        qFreeAligned(client->sampleRings);
+    }
+    delete client;
+}
+
 void SocketConnect::sendData(void *data, size_t sendSize){
-    if(m_Socket == nullptr) {
+    if(m_clients.isEmpty()) {
         throw std::runtime_error("[Socket Connect]: No clients connected, send data failed\n");
     }
-    char *sendData = new char[sendSize];
-    memcpy(sendData, data, sendSize);
-    qint64 count = m_Socket->write(sendData, sendSize);
+    // one client which can't be written to must not keep the others from getting the control parameters
+    bool failed = false;
+    for (SocketClient *client : m_clients){
+        try {
+            sendFrame(client, data, sendSize);
+        } catch (std::runtime_error &err) {
+            printf("%s\n", err.what());
+            failed = true;
+        }
+    }
+    if (failed){
+        throw std::runtime_error("[Socket Connect]: Write error: send to some of the clients failed");
+    }
+}
+
+void SocketConnect::sendData(int client, void *data, size_t sendSize){
+    if(client < 0 || client >= m_clients.count()) {
+        throw std::runtime_error("[Socket Connect]: No such client, send data failed\n");
+    }
+    sendFrame(m_clients[client], data, sendSize);
+}
+
+void SocketConnect::sendFrame(SocketClient *client, void *data, size_t sendSize){
+    phawd::SocketFrameHeader header{};
+    header.init(phawd::FRAME_FROM_PHAWD, (unsigned int)sendSize, client->sendSequence++);
+#if __linux__
+    if(client->localFd >= 0){
+        // header and data leave as one record, a full socket buffer drops it rather than blocking the GUI
+        iovec iov[2] = {{&header, sizeof(header)}, {data, sendSize}};
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+        if(sendmsg(client->localFd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT) < 0 && errno != EAGAIN && errno != EWOULDBLOCK){
+            throw std::runtime_error("[Socket Connect]: Write error: send on closed local socket");
+        }
+        return;
+    }
+#endif
+    QTcpSocket *socket = client->socket;
+    size_t sent = 0;    // bytes already taken by the kernel
+#if __linux__
+    // with nothing queued in QTcpSocket the frame goes to the kernel directly, without being copied into its buffer
+    if(socket->bytesToWrite() == 0){
+        iovec iov[2] = {{&header, sizeof(header)}, {data, sendSize}};
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+        ssize_t count = sendmsg((int)socket->socketDescriptor(), &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        sent = count > 0 ? (size_t)count : 0;
+        if(sent == sizeof(header) + sendSize){
+            return;
+        }
+    }
+#endif
+    // QTcpSocket buffers whatever the kernel doesn't take yet, so a frame is never cut in the middle
+    qint64 count = 1;
+    if (sent < sizeof(header)) {
+        count = socket->write((const char *)&header + sent, (qint64)(sizeof(header) - sent));
+    }
+    if (count > 0) {
+        size_t dataSent = sent > sizeof(header) ? sent - sizeof(header) : 0;
+        count = socket->write((const char *)data + dataSent, (qint64)(sendSize - dataSent));
+    }
     if (count <= 0){
         throw std::runtime_error("[Socket Connect]: Write error: read on closed socket or no data for reading");
     }
-    m_Socket->flush();
-    delete []sendData;
+    socket->flush();
 }
 
 void SocketConnect::slotNewConnection(){
-    m_Socket = m_Server->nextPendingConnection();
-    connect(m_Socket, SIGNAL(readyRead()), this, SLOT(readData()));
-    connect(m_Socket, SIGNAL(disconnected()) ,this, SLOT(closeSocket()));
-    emit connected(true);
+    while (m_Server->hasPendingConnections()){
+        SocketClient *client = addClient();
+        client->socket = m_Server->nextPendingConnection();
+        connect(client->socket, SIGNAL(readyRead()), this, SLOT(readData()));
+        connect(client->socket, SIGNAL(disconnected()) ,this, SLOT(closeSocket()));
+        emit connected(m_clients.count() - 1, true);
+    }
 }
 
 void SocketConnect::readData() {
-    size_t readSize = sizeof(phawd::SocketToPhawd) + m_numWaveParams * sizeof(phawd::Parameter);
-    char *recvData = new char[readSize];
-    qint64 count = m_Socket->read(recvData, readSize);
-
+    auto *socket = qobject_cast<QTcpSocket *>(sender());
+    SocketClient *client = nullptr;
+    for (SocketClient *c : m_clients){
+        if (socket != nullptr && c->socket == socket){
+            client = c;
+        }
+    }
+    if (client == nullptr){
+        return;
+    }
+    qint64 available = socket->bytesAvailable();
+    if (available <= 0){
+        return;
+    }
+    qint64 count = socket->read(client->assembler.reserve((size_t)available), available);
     if (count <= 0){
         return;
 //        throw std::runtime_error("[Socket Connect]: Read error: read on closed socket or no data for reading");
     }
-    memcpy(m_socketToPhawd, recvData, readSize);
+    client->assembler.commit((size_t)count);
+    dispatchFrames(client);
+}
+
+void SocketConnect::dispatchFrames(SocketClient *client){
+    // only the latest complete message matters for display, older ones in the same batch are overwritten
+    bool received = false;
+    bool schemaChanged = false;
+    phawd::SocketFrameHeader header{};
+    const char *payload = nullptr;
+    while (client->assembler.next(header, payload)) {
+        handleFrame(client, header, payload, received, schemaChanged);
+    }
+    if(schemaChanged && m_numWaveParams > 0){
+        emit schemaReady();
+    }
+    if(received && m_numWaveParams > 0){
+        emit readReady(m_clients.indexOf(client));
+    }
+}
 
-    delete []recvData;
-    recvData = nullptr;
-    if(m_numWaveParams > 0){
-        emit readReady();
+void SocketConnect::readDatagrams() {
+    // a datagram may come from any client, each of them is answered once after all were read
+    QList<SocketClient *> receivedClients;
+    bool schemaChanged = false;
+    while (m_udpSocket->hasPendingDatagrams()) {
+        qint64 size = m_udpSocket->pendingDatagramSize();
+        m_datagram.resize(size > 0 ? (size_t)size : 0);
+        QHostAddress sender;
+        quint16 senderPort = 0;
+        qint64 count = m_udpSocket->readDatagram(m_datagram.data(), (qint64)m_datagram.size(), &sender, &senderPort);
+        if (count < (qint64)sizeof(phawd::SocketFrameHeader)) {
+            continue;
+        }
+        // only clients connected over TCP may send, they have sent the schema there. Clients bind their UDP socket to
+        // the port of their TCP connection, so several of them on one host can be told apart
+        SocketClient *client = nullptr;
+        int sameHost = 0;
+        for (SocketClient *c : m_clients) {
+            if (c->socket == nullptr || !sender.isEqual(c->socket->peerAddress(), QHostAddress::TolerantConversion)) {
+                continue;
+            }
+            if (c->socket->peerPort() == senderPort) {
+                client = c;
+                break;
+            }
+            if (sameHost++ == 0) {
+                client = c;
+            }
+        }
+        if (client == nullptr || (client->socket->peerPort() != senderPort && sameHost > 1)) {
+            continue;
+        }
+        phawd::SocketFrameHeader header{};
+        memcpy(&header, m_datagram.data(), sizeof(header));
+        if (header.magic != phawd::SOCKET_FRAME_MAGIC || (qint64)header.length != count - (qint64)sizeof(header)) {
+            continue;
+        }
+        // a datagram arriving after a newer one would move the waveform back in time
+        bool received = false;
+        if (client->telemetry.accept(header.sequence)) {
+            handleFrame(client, header, m_datagram.data() + sizeof(header), received, schemaChanged);
+        }
+        if (received && !receivedClients.contains(client)) {
+            receivedClients.append(client);
+        }
+    }
+    if(schemaChanged && m_numWaveParams > 0){
+        emit schemaReady();
+    }
+    for (SocketClient *client : receivedClients) {
+        int index = m_clients.indexOf(client);
+        if(index >= 0 && m_numWaveParams > 0){
+            emit readReady(index);
+        }
     }
 }
 
+void SocketConnect::handleFrame(SocketClient *client, const phawd::SocketFrameHeader &header, const char *payload,
+                                bool &received, bool &schemaChanged) {
+    size_t readSize = sizeof(phawd::SocketToPhawd) + m_numWaveParams * sizeof(phawd::Parameter);
+    bool applied = false;
+    if (header.type == phawd::FRAME_TO_PHAWD && header.length == readSize) {
+        // clients without the schema handshake repeat the names in every message, only a change is reported
+        memcpy(client->received, payload, readSize);
+        if (!client->haveKeyframe || client->haveSchema || !phawd::sameWaveSchema(client->received, client->data)) {
+            schemaChanged = true;
+        }
+        memcpy(client->data, client->received, readSize);
+        client->haveSchema = false;
+        client->units.clear();
+        client->haveKeyframe = true;
+        toLocalClock(client);
+        applied = true;
+    } else if (header.type == phawd::FRAME_WAVE_SCHEMA) {
+        if (phawd::applyWaveSchema(client->data, m_numWaveParams, payload, header.length, client->schemaId,
+                                   client->units)) {
+            client->haveSchema = true;
+            client->haveKeyframe = false;
+            schemaChanged = true;
+        }
+    } else if (header.type == phawd::FRAME_TO_PHAWD_SAMPLE && client->haveSchema) {
+        if (phawd::applyWaveSample(client->data, client->schemaId, payload, header.length)) {
+            client->haveKeyframe = true;
+            toLocalClock(client);
+            applied = true;
+        }
+    } else if (header.type == phawd::FRAME_TO_PHAWD_DELTA && client->haveKeyframe) {
+        if (phawd::applyWaveDelta(client->data, payload, header.length)) {
+            toLocalClock(client);
+            applied = true;
+        }
+    } else if (header.type == phawd::FRAME_TO_PHAWD_BATCH && header.length >= sizeof(phawd::SocketBatchHeader)) {
+        phawd::SocketBatchHeader batch{};
+        memcpy(&batch, payload, sizeof(batch));
+        if (batch.sampleType == phawd::FRAME_TO_PHAWD_BATCH ||
+            header.length != sizeof(batch) + (size_t)batch.numSamples * batch.sampleSize) {
+            return;
+        }
+        // every message is applied in turn and kept for the waveforms, the last one stays as the latest
+        phawd::SocketFrameHeader entry = header;
+        entry.type = batch.sampleType;
+        entry.length = batch.sampleSize;
+        const char *sample = payload + sizeof(batch);
+        for (unsigned int i = 0; i < batch.numSamples; i++, sample += batch.sampleSize) {
+            handleFrame(client, entry, sample, received, schemaChanged);
+        }
+    }
+    // every message goes into the rings, WaveShow draws a client from them once they exist
+    if (applied) {
+        pushSamples(client);
+        received = true;
+    }
+}
+
+void SocketConnect::toLocalClock(SocketClient *client){
+    // a message can't arrive before it was sent, the smallest difference seen is the offset of the two clocks plus
+    // the quickest delivery, waveforms of several robots line up on it
+    long long offset = phawd::getTimestamp() - client->data->timestamp;
+    if (!client->haveClock || offset < client->clockOffset){
+        client->clockOffset = offset;
+        client->haveClock = true;
+    }
+    client->data->timestamp += client->clockOffset;
+}
+
+void SocketConnect::pushSamples(SocketClient *client){
+    if (m_numWaveParams == 0){
+        return;
+    }
+    if (client->sampleRings == nullptr){
+        client->sampleRings = (char *) qMallocAligned(m_ringSize * m_numWaveParams, 64);
+        for (size_t i = 0; i < m_numWaveParams; i++){
+            getSampleRing(client, i)->init(SOCKET_RING_CAPACITY);
+        }
+    }
+    for (size_t i = 0; i < client->data->numWaveParams && i < m_numWaveParams; i++){
+        phawd::ParameterValue value;
+        client->data->parameters[i].readValue(value);
+        getSampleRing(client, i)->push(value, client->data->timestamp);
+    }
+}
+
+phawd::SampleRing *SocketConnect::getSampleRing(SocketClient *client, size_t index){
+    if (client->sampleRings == nullptr || index >= m_numWaveParams){
+        return nullptr;
+    }
+    return (phawd::SampleRing *)(client->sampleRings + index * m_ringSize);
+}
+
+int SocketConnect::getChannel(int client, size_t index) const {
+    return m_clients[client]->id * (int)m_numWaveParams + (int)index;
+}
+
+phawd::Parameter *SocketConnect::getParameter(int channel){
+    SocketClient *client = m_numWaveParams > 0 ? findClient(channel / (int)m_numWaveParams) : nullptr;
+    size_t index = m_numWaveParams > 0 ? (size_t)channel % m_numWaveParams : 0;
+    if (client == nullptr || index >= client->data->numWaveParams){
+        return nullptr;
+    }
+    return &client->data->parameters[index];
+}
+
+phawd::SampleRing *SocketConnect::getSampleRing(int channel){
+    SocketClient *client = m_numWaveParams > 0 ? findClient(channel / (int)m_numWaveParams) : nullptr;
+    if (client == nullptr){
+        return nullptr;
+    }
+    return getSampleRing(client, (size_t)channel % m_numWaveParams);
+}
+
+long long SocketConnect::getLatestTimestamp() const {
+    long long latest = 0;
+    for (SocketClient *client : m_clients){
+        if (client->haveClock){
+            latest = std::max(latest, client->data->timestamp);
+        }
+    }
+    return latest;
+}
+
+void SocketConnect::discardSamples(){
+    for (SocketClient *client : m_clients){
+        for (size_t i = 0; client->sampleRings != nullptr && i < m_numWaveParams; i++){
+            getSampleRing(client, i)->discard();
+        }
+    }
+}
+
+void SocketConnect::listenLocal(unsigned short port){
+#if __linux__
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    m_localPath = phawd::getLocalSocketPath(port);
+    memcpy(address.sun_path, m_localPath.c_str(), std::min(m_localPath.size(), sizeof(address.sun_path) - 1));
+    // only a socket file left by a phawd of the same user which didn't exit cleanly is removed
+    bool prepared = phawd::prepareLocalSocketPath(m_localPath);
+    m_localServerFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(!prepared || m_localServerFd < 0 || bind(m_localServerFd, (sockaddr *)&address, sizeof(address)) != 0 ||
+       chmod(m_localPath.c_str(), 0600) != 0 || listen(m_localServerFd, 8) != 0){
+        // TCP still works, clients on the same host only lose the shortcut
+        printf("[Socket Connect]: Listening on %s failed, local clients have to use TCP\n", m_localPath.c_str());
+        if(m_localServerFd >= 0){
+            ::close(m_localServerFd);
+            m_localServerFd = -1;
+        }
+        return;
+    }
+    m_localServerNotifier = new QSocketNotifier(m_localServerFd, QSocketNotifier::Read);
+    connect(m_localServerNotifier, SIGNAL(activated(int)), this, SLOT(acceptLocalConnection()));
+#endif
+}
+
+void SocketConnect::acceptLocalConnection(){
+#if __linux__
+    for(;;){
+        int fd = accept4(m_localServerFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0){
+            return;
+        }
+        SocketClient *client = addClient();
+        client->localFd = fd;
+        client->localNotifier = new QSocketNotifier(fd, QSocketNotifier::Read);
+        connect(client->localNotifier, SIGNAL(activated(int)), this, SLOT(readLocalData()));
+        emit connected(m_clients.count() - 1, true);
+    }
+#endif
+}
+
+void SocketConnect::readLocalData(){
+#if __linux__
+    auto *notifier = qobject_cast<QSocketNotifier *>(sender());
+    SocketClient *client = nullptr;
+    for (SocketClient *c : m_clients){
+        if (notifier != nullptr && c->localNotifier == notifier){
+            client = c;
+        }
+    }
+    if (client == nullptr){
+        return;
+    }
+    for(;;){
+        // a record can't be received in pieces, ask for its size first so that batches of any size fit
+        ssize_t size = recv(client->localFd, nullptr, 0, MSG_PEEK | MSG_TRUNC | MSG_DONTWAIT);
+        if(size < 0 && errno == EINTR){
+            continue;
+        }
+        if(size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            break;
+        }
+        if(size <= 0){
+            removeClient(client);
+            return;
+        }
+        iovec iov{client->assembler.reserve((size_t)size), (size_t)size};
+        alignas(cmsghdr) char control[CMSG_SPACE(4 * sizeof(int))];
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t count = recvmsg(client->localFd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+        if(count < 0 && errno == EINTR){
+            continue;
+        }
+        if(count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            break;
+        }
+        if(count <= 0){
+            removeClient(client);
+            return;
+        }
+        // descriptors passed by the client aren't used by phawd, don't keep them open. Those which didn't fit into
+        // control(MSG_CTRUNC) were never received
+        for(cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)){
+            if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS){
+                size_t num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                for(size_t i = 0; i < num; i++){
+                    int fd;
+                    memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                    ::close(fd);
+                }
+            }
+        }
+        if(msg.msg_flags & MSG_CTRUNC){
+            printf("[Socket Connect]: robot%d attached more descriptors than fit, the rest were closed\n", client->id);
+        }
+        if(!(msg.msg_flags & MSG_TRUNC)){
+            client->assembler.commit((size_t)count);
+        }
+    }
+    dispatchFrames(client);
+#endif
+}
+
 void SocketConnect::close(){
+    while(!m_clients.isEmpty()){
+        removeClient(m_clients.last());
+    }
     if(m_Server != nullptr){
         disconnect(m_Server, SIGNAL(newConnection()), this, SLOT(slotNewConnection()));
         delete m_Server;
         m_Server = nullptr;
     }
-
-    if(m_Socket != nullptr){
-        disconnect(m_Socket, SIGNAL(readyRead()), this, SLOT(readData()));
-        disconnect(m_Socket, SIGNAL(disconnected()) ,this, SLOT(closeSocket()));
-        m_Socket->close();
-        m_Socket = nullptr;
+    if(m_udpSocket != nullptr){
+        disconnect(m_udpSocket, SIGNAL(readyRead()), this, SLOT(readDatagrams()));
+        delete m_udpSocket;
+        m_udpSocket = nullptr;
     }
-
-    if(m_socketToPhawd != nullptr){
-        free(m_socketToPhawd);
-        m_socketToPhawd = nullptr;
+#if __linux__
+    if(m_localServerNotifier != nullptr){
+        delete m_localServerNotifier;
+        m_localServerNotifier = nullptr;
+    }
+    if(m_localServerFd >= 0){
+        ::close(m_localServerFd);
+        m_localServerFd = -1;
+        unlink(m_localPath.c_str());
     }
-    emit connected(false);
+#endif
 }
 
 void SocketConnect::closeSocket(){
-    disconnect(m_Socket, SIGNAL(readyRead()), this, SLOT(readData()));
-    disconnect(m_Socket, SIGNAL(disconnected()) ,this, SLOT(closeSocket()));
-    m_Socket->close();
-    m_Socket = nullptr;
-    emit connected(false);
+    auto *socket = qobject_cast<QTcpSocket *>(sender());
+    for (SocketClient *client : m_clients){
+        if (socket != nullptr && client->socket == socket){
+            removeClient(client);
+            return;
+        }
+    }
 }
 
 SocketConnect::~SocketConnect() {
+    for (SocketClient *client : m_clients){
+        freeClient(client);
+    }
+    m_clients.clear();
     if(m_Server != nullptr){
         disconnect(m_Server, SIGNAL(newConnection()), this, SLOT(slotNewConnection()));
         delete m_Server;
         m_Server = nullptr;
     }
-    if(m_Socket != nullptr){
-        m_Socket->close();
-        m_Socket = nullptr;
+    if(m_udpSocket != nullptr){
+        delete m_udpSocket;
+        m_udpSocket = nullptr;
     }
-    if(m_socketToPhawd != nullptr){
-        free(m_socketToPhawd);
-        m_socketToPhawd = nullptr;
+#if __linux__
+    if(m_localServerNotifier != nullptr){
+        delete m_localServerNotifier;
+        m_localServerNotifier = nullptr;
     }
+    if(m_localServerFd >= 0){
+        ::close(m_localServerFd);
+        m_localServerFd = -1;
+        unlink(m_localPath.c_str());
+    }
+#endif
+}
+
+int SocketConnect::getClientCount() const {
+    return m_clients.count();
+}
+
+phawd::SocketToPhawd* SocketConnect::getRead(int client){
+    return m_clients[client]->data;
+}
+
+QString SocketConnect::getClientName(int client) const {
+    return QString("robot%1").arg(m_clients[client]->id);
+}
+
+const std::vector<std::string> &SocketConnect::getUnits(int client) const {
+    return m_clients[client]->units;
 }
 
-phawd::SocketToPhawd* SocketConnect::getRead(){
-    return m_socketToPhawd;
+const phawd::SequenceTracker &SocketConnect::getTelemetryStats(int client) const {
+    return m_clients[client]->telemetry;
 }
\ No newline at end of file
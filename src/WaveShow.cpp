@@ -9,6 +9,7 @@
  * @file WaveShow.cpp
  * @brief waveform display
  */
+#include <QHash>
 #include "WaveShow.h"
 
 WaveShow::WaveShow(QWidget *parent): QWidget(parent), ui(new Ui::WaveShow){
@@ -84,7 +85,7 @@ void WaveShow::freqChangeInGraph(int value){
 
 void WaveShow::clearPtr(){
     m_sharedMessage = nullptr;
-    m_socketToPhawd = nullptr;
+    m_socketConnect = nullptr;
 }
 
 void WaveShow::receiveLineAttribute(QList<LineAttribute> selected){
@@ -97,53 +98,41 @@ void WaveShow::receiveDeleteSelections(QStringList selected){
     m_selectedNamesToDelete = std::move(selected);
 }
 
-// QPair's first is the index of the actual parameter, second is the index of the vector (-1 for non-vectors),
-// and stores the real index of all selected parameters on a chart
+// QPair's first is the index of the actual parameter, second is the index of the vector (-1 for non-vectors) or the
+// row major index of the element of a VECN/MATRIX parameter, and stores the real index of all selected parameters on
+// a chart
 QPair<int, int> WaveShow::getIndexOfSelectedParameters(int graphIndex){
     QPair<int, int> indexPair;
-    int vecCount = 0;
-    int index = m_selectedToAddIndex[graphIndex];
-    // Note here that the m_paramsNameList header is not added with a null character, and the returned index has been
-    // subtracted by 1, so there is no need to subtract it here
-    for (int i = 2; i < index; i++){
-        if(m_paramsNameList[i].contains("-z")) {
-            vecCount++;
-        }
-    }
-
-    if(m_paramsNameList[index].contains("-x")){
-        if(m_usingSocket){
-            indexPair.first = index - vecCount * 2;
-            indexPair.second = 0;
-        }else{
-            indexPair.first = index - vecCount * 2 + m_sharedMessage->numControlParams;
+    // Several robot programs may share the memory or connect over socket, so the list only holds what the alive ones
+    // publish and the position in it says nothing about where the parameter is, look the label up instead
+    QString label = m_selectedToAddName[graphIndex];
+    indexPair.second = -1;
+    if(!m_waveIndexOfLabel.contains(label) && label.length() > 2){
+        if(label.endsWith("-x")){
             indexPair.second = 0;
-        }
-    }else if(m_paramsNameList[index].contains("-y")){
-        if(m_usingSocket){
-            indexPair.first = index - vecCount * 2 - 1;
-            indexPair.second = 1;
-        }else{
-            indexPair.first = index - vecCount * 2 + m_sharedMessage->numControlParams - 1;
+        }else if(label.endsWith("-y")){
             indexPair.second = 1;
-        }
-    }else if(m_paramsNameList[index].contains("-z")){
-        if (m_usingSocket){
-            indexPair.first = index - vecCount * 2 - 2;
-            indexPair.second = 2;
-        }else{
-            indexPair.first = index - vecCount * 2 + m_sharedMessage->numControlParams - 2;
+        }else if(label.endsWith("-z")){
             indexPair.second = 2;
         }
-    }else{
-        if(m_usingSocket){
-            indexPair.first = index - vecCount * 2;
-            indexPair.second = -1;
-        }else{
-            indexPair.first = index - vecCount * 2 + m_sharedMessage->numControlParams;
-            indexPair.second = -1;
+        if(indexPair.second >= 0){
+            label.chop(2);
+        }else if(!m_usingSocket && label.endsWith("]") && label.contains("[")){
+            // "name[i]" of a vector or "name[r,c]" of a matrix, see DataDetect
+            int open = label.lastIndexOf("[");
+            QStringList position = label.mid(open + 1, label.length() - open - 2).split(",");
+            label.truncate(open);
+            int index = m_waveIndexOfLabel.value(label, -1);
+            if(index >= 0 && position.count() == 1){
+                indexPair.second = position[0].toInt();
+            }else if(index >= 0 && position.count() == 2){
+                phawd::ParameterValue value;
+                m_sharedMessage->parameters[index].readValue(value);
+                indexPair.second = position[0].toInt() * (int)value.array.cols + position[1].toInt();
+            }
         }
     }
+    indexPair.first = m_waveIndexOfLabel.value(label, -1);
     return indexPair;
 }
 
@@ -247,6 +236,7 @@ void WaveShow::addChannel(){
 void WaveShow::StartGraph(){
     if(!m_paramsNameList.isEmpty()){
         if(!m_timer->isActive()){
+            discardSamples();
             m_timer->setTimerType(Qt::PreciseTimer);
             m_timer->setInterval(ui->freqInGraph->value());
             m_timer->start();
@@ -255,12 +245,30 @@ void WaveShow::StartGraph(){
     }
 }
 
+void WaveShow::discardSamples(){
+    // Samples pushed while the graph was stopped would be squeezed into the first frame
+    if (m_usingSocket && m_socketConnect != nullptr){
+        m_socketConnect->discardSamples();
+    }
+    if (m_usingSocket || m_sharedMessage == nullptr){
+        return;
+    }
+    for (size_t i = 0; i < m_sharedMessage->numWaveParams; i++){
+        phawd::SampleRing *ring = m_sharedMessage->getSampleRing(i);
+        if (ring != nullptr){
+            ring->discard();
+        }
+    }
+}
+
 void WaveShow::undoRequest() {
     if(m_timer->isActive()){
         m_timer->stop();
         m_isStarted = false;
     }
     iter = 0;
+    m_firstTimestamp = 0;
+    m_lastTimestamp = 0;
     ui->widget->clearGraphs();
     m_selectedToAddName.clear();
     m_selectedToAddIndex.clear();
@@ -292,207 +300,176 @@ void WaveShow::ResetGraph(){
     ui->widget->xAxis->setRange(0, 2);
     ui->widget->replot();
     iter = 0;
+    m_firstTimestamp = 0;
+    m_lastTimestamp = 0;
+}
+
+/*!
+ * Value of one curve: the component index of a vector, or the scalar itself when index is -1
+ * @return false if the kind of the parameter doesn't match the curve
+ */
+static bool curveValue(phawd::ParameterKind kind, const phawd::ParameterValue &value, int index, double &result){
+    switch (kind){
+        case phawd::ParameterKind::VEC3_FLOAT:
+            if (index < 0 || index > 2) return false;
+            result = value.vec3f[index];
+            return true;
+        case phawd::ParameterKind::VEC3_DOUBLE:
+            if (index < 0 || index > 2) return false;
+            result = value.vec3d[index];
+            return true;
+        case phawd::ParameterKind::DOUBLE:
+            result = value.d;
+            return true;
+        case phawd::ParameterKind::FLOAT:
+            result = value.f;
+            return true;
+        case phawd::ParameterKind::S64:
+            result = (double)value.i;
+            return true;
+        default:
+            return false;
+    }
+}
+
+double WaveShow::toPlotTime(long long timestamp){
+    if (m_firstTimestamp == 0){
+        m_firstTimestamp = timestamp;
+    }
+    return (double)(timestamp - m_firstTimestamp) * 1e-9;
 }
 
 void WaveShow::addDataToGraph(){
     QPair<int, int> paramsIndex;
+    // Socket clients are stamped on the clock of phawd, so that the waveforms of several robots line up
+    long long timestamp = m_usingSocket ? m_socketConnect->getLatestTimestamp() :
+                                          m_sharedMessage->waveTimestamp.load(std::memory_order_acquire);
     double time = iter * 0.001;
-
+    if (timestamp != 0){
+        // The robot program stamps what it publishes, so the time axis follows its clock instead of this timer
+        if (timestamp == m_lastTimestamp){
+            return; // nothing new has been published since last frame
+        }
+    }
+    m_lastTimestamp = timestamp;
+    // Every parameter is read only once per frame, so that the x/y/z curves of a vector come from the same
+    // control cycle, the seqlock inside readValue() guarantees that the snapshot itself is never torn
+    QHash<int, QPair<phawd::ParameterKind, phawd::ParameterValue>> snapshots;
+    QHash<int, int> drainedCount;           // samples taken out of the ring into m_drainBuffers this frame
+    QHash<int, QVector<double>> elements;   // of VECN/MATRIX parameters, which have no rings
+    long long oldest = timestamp;           // of the samples drained, the plot starts there
+
+    // first take the snapshots and drain the rings of all curves, then draw them once the time axis is known
+    m_graphIndices.resize(ui->widget->graphCount());
     for (int i = 0; i < ui->widget->graphCount(); i++){
         paramsIndex = getIndexOfSelectedParameters(i);
-
-        if(!m_usingSocket){
-            switch (m_sharedMessage->parameters[paramsIndex.first].getValueKind()){
-                case phawd::ParameterKind::VEC3_FLOAT:{
-                    float value;
-                    try{
-                        value = m_sharedMessage->parameters[paramsIndex.first].getFromVec3fByIndex(paramsIndex.second);
-                        ui->widget->graph(i)->addData(time, value);
-                        break;
-                    } catch (std::runtime_error &err){
-                        QString paramName = QString::fromStdString(m_sharedMessage->parameters[paramsIndex.first].getName());
-                        QString windowMessage = QString("Start Failed!Try to use getVec3f() for parameter(%1)"
-                                                        " that is not of type VEC3_FLOAT").arg(paramName);
-                        QMessageBox::critical(this, tr("Error"),
-                                              windowMessage, 
-                                              QMessageBox::Discard,  
-                                              QMessageBox::Discard);
-                        m_timer->stop();
-                        break;
-                    }
-                }
-                case phawd::ParameterKind::VEC3_DOUBLE:{
-                    double value;
-                    try{
-                        value = m_sharedMessage->parameters[paramsIndex.first].getFromVec3dByIndex(paramsIndex.second);
-                        ui->widget->graph(i)->addData(time, value);
-                        break;
-                    } catch (std::runtime_error &err){
-                        QString paramName = QString::fromStdString(m_sharedMessage->parameters[paramsIndex.first].getName());
-                        QString windowMessage = QString("Start Failed!Try to use getVec3d() for parameter(%1)"
-                                                        " that is not of type VEC3_DOUBLE").arg(paramName);
-                        QMessageBox::critical(this, tr("Error"),
-                                              windowMessage,
-                                              QMessageBox::Discard,
-                                              QMessageBox::Discard);
-                        m_timer->stop();
-                        break;
-                    }
-                }
-                case phawd::ParameterKind::DOUBLE:{
-                    double value;
-                    try{
-                        value = m_sharedMessage->parameters[paramsIndex.first].getDouble();
-                        ui->widget->graph(i)->addData(time, value);
-                        break;
-                    } catch (std::runtime_error &err){
-                        QString paramName = QString::fromStdString(m_sharedMessage->parameters[paramsIndex.first].getName());
-                        QString windowMessage = QString("Start Failed!Try to use getDouble() for parameter(%1)"
-                                                        " that is not of type DOUBLE").arg(paramName);
-                        QMessageBox::critical(this, tr("Error"),
-                                              windowMessage,
-                                              QMessageBox::Discard,
-                                              QMessageBox::Discard);
-                        m_timer->stop();
-                        break;
-                    }
-                }
-                case phawd::ParameterKind::FLOAT:{
-                    float value;
-                    try{
-                        value = m_sharedMessage->parameters[paramsIndex.first].getFloat();
-                        ui->widget->graph(i)->addData(time, value);
-                        break;
-                    } catch (std::runtime_error &err){
-                        QString paramName = QString::fromStdString(m_sharedMessage->parameters[paramsIndex.first].getName());
-                        QString windowMessage = QString("Start Failed!Try to use getFloat() for parameter(%1)"
-                                                        " that is not of type FLOAT").arg(paramName);
-                        QMessageBox::critical(this, tr("Error"),
-                                              windowMessage,
-                                              QMessageBox::Discard,
-                                              QMessageBox::Discard);
-                        m_timer->stop();
-                        break;
-                    }
-                }
-                case phawd::ParameterKind::S64:{
-                    long value;
-                    try{
-                        value = m_sharedMessage->parameters[paramsIndex.first].getS64();
-                        ui->widget->graph(i)->addData(time, value);
-                        break;
-                    } catch (std::runtime_error &err){
-                        QString paramName = QString::fromStdString(m_sharedMessage->parameters[paramsIndex.first].getName());
-                        QString windowMessage = QString("Start Failed!Try to use getS64() for parameter(%1)"
-                                                        " that is not of type S64").arg(paramName);
-                        QMessageBox::critical(this, tr("Error"),
-                                              windowMessage,
-                                              QMessageBox::Discard,
-                                              QMessageBox::Discard);
-                        m_timer->stop();
-                        break;
-                    }
+        m_graphIndices[i] = paramsIndex;
+        if (paramsIndex.first < 0){
+            continue; // its producer is gone
+        }
+        phawd::Parameter *parameter = m_usingSocket ? m_socketConnect->getParameter(paramsIndex.first) :
+                                                      &m_sharedMessage->parameters[paramsIndex.first];
+        if (parameter == nullptr){
+            m_graphIndices[i].first = -1;
+            continue; // its robot has disconnected
+        }
+        // With waveform rings every sample the robot pushed since the last frame is drawn, otherwise only the latest
+        // value. Socket clients have them once they send batches
+        phawd::SampleRing *ring = m_usingSocket ? m_socketConnect->getSampleRing(paramsIndex.first) :
+                                  m_sharedMessage->getSampleRing(paramsIndex.first - m_sharedMessage->waveParamsBegin);
+        if (!snapshots.contains(paramsIndex.first)){
+            phawd::ParameterValue value;
+            phawd::ParameterKind kind = parameter->readValue(value);
+            if (parameter->isStale()){
+                // its writer stopped in the middle of a write, the value may be torn, leave a gap in the curves
+                if (!m_staleParameters.contains(paramsIndex.first)){
+                    m_staleParameters.insert(paramsIndex.first);
+                    printf("[WaveShow]: parameter(%s) is stale, its writer didn't finish a write\n",
+                           parameter->getName().c_str());
                 }
-                default:
-                    break;
+            }else{
+                m_staleParameters.remove(paramsIndex.first);
             }
-        }else{
-            switch (m_socketToPhawd->parameters[paramsIndex.first].getValueKind()){
-                case phawd::ParameterKind::VEC3_FLOAT:{
-                    float value;
-                    try{
-                        value = m_socketToPhawd->parameters[paramsIndex.first].getFromVec3fByIndex(paramsIndex.second);
-                        ui->widget->graph(i)->addData(time, value);
-                        break;
-                    } catch (std::runtime_error &err){
-                        QString paramName = QString::fromStdString(m_socketToPhawd->parameters[paramsIndex.first].getName());
-                        QString windowMessage = QString("Start Failed!Try to use getVec3f() for parameter(%1)"
-                                                        " that is not of type VEC3_FLOAT").arg(paramName);
-                        QMessageBox::critical(this, tr("Error"),
-                                              windowMessage,
-                                              QMessageBox::Discard,
-                                              QMessageBox::Discard);
-                        m_timer->stop();
-                        break;
-                    }
-                }
-                case phawd::ParameterKind::VEC3_DOUBLE:{
-                    double value;
-                    try{
-                        value = m_socketToPhawd->parameters[paramsIndex.first].getFromVec3dByIndex(paramsIndex.second);
-                        ui->widget->graph(i)->addData(time, value);
-                        break;
-                    } catch (std::runtime_error &err){
-                        QString paramName = QString::fromStdString(m_socketToPhawd->parameters[paramsIndex.first].getName());
-                        QString windowMessage = QString("Start Failed!Try to use getVec3d() for parameter(%1)"
-                                                        " that is not of type VEC3_DOUBLE").arg(paramName);
-                        QMessageBox::critical(this, tr("Error"),
-                                              windowMessage,
-                                              QMessageBox::Discard,
-                                              QMessageBox::Discard);
-                        m_timer->stop();
-                        break;
-                    }
-                }
-                case phawd::ParameterKind::DOUBLE:{
-                    double value;
-                    try{
-                        value = m_socketToPhawd->parameters[paramsIndex.first].getDouble();
-                        ui->widget->graph(i)->addData(time, value);
-                        break;
-                    } catch (std::runtime_error &err){
-                        QString paramName = QString::fromStdString(m_socketToPhawd->parameters[paramsIndex.first].getName());
-                        QString windowMessage = QString("Start Failed!Try to use getDouble() for parameter(%1)"
-                                                        " that is not of type DOUBLE").arg(paramName);
-                        QMessageBox::critical(this, tr("Error"),
-                                              windowMessage,
-                                              QMessageBox::Discard,
-                                              QMessageBox::Discard);
-                        m_timer->stop();
-                        break;
-                    }
-                }
-                case phawd::ParameterKind::FLOAT:{
-                    float value;
-                    try{
-                        value = m_socketToPhawd->parameters[paramsIndex.first].getFloat();
-                        ui->widget->graph(i)->addData(time, value);
-                        break;
-                    } catch (std::runtime_error &err){
-                        QString paramName = QString::fromStdString(m_socketToPhawd->parameters[paramsIndex.first].getName());
-                        QString windowMessage = QString("Start Failed!Try to use getFloat() for parameter(%1)"
-                                                        " that is not of type FLOAT").arg(paramName);
-                        QMessageBox::critical(this, tr("Error"),
-                                              windowMessage,
-                                              QMessageBox::Discard,
-                                              QMessageBox::Discard);
-                        m_timer->stop();
-                        break;
-                    }
+            if (!m_usingSocket && (kind == phawd::ParameterKind::VECN_DOUBLE ||
+                                   kind == phawd::ParameterKind::MATRIX_DOUBLE)){
+                // the elements and the size are read again together, the kind and size above may be older
+                QVector<double> &array = elements[paramsIndex.first];
+                array.resize((int)(value.array.rows * value.array.cols));
+                unsigned int rows = 0, cols = 0;
+                kind = m_sharedMessage->getWaveArray(paramsIndex.first - m_sharedMessage->waveParamsBegin,
+                                                     array.data(), array.count(), rows, cols);
+                array.resize(qMin(array.count(), (int)(rows * cols)));
+                ring = nullptr;
+            }
+            snapshots.insert(paramsIndex.first, qMakePair(kind, value));
+            if (ring != nullptr){
+                // the buffer of a channel is allocated once and reused every frame
+                QVector<phawd::WaveSample> &drained = m_drainBuffers[paramsIndex.first];
+                if (drained.count() < (int)ring->capacity()){
+                    drained.resize((int)ring->capacity());
                 }
-                case phawd::ParameterKind::S64:{
-                    long value;
-                    try{
-                        value = m_socketToPhawd->parameters[paramsIndex.first].getS64();
-                        ui->widget->graph(i)->addData(time, value);
-                        break;
-                    } catch (std::runtime_error &err){
-                        QString paramName = QString::fromStdString(m_socketToPhawd->parameters[paramsIndex.first].getName());
-                        QString windowMessage = QString("Start Failed!Try to use getS64() for parameter(%1)"
-                                                        " that is not of type S64").arg(paramName);
-                        QMessageBox::critical(this, tr("Error"),
-                                              windowMessage,
-                                              QMessageBox::Discard,
-                                              QMessageBox::Discard);
-                        m_timer->stop();
-                        break;
-                    }
+                int count = (int)ring->pop(drained.data(), ring->capacity());
+                drainedCount.insert(paramsIndex.first, count);
+                if (count > 0 && (oldest == 0 || drained[0].timestamp < oldest)){
+                    oldest = drained[0].timestamp;
                 }
-                default:
-                    break;
             }
         }
     }
+
+    if (timestamp != 0){
+        // The origin is the oldest sample drawn, so that the backlog of the rings doesn't start at negative time
+        if (m_firstTimestamp == 0){
+            m_firstTimestamp = oldest;
+        }
+        time = toPlotTime(timestamp);
+    }
+    for (int i = 0; i < ui->widget->graphCount(); i++){
+        paramsIndex = m_graphIndices[i];
+        if (paramsIndex.first < 0){
+            continue;
+        }
+        phawd::Parameter *parameter = m_usingSocket ? m_socketConnect->getParameter(paramsIndex.first) :
+                                                      &m_sharedMessage->parameters[paramsIndex.first];
+        const QPair<phawd::ParameterKind, phawd::ParameterValue> &snapshot = snapshots[paramsIndex.first];
+
+        double value = 0;
+        if (elements.contains(paramsIndex.first)){
+            const QVector<double> &array = elements[paramsIndex.first];
+            if (paramsIndex.second >= 0 && paramsIndex.second < array.count()){
+                ui->widget->graph(i)->addData(time, array[paramsIndex.second]);
+                continue;
+            }
+        }
+        if (m_staleParameters.contains(paramsIndex.first)){
+            continue;
+        }
+        if (!curveValue(snapshot.first, snapshot.second, paramsIndex.second, value)){
+            // the kind in the message is the one just read, not the one the curve was detected with
+            QString paramName = QString::fromStdString(parameter->getName());
+            QString windowMessage = QString("Start Failed!Parameter(%1) was read as %2, which doesn't match the "
+                                            "curve %3 it was detected with").arg(paramName)
+                                            .arg(QString::fromStdString(phawd::ParameterKindToString(snapshot.first)))
+                                            .arg(m_selectedToAddName[i]);
+            QMessageBox::critical(this, tr("Error"),
+                                  windowMessage,
+                                  QMessageBox::Discard,
+                                  QMessageBox::Discard);
+            m_timer->stop();
+            return;
+        }
+
+        if (drainedCount.contains(paramsIndex.first)){
+            const QVector<phawd::WaveSample> &drained = m_drainBuffers[paramsIndex.first];
+            int count = drainedCount.value(paramsIndex.first, 0);
+            for (int k = 0; k < count; k++){
+                curveValue(snapshot.first, drained[k].value, paramsIndex.second, value);
+                ui->widget->graph(i)->addData(toPlotTime(drained[k].timestamp), value);
+            }
+        } else {
+            ui->widget->graph(i)->addData(time, value);
+        }
+    }
     QCPRange XAxis_Range_Pre = ui->widget->xAxis->range();// Gets the axis value before adjustment
     if (time >= XAxis_Range_Pre.upper){
         XAxis_Range_Pre.lower = time - ui->xAxisWIDTH->value();
@@ -510,6 +487,23 @@ void WaveShow::closeEvent(QCloseEvent *event){
 
 void WaveShow::setSelections(QStringList paramsNames) {
     m_paramsNameList = std::move(paramsNames);
+    m_waveIndexOfLabel.clear();
+    if(!m_usingSocket && m_sharedMessage != nullptr){
+        for (size_t i = 0; i < m_sharedMessage->numWaveParams; i++){
+            m_waveIndexOfLabel.insert(QString::fromStdString(m_sharedMessage->getWaveLabel(i)),
+                                      (int)(m_sharedMessage->waveParamsBegin + i));
+        }
+    }
+    if(m_usingSocket && m_socketConnect != nullptr){
+        for (int client = 0; client < m_socketConnect->getClientCount(); client++){
+            phawd::SocketToPhawd *data = m_socketConnect->getRead(client);
+            for (size_t i = 0; i < data->numWaveParams; i++){
+                m_waveIndexOfLabel.insert(m_socketConnect->getClientName(client) + "/" +
+                                          QString::fromStdString(data->parameters[i].getName()),
+                                          m_socketConnect->getChannel(client, i));
+            }
+        }
+    }
 }
 
 void WaveShow::saveGraph() {
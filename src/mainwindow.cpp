@@ -57,6 +57,8 @@ void MainWindow::initForm(){
 
     ui->waveParameterNum->setMaximum(INT16_MAX);
     ui->waveParameterNum->setMinimum(0);
+    // only the final number matters when it changes while running, see waveParamNumChanged()
+    ui->waveParameterNum->setKeyboardTracking(false);
 
     this->readOnlyDelegate = new ReadOnlyDelegate();
     this->comboBoxDelegate = new ComboBoxDelegate();
@@ -110,17 +112,30 @@ void MainWindow::slotConnect(){
     connect(ui->paramTableWidget, SIGNAL(customContextMenuRequested(QPoint)), this, SLOT(tableMenuRequested(QPoint)));
 
     connect(ui->choicesBox, SIGNAL(currentIndexChanged(int)), this, SLOT(choiceChanged(int)));
+    connect(ui->waveParameterNum, SIGNAL(valueChanged(int)), this, SLOT(waveParamNumChanged(int)));
 
     connect(m_dataDetect, SIGNAL(detected(QStringList)), this, SLOT(receiveWaveParams(QStringList)));
-    connect(m_dataDetect,&DataDetect::detected, m_dataDetectThread,&QThread::quit);
     connect(this, SIGNAL(startDetect()), m_dataDetectThread, SLOT(start()));
     connect(this, SIGNAL(startDetect()), m_dataDetect, SLOT(doDetection()));
 
     connect(m_joystickWindow, SIGNAL(updated()), this, SLOT(updateGamepadCommand()));
-    connect(m_socketConnect, &SocketConnect::connected, this, [=](bool isConnected) {
-        m_socketConnected = isConnected;
-        this->createMessage("Socket Connect! PLease set all waveform parameters(Name, Value, ValueKind...)");
+    connect(m_socketConnect, &SocketConnect::connected, this, [=](int client, bool isConnected) {
+        // a client which disconnects is still counted while this is emitted
+        m_socketConnected = m_socketConnect->getClientCount() > (isConnected ? 0 : 1);
+        QString name = m_socketConnect->getClientName(client);
+        if(isConnected){
+            this->createMessage(QString("Socket Connect(%1)! PLease set all waveform parameters(Name, Value, ValueKind...)").arg(name));
+            return;
+        }
+        this->createMessage(QString("[Socket Connect] %1 disconnected").arg(name));
+        const phawd::SequenceTracker &telemetry = m_socketConnect->getTelemetryStats(client);
+        if(telemetry.received() > 0){
+            this->createMessage(QString("[Socket Connect] %1 UDP telemetry: %2 datagrams received, %3 lost, %4 out of order, %5 duplicated")
+                                    .arg(name).arg(telemetry.received()).arg(telemetry.lost()).arg(telemetry.reordered())
+                                    .arg(telemetry.duplicated()));
+        }
     });
+    connect(m_socketConnect, &SocketConnect::schemaReady, this, &MainWindow::socketSchemaReady);
     connect(m_socketConnect, &SocketConnect::readReady, this, &MainWindow::socketReadyRead);
     // finished Signal detection is unnecessary, since we do not need to clean up immediately after the thread exits,
     // the following one is only used to test the thread exit
@@ -134,6 +149,42 @@ void MainWindow::receiveWaveParams(QStringList paramsNames){
     m_waveShow->setSelections(m_paramsNameList);
 }
 
+void MainWindow::waveParamNumChanged(int num){
+    if(!ui->readyButton->signalsBlocked() || m_usingSocket){
+        return;
+    }
+    // the parameters reserved for the gaps between producers aren't counted in the table
+    int current = (int)(m_sharedObject().numWaveParams - phawd::SharedParameters::getProducerPadding(
+                                                        m_sharedObject().separateRegions));
+    if(num <= current){
+        if(num < current){
+            this->createMessage("[Shared Memory] Waveform parameters can't be removed while running, click undo first");
+            ui->waveParameterNum->setValue(current);
+        }
+        return;
+    }
+    // grow the shared memory in place, the robot program keeps running and only needs to set the new parameters
+    try{
+        m_sharedObject.grow(phawd::SharedParameters::getSize(ui->paramTableWidget->rowCount(), num, m_sampleRingSize,
+                                                               m_sharedObject().separateRegions, m_dataArenaSize));
+    }catch(std::runtime_error& err){
+        this->createWarningMessage(err.what());
+        ui->waveParameterNum->setValue(current);
+        return;
+    }
+    m_sharedObject().addWaveParameters(num - current);
+    this->createMessage(QString("[Shared Memory] %1 waveform parameters added, now there are %2").arg(num - current).arg(num));
+
+    // detect again, so that the new parameters show up once the robot program has set them
+    if(!m_dataDetectThread->isRunning()){
+        m_dataDetect->setSharedMessage(m_sharedObject.get());
+        m_dataDetect->setStopFlag(false);
+        m_waveShow->setSharedMessage(m_sharedObject.get());
+        emit startDetect();
+        this->createMessage("Enter the data input detecting state");
+    }
+}
+
 void MainWindow::updateGamepadCommand(){
     if(m_usingSocket){
         if(ui->readyButton->signalsBlocked() && m_socketFromPhawd != nullptr && m_socketConnected){
@@ -153,95 +204,85 @@ void MainWindow::updateGamepadCommand(){
     }
 }
 
-void MainWindow::socketReadyRead(){
+void MainWindow::socketSchemaReady(){
+    // names and kinds are only parsed when a client changes them or comes and goes, not for every message.
+    // Every robot has its own namespace, so that the same parameter of several robots can be overlaid
     m_paramsNameList.clear();
-    try {
-        if (m_socketConnect->getRead() == nullptr && m_socketConnect->getRead()->numWaveParams <= 0) {
-            throw std::runtime_error("Socket read error");
-        }
-        if (m_socketConnect->getRead()->numWaveParams > ui->waveParameterNum->value()) {
-            throw std::runtime_error("The number of parameters is incorrect: parameters in heap is less than the client sends");
+    for(int client = 0; client < m_socketConnect->getClientCount(); client++) {
+        QStringList names;
+        try {
+            names = socketWaveNames(client);
+        } catch (std::runtime_error& err) {
+            // the other robots are still shown
+            this->createWarningMessage(m_socketConnect->getClientName(client) + ": " + err.what());
+            continue;
         }
-    }catch (std::runtime_error& err){
-        this->createWarningMessage(err.what());
-        return;
+        m_paramsNameList.append(names);
     }
 
-    for(size_t i = 0; i < m_socketConnect->getRead()->numWaveParams; i++) {
-        std::string paramName = m_socketConnect->getRead()->parameters[i].getName();
-        bool isSet = m_socketConnect->getRead()->parameters[i].isSet();
-        try {
-            if(paramName.empty()){
-                throw std::runtime_error("Please complete all parameters name in client program!");
-            }
-            if(!isSet){
-                std::string message = "Please complete " + std::to_string(i) + "th parameter's value and kind";
-                throw std::runtime_error(message);
-            }
-        } catch(std::runtime_error& err){
-            this->createWarningMessage(err.what());
-            this->createWarningMessage("Read waveform parameters error");
-            return;
-        }
+    m_waveShow->setSocketConnect(m_socketConnect);
+    m_waveShow->setSelections(m_paramsNameList);
+}
 
-        switch (m_socketConnect->getRead()->parameters[i].getValueKind()) {
-            case phawd::ParameterKind::VEC3_DOUBLE: {
-                std::string paramNameX = paramName + "-x";
-                std::string paramNameY = paramName + "-y";
-                std::string paramNameZ = paramName + "-z";
-                m_paramsNameList.append(QString::fromStdString(paramNameX));
-                m_paramsNameList.append(QString::fromStdString(paramNameY));
-                m_paramsNameList.append(QString::fromStdString(paramNameZ));
-                break;
-            }
-            case phawd::ParameterKind::VEC3_FLOAT: {
-                std::string paramNameX = paramName + "-x";
-                std::string paramNameY = paramName + "-y";
-                std::string paramNameZ = paramName + "-z";
-                m_paramsNameList.append(QString::fromStdString(paramNameX));
-                m_paramsNameList.append(QString::fromStdString(paramNameY));
-                m_paramsNameList.append(QString::fromStdString(paramNameZ));
+QStringList MainWindow::socketWaveNames(int client){
+    phawd::SocketToPhawd *data = m_socketConnect->getRead(client);
+    QString prefix = m_socketConnect->getClientName(client) + "/";
+    QStringList names;
+    if (data->numWaveParams <= 0) {
+        throw std::runtime_error("Socket received data but they are not initialized!");
+    }
+    if (data->numWaveParams > ui->waveParameterNum->value()) {
+        throw std::runtime_error("The number of parameters is incorrect: parameters in heap is less than the client sends");
+    }
+
+    for(size_t i = 0; i < data->numWaveParams; i++) {
+        std::string paramName = data->parameters[i].getName();
+        if(paramName.empty()){
+            throw std::runtime_error("Please complete all parameters name in client program!");
+        }
+        if(!data->parameters[i].isSet()){
+            throw std::runtime_error("Please complete " + std::to_string(i) + "th parameter's value and kind");
+        }
+        QString name = prefix + QString::fromStdString(paramName);
+        switch (data->parameters[i].getValueKind()) {
+            case phawd::ParameterKind::VEC3_DOUBLE:
+            case phawd::ParameterKind::VEC3_FLOAT:
+                names.append(name + "-x");
+                names.append(name + "-y");
+                names.append(name + "-z");
                 break;
-            }
             default:
-                m_paramsNameList.append(QString::fromStdString(paramName));
+                names.append(name);
                 break;
         }
     }
 
-    try{
-        if (m_paramsNameList.isEmpty()) {
-            throw std::runtime_error("Socket received data but they are not initialized!");
-        }
-    }catch(std::runtime_error& err){
-        this->createWarningMessage(err.what());
-        return;
+    if (names.removeDuplicates() > 0) {
+        throw std::runtime_error("Socket received data but the parameter with the same name exists");
     }
 
-    bool sameName = false;
-    QMap<QString, int> countOfString;
-    for (int j = 0; j < m_paramsNameList.count(); j++) {
-        countOfString[m_paramsNameList[j]]++;
-        if (countOfString[m_paramsNameList[j]] > 1) {
-            sameName = true;
-            break;
+    QStringList units;
+    const std::vector<std::string> &unitOfParams = m_socketConnect->getUnits(client);
+    for(size_t i = 0; i < unitOfParams.size(); i++) {
+        if(!unitOfParams[i].empty()){
+            units.append(QString("%1 [%2]").arg(prefix + QString::fromStdString(data->parameters[i].getName()),
+                                                QString::fromStdString(unitOfParams[i])));
         }
     }
-
-    try{
-        if (sameName) {
-            throw std::runtime_error("Socket received data but the parameter with the same name exists");
-        }
-    }catch(std::runtime_error& err){
-        this->createWarningMessage(err.what());
-        return;
+    if(!units.isEmpty()){
+        this->createMessage("[Socket Connect] Units of waveform parameters: " + units.join(", "));
     }
+    return names;
+}
 
-    m_waveShow->setSocketMessage(m_socketConnect->getRead());
-    m_waveShow->setSelections(m_paramsNameList);
+void MainWindow::socketReadyRead(int client){
+    if(m_paramsNameList.isEmpty()){
+        return; // the waveform parameters sent by the clients are not valid
+    }
+    // only the robot which sent is answered, the others get their own replies
     try{
-        m_socketConnect->sendData(m_socketFromPhawd, sizeof(phawd::SocketFromPhawd) +
-                                                     sizeof(phawd::Parameter) * ui->paramTableWidget->rowCount());
+        m_socketConnect->sendData(client, m_socketFromPhawd, sizeof(phawd::SocketFromPhawd) +
+                                                             sizeof(phawd::Parameter) * ui->paramTableWidget->rowCount());
     } catch (std::runtime_error& err){
         createWarningMessage(err.what());
         createMessage("[Socket Connect] write data failed");
@@ -318,9 +359,12 @@ void MainWindow::clickReadyButton(){
          */
         if(!m_usingSocket){
             this->createMessage("Building Shared Memory...");
-            size_t memSize = sizeof(phawd::SharedParameters) + (rowCount + waveParamCount) * sizeof(phawd::Parameter);
+            size_t memSize = phawd::SharedParameters::getSize(rowCount, waveParamCount, m_sampleRingSize, m_separateRegions,
+                                                              m_dataArenaSize);
             try{
-                m_sharedObject.createNew(ui->robotNameEdit->text().toStdString(), memSize);
+                unsigned int options = m_realTimeMemory ? phawd::SHM_PREFAULT | phawd::SHM_MLOCK | phawd::SHM_HUGE_PAGES
+                                                        : phawd::SHM_NO_OPTION;
+                m_sharedObject.createNew(ui->robotNameEdit->text().toStdString(), memSize, true, options);
             }catch (std::runtime_error& err){
                 this->createWarningMessage(err.what());
                 this->createWarningMessage("Build Shared Memory failed, please follow the tips and retry!");
@@ -329,9 +373,9 @@ void MainWindow::clickReadyButton(){
 
             QString strMessage1 = QString("[Shared Memory] CreateNew(%1) success, size: %2 bytes").arg(ui->robotNameEdit->text()).arg(memSize);
             this->createMessage(strMessage1);
-            m_sharedObject().gameCommand.init();
-            m_sharedObject().numControlParams = rowCount;
-            m_sharedObject().numWaveParams = waveParamCount;
+            m_sharedObject().init(rowCount, waveParamCount, m_sampleRingSize, m_separateRegions, m_dataArenaSize);
+            // both banks of control parameters start with the table, see commitControlUpdate()
+            phawd::Parameter *staging = m_sharedObject().getControlStaging();
 
             for(int row = 0; row < rowCount; row++){
                 QString dataOfCol1 = ui->paramTableWidget->model()->index(row, 0, QModelIndex()).data().toString();
@@ -343,26 +387,26 @@ void MainWindow::clickReadyButton(){
                 QString withoutBracket = dataOfCol3.remove(bracket);
                 QStringList list = withoutBracket.split(split);
 
-                m_sharedObject().parameters[row].setName(dataOfCol1.toStdString());
+                staging[row].setName(dataOfCol1.toStdString());
                 phawd::ParameterKind kind = phawd::getParameterKindFromString(dataOfCol2.toStdString());
-                m_sharedObject().parameters[row].setValueKind(kind);
+                staging[row].setValueKind(kind);
 
                 switch (kind){
                     case phawd::ParameterKind::FLOAT:
-                        m_sharedObject().parameters[row].setValue(list.at(0).toFloat());
+                        staging[row].setValue(list.at(0).toFloat());
                         break;
                     case phawd::ParameterKind::DOUBLE:
-                        m_sharedObject().parameters[row].setValue(list.at(0).toDouble());
+                        staging[row].setValue(list.at(0).toDouble());
                         break;
                     case phawd::ParameterKind::S64:
-                        m_sharedObject().parameters[row].setValue(list.at(0).toLong());
+                        staging[row].setValue(list.at(0).toLong());
                         break;
                     case phawd::ParameterKind::VEC3_FLOAT:{
                         float value[3];
                         for (int i = 0; i < 3; i++){
                             value[i] = list.at(i).toFloat();
                         }
-                        m_sharedObject().parameters[row].setValue(value);
+                        staging[row].setValue(value);
                         break;
                     }
                     case phawd::ParameterKind::VEC3_DOUBLE:{
@@ -370,13 +414,14 @@ void MainWindow::clickReadyButton(){
                         for (int i = 0; i < 3; i++){
                             value[i] = list.at(i).toDouble();
                         }
-                        m_sharedObject().parameters[row].setValue(value);
+                        staging[row].setValue(value);
                         break;
                     }
                     default:
                         break;
                 }
             }
+            m_sharedObject().commitControlUpdate();
             /*! Todo: Close the data detect thread is important */
             if(waveParamCount > 0){
                 m_dataDetect->setSharedMessage(m_sharedObject.get());
@@ -389,7 +434,11 @@ void MainWindow::clickReadyButton(){
 
             QString strMessage2 = QString("[Shared Memory] Construction completed, of which there are %1 control parameters and %2 waveform parameters").arg(rowCount).arg(waveParamCount);
             this->createMessage(strMessage2);
-            this->createMessage("[Shared Memory] Please attach the same size to this shared memory!");
+            if(m_sampleRingSize > 0){
+                this->createMessage(QString("[Shared Memory] Each waveform parameter has a ring of %1 samples, "
+                                            "call pushWaveSamples() once per control cycle").arg(m_sampleRingSize));
+            }
+            this->createMessage("[Shared Memory] Please attach to this shared memory by name, or with the same size!");
         }else{
             this->createMessage("Creating Socket Server...");
             // using socket
@@ -462,7 +511,8 @@ void MainWindow::clickReadyButton(){
         //Set first two columns to read-only, keeping the last column editable
         ui->paramTableWidget->setItemDelegateForColumn(0, this->readOnlyDelegate);
         ui->paramTableWidget->setItemDelegateForColumn(1, this->readOnlyDelegate);
-        ui->waveParameterNum->setReadOnly(true);
+        // shared memory can grow while running, see waveParamNumChanged()
+        ui->waveParameterNum->setReadOnly(m_usingSocket);
 
         ui->addButton->blockSignals(true);
         ui->deleteButton->blockSignals(true);
@@ -487,6 +537,7 @@ void MainWindow::clickUndoButton(){
                 m_waveShow->clearPtr();
             }
             this->createMessage("[Shared Memory] Releasing the shared memory");
+            m_holdControlUpdates = false;
             try{
                 m_sharedObject.closeNew();
             }catch(std::runtime_error& err){
@@ -597,17 +648,19 @@ void MainWindow::cellModified(int row, int column) {
     }else{
         if(ui->readyButton->signalsBlocked() && m_sharedObject.get() != nullptr){
             if(checkOneRow(row)){
+                // edits are staged and published all at once, so the robot program never sees half of them
+                phawd::Parameter *staging = m_sharedObject().getControlStaging();
                 switch (kind) {
                     case phawd::ParameterKind::FLOAT:{
-                        m_sharedObject().parameters[row].setValue(list.at(0).toFloat());
+                        staging[row].setValue(list.at(0).toFloat());
                         break;
                     }
                     case phawd::ParameterKind::DOUBLE:{
-                        m_sharedObject().parameters[row].setValue(list.at(0).toDouble());
+                        staging[row].setValue(list.at(0).toDouble());
                         break;
                     }
                     case phawd::ParameterKind::S64:{
-                        m_sharedObject().parameters[row].setValue(list.at(0).toLong());
+                        staging[row].setValue(list.at(0).toLong());
                         break;
                     }
                     case phawd::ParameterKind::VEC3_FLOAT:{
@@ -615,7 +668,7 @@ void MainWindow::cellModified(int row, int column) {
                         for (int i = 0; i < 3; i++) {
                             value[i] = list.at(i).toFloat();
                         }
-                        m_sharedObject().parameters[row].setValue(value);
+                        staging[row].setValue(value);
                         break;
                     }
                     case phawd::ParameterKind::VEC3_DOUBLE:{
@@ -623,13 +676,19 @@ void MainWindow::cellModified(int row, int column) {
                         for (int i = 0; i < 3; i++) {
                             value[i] = list.at(i).toDouble();
                         }
-                        m_sharedObject().parameters[row].setValue(value);
+                        staging[row].setValue(value);
                         break;
                     }
                     default:
                         return;
                         break;
                 }
+                if(m_holdControlUpdates){
+                    this->createMessage(QString("[Shared Memory] Change of %1 held, apply updates to publish it")
+                                        .arg(ui->paramTableWidget->model()->index(row, 0, QModelIndex()).data().toString()));
+                }else{
+                    m_sharedObject().commitControlUpdate();
+                }
             }else{
                 return;
             }
@@ -808,6 +867,20 @@ void MainWindow::tableMenuRequested(QPoint pos){
             }});
         menu.addAction(tr("Load From File"), this, &MainWindow::clickReadFileButton);
         menu.addAction(tr("Save to File"), this, &MainWindow::clickSaveFileButton);
+        if(!m_usingSocket && ui->readyButton->signalsBlocked()){
+            // hold edits of several control parameters, e.g. a set of gains, and let the robot program switch to all
+            // of them in the same control cycle
+            menu.addSeparator();
+            if(m_holdControlUpdates){
+                menu.addAction(tr("Apply Updates"), this, [=](){
+                    m_holdControlUpdates = false;
+                    m_sharedObject().commitControlUpdate();
+                    this->createMessage("[Shared Memory] Held changes of control parameters published");
+                });
+            }else{
+                menu.addAction(tr("Hold Updates"), this, [=](){ m_holdControlUpdates = true; });
+            }
+        }
         menu.exec(QCursor::pos());
     }
 }
@@ -851,6 +924,10 @@ void MainWindow::saveToFile(){
             userParameters["RobotName"] = ui->robotNameEdit->text().toStdString();
             userParameters["Type"] = ui->choicesBox->currentText().toStdString();
             userParameters["WaveParamNum"] = ui->waveParameterNum->value();
+            userParameters["SampleRingSize"] = m_sampleRingSize;
+            userParameters["DataArenaSize"] = m_dataArenaSize;
+            userParameters["RealTimeMemory"] = m_realTimeMemory;
+            userParameters["SeparateRegions"] = m_separateRegions;
             for (int row = 0; row < rowCount; row++) {
                 QString dataOfCol1 = ui->paramTableWidget->model()->index(row, 0, QModelIndex()).data().toString();
                 QString dataOfCol2 = ui->paramTableWidget->model()->index(row, 1, QModelIndex()).data().toString();
@@ -869,6 +946,10 @@ void MainWindow::saveToFile(){
             userParameters["RobotName"] = ui->robotNameEdit->text().toStdString();
             userParameters["Type"] = ui->choicesBox->currentText().toStdString();
             userParameters["WaveParamNum"] = ui->waveParameterNum->value();
+            userParameters["SampleRingSize"] = m_sampleRingSize;
+            userParameters["DataArenaSize"] = m_dataArenaSize;
+            userParameters["RealTimeMemory"] = m_realTimeMemory;
+            userParameters["SeparateRegions"] = m_separateRegions;
             userParameters["FLOAT"]["ParametersName"] = YAML::Load("[]");
             userParameters["DOUBLE"]["ParametersName"] = YAML::Load("[]");
             userParameters["S64"]["ParametersName"] = YAML::Load("[]");
@@ -931,6 +1012,50 @@ void MainWindow::readFromFile(){
             this->createMessage("No definition for WaveParamNum in this yaml file");
         }
 
+        // Optional, shared memory is created without waveform rings if it's not given
+        m_sampleRingSize = 0;
+        if(userParameters["SampleRingSize"].IsDefined() && userParameters["SampleRingSize"].IsScalar()){
+            QString sampleRingSize = QString::fromStdString(userParameters["SampleRingSize"].as<std::string>());
+            qulonglong size = sampleRingSize.toULongLong(&ok);
+            if (ok){
+                m_sampleRingSize = size;
+            }else{
+                this->createMessage("Invalid SampleRingSize: Should be positive integer");
+            }
+        }
+
+        // Optional, robot programs can only publish VECN/MATRIX waveform parameters if it's given
+        m_dataArenaSize = 0;
+        if(userParameters["DataArenaSize"].IsDefined() && userParameters["DataArenaSize"].IsScalar()){
+            QString dataArenaSize = QString::fromStdString(userParameters["DataArenaSize"].as<std::string>());
+            qulonglong size = dataArenaSize.toULongLong(&ok);
+            if (ok){
+                m_dataArenaSize = size;
+            }else{
+                this->createMessage("Invalid DataArenaSize: Should be positive integer");
+            }
+        }
+
+        // Optional, robot programs attaching with SHM_HUGE_PAGES need it to find the shared memory
+        m_realTimeMemory = false;
+        if(userParameters["RealTimeMemory"].IsDefined() && userParameters["RealTimeMemory"].IsScalar()){
+            try{
+                m_realTimeMemory = userParameters["RealTimeMemory"].as<bool>();
+            }catch (std::runtime_error& err){
+                this->createMessage("Invalid RealTimeMemory: Should be true or false");
+            }
+        }
+
+        // Optional, keeps control and waveform parameters on different cache lines, independent of RealTimeMemory
+        m_separateRegions = false;
+        if(userParameters["SeparateRegions"].IsDefined() && userParameters["SeparateRegions"].IsScalar()){
+            try{
+                m_separateRegions = userParameters["SeparateRegions"].as<bool>();
+            }catch (std::runtime_error& err){
+                this->createMessage("Invalid SeparateRegions: Should be true or false");
+            }
+        }
+
         rowCount = 0;
         // Check all parameter value kind
         for (auto &kind : phawd::ParameterKinds){